@@ -3,6 +3,7 @@
 #include <getopt.h>
 #include <libgen.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -30,6 +31,12 @@ static struct option longopts[] = {
     {"hfile", required_argument, NULL, 'H'},
 #define GENDATA_OPT_CFILE   3
     {"cfile", required_argument, NULL, 'C'},
+#define GENDATA_OPT_VIEWS   4
+    {"views", no_argument, NULL, 'V'},
+#define GENDATA_OPT_LAZY    5
+    {"lazy", no_argument, NULL, 'L'},
+#define GENDATA_OPT_TABLES  6
+    {"tables", no_argument, NULL, 'T'},
     {NULL, 0, NULL, 0},
 };
 
@@ -43,6 +50,16 @@ usage(char *progname)
         "  -h, --help               Print help message and exit.\n"
         "  -H, --hfile              Path to C header file.  Default to <file.proto>.h.\n"
         "  -C, --cfile              Path to C source file.  Default to <file.proto>.c.\n"
+        "  -V, --views              Decode string and bytes fields as\n"
+        "                           mnpb_view_t into the input buffer\n"
+        "                           instead of copying them.\n"
+        "  -L, --lazy               Keep embedded messages as raw wire\n"
+        "                           data until first accessed through\n"
+        "                           <msg>_get_<field>().\n"
+        "  -T, --tables             Emit field descriptor tables, and\n"
+        "                           have <msg>_unpack(), _pack_cached(),\n"
+        "                           _sz(), _fini() and _dump() interpret\n"
+        "                           them instead of unrolled code.\n"
         "\n",
         basename(progname));
 }
@@ -56,6 +73,9 @@ main(UNUSED int argc, char **argv)
     mnpbc_ctx_t ctx;
     mnbytes_t *namein, *nameout0, *nameout1;
     FILE *in, *out0, *out1;
+    bool views;
+    bool lazy;
+    bool tables;
 
 #ifdef HAVE_MALLOC_H
 #   ifndef NDEBUG
@@ -73,8 +93,11 @@ main(UNUSED int argc, char **argv)
 
     nameout0 = NULL;
     nameout1 = NULL;
+    views = false;
+    lazy = false;
+    tables = false;
 
-    while ((ch = getopt_long(argc, argv, "hH:C:", longopts, NULL)) != -1) {
+    while ((ch = getopt_long(argc, argv, "hH:C:VLT", longopts, NULL)) != -1) {
         switch (ch) {
         case 'h':
             usage(argv[0]);
@@ -95,6 +118,18 @@ main(UNUSED int argc, char **argv)
             nameout1 = bytes_new_from_str(optarg);
             break;
 
+        case 'V':
+            views = true;
+            break;
+
+        case 'L':
+            lazy = true;
+            break;
+
+        case 'T':
+            tables = true;
+            break;
+
         case '?':
             /* unknown option */
             usage(argv[0]);
@@ -109,10 +144,24 @@ main(UNUSED int argc, char **argv)
         }
     }
 
+    if (tables && lazy) {
+        usage(argv[0]);
+        errx(1, "--tables and --lazy are exclusive");
+    }
+
+    /* views would point into the raw data released on first access */
+    if (views && lazy) {
+        usage(argv[0]);
+        errx(1, "--views and --lazy are exclusive");
+    }
+
     argc -= optind;
     argv += optind;
 
     mnpbc_ctx_init(&ctx);
+    ctx.flags.views = views;
+    ctx.flags.lazy = lazy;
+    ctx.flags.tables = tables;
 
     if (argc < 1) {
         namein = bytes_new_from_str("test");
@@ -81,7 +81,11 @@ typedef struct _mnpbc_container {
         mnbytes_t *name;
         mnbytes_t *fqname;
         mnbytes_t *encode;
+        /* reverse encoder, into mnpb_rbuf_t */
+        mnbytes_t *rencode;
         mnbytes_t *decode;
+        /* bulk decoder of a packed run, NULL if none */
+        mnbytes_t *decode_packed;
         mnbytes_t *sz;
         mnbytes_t *rawsz;
         mnbytes_t *dump;
@@ -127,6 +131,15 @@ typedef struct _mnpbc_ctx {
 
     /* weakref mnpbc_container_t * */
     mnarray_t stack;
+
+    struct {
+        /* string and bytes as mnpb_view_t into the input buffer */
+        int views:1;
+        /* embedded messages decoded on first access */
+        int lazy:1;
+        /* descriptor tables run by mnpb_tbl_*() */
+        int tables:1;
+    } flags;
 } mnpbc_ctx_t;
 
 
@@ -185,9 +198,15 @@ void mnpbc_container_set_pb_fqname(mnpbc_container_t *,
 void mnpbc_container_set_be_encode(mnpbc_container_t *,
                                     mnbytes_t *);
 
+void mnpbc_container_set_be_rencode(mnpbc_container_t *,
+                                     mnbytes_t *);
+
 void mnpbc_container_set_be_decode(mnpbc_container_t *,
                                     mnbytes_t *);
 
+void mnpbc_container_set_be_decode_packed(mnpbc_container_t *,
+                                           mnbytes_t *);
+
 void mnpbc_container_set_be_sz(mnpbc_container_t *,
                                 mnbytes_t *);
 
@@ -201,6 +220,10 @@ void mnpbc_container_traverse_fields(mnpbc_container_t *,
                                       array_traverser_t,
                                       void *);
 
+void mnpbc_container_traverse_fields_reverse(mnpbc_container_t *,
+                                              array_traverser_t,
+                                              void *);
+
 void mnpbc_container_traverse_containers(mnpbc_container_t *,
                                           array_traverser_t,
                                           void *);
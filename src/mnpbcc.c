@@ -72,6 +72,153 @@ mnpbc_wtype_from_type(mnpbc_container_t *ty)
 }
 
 
+/*
+ * string or bytes decoded as mnpb_view_t: no ownership, empty when data
+ * is NULL
+ */
+static int
+mnpbc_container_is_view(mnpbc_container_t *ty)
+{
+    return ty->ctx->flags.views &&
+        ty->kind == MNPBC_CONT_KBUILTIN &&
+        (bytes_cmp(ty->pb.name, &_string) == 0 ||
+         bytes_cmp(ty->pb.name, &_bytes) == 0);
+}
+
+
+/*
+ * element width of a fixed32/fixed64/float/double field, zero otherwise
+ */
+static int
+mnpbc_field_fixed_width(mnpbc_field_t *field)
+{
+    if (field->cty == NULL || field->cty->kind != MNPBC_CONT_KBUILTIN) {
+        return 0;
+    }
+    switch (field->wtype) {
+    case MNPB_WT_32BIT:
+        return 4;
+    case MNPB_WT_64BIT:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+
+/*
+ * wire types the field's decoder accepts, a bit each: its own, and for
+ * some scalars a fixed width the runtime widens or narrows from
+ */
+static int
+mnpbc_field_wtypes(mnpbc_field_t *field)
+{
+    mnpbc_container_t *cty;
+    int res;
+
+    if (field->flags.repeated) {
+        return 1 << MNPB_WT_LDELIM;
+    }
+    res = 1 << field->wtype;
+    cty = field->cty;
+    if (cty->kind == MNPBC_CONT_KENUM) {
+        res |= 1 << MNPB_WT_64BIT;
+    } else if (cty->kind != MNPBC_CONT_KBUILTIN) {
+        return res;
+    } else if (bytes_cmp(cty->pb.name, &_int64) == 0 ||
+               bytes_cmp(cty->pb.name, &_uint64) == 0 ||
+               bytes_cmp(cty->pb.name, &_float) == 0) {
+        res |= 1 << MNPB_WT_64BIT;
+    } else if (bytes_cmp(cty->pb.name, &_int32) == 0 ||
+               bytes_cmp(cty->pb.name, &_uint32) == 0 ||
+               bytes_cmp(cty->pb.name, &_double) == 0) {
+        res |= 1 << MNPB_WT_32BIT;
+    } else if (bytes_cmp(cty->pb.name, &_bool) == 0) {
+        res |= (1 << MNPB_WT_64BIT) | (1 << MNPB_WT_32BIT);
+    }
+    return res;
+}
+
+
+/*
+ * key as emitted for mnpb_entag(): its varint bytes in a word, first
+ * byte lowest, and their number
+ */
+static uint64_t
+mnpbc_tag_word(uint64_t key)
+{
+    uint64_t w;
+    int i;
+
+    for (w = 0, i = 0; key >= 0x80; ++i, key >>= 7) {
+        w |= ((key & 0x7f) | 0x80) << (i * 8);
+    }
+    return w | (key << (i * 8));
+}
+
+
+static int
+mnpbc_tag_sz(uint64_t key)
+{
+    int res;
+
+    for (res = 1; key >= 0x80; key >>= 7) {
+        ++res;
+    }
+    return res;
+}
+
+#define MNPBC_TAG(key) mnpbc_tag_word(key), mnpbc_tag_sz(key)
+
+/* tags below it have single byte keys, dispatched through a table */
+#define MNPBC_SLOT_DENSE 16
+
+
+/*
+ * singular embedded message kept as raw wire data until first accessed
+ */
+static int
+mnpbc_field_is_lazy(mnpbc_field_t *field)
+{
+    return field->parent->ctx->flags.lazy &&
+        !field->flags.repeated &&
+        field->cty != NULL &&
+        field->cty->kind == MNPBC_CONT_KMESSAGE &&
+        field->wtype == MNPB_WT_LDELIM;
+}
+
+
+/*
+ * repeated string, bytes or message field: elements past sz keep their
+ * storage after _clear for the next decode to reuse, and are released by
+ * _fini up to cap; a cleared message is as good as a zeroed one, but
+ * kept strings and bytes are only for the decoder, through
+ * _alloc_retained
+ */
+static int
+mnpbc_field_retains(mnpbc_field_t *field)
+{
+    mnpbc_container_t *cty;
+
+    cty = field->cty;
+    return field->flags.repeated &&
+        cty != NULL &&
+        (cty->kind == MNPBC_CONT_KMESSAGE ||
+         (cty->kind == MNPBC_CONT_KBUILTIN &&
+          !mnpbc_container_is_view(cty) &&
+          (bytes_cmp(cty->pb.name, &_string) == 0 ||
+           bytes_cmp(cty->pb.name, &_bytes) == 0)));
+}
+
+
+static int
+mnpbc_field_retains_bytes(mnpbc_field_t *field)
+{
+    return mnpbc_field_retains(field) &&
+        field->cty->kind != MNPBC_CONT_KMESSAGE;
+}
+
+
 static mnbytes_t *
 mnpbc_module_name_upper(mnpbc_ctx_t *ctx)
 {
@@ -88,6 +235,34 @@ mnpbc_module_name_upper(mnpbc_ctx_t *ctx)
 }
 
 
+static mnbytes_t *
+mnpbc_container_name_upper(mnpbc_container_t *cont)
+{
+    mnbytes_t *res;
+    res = bytes_new_from_bytes(cont->be.fqname);
+    bytes_tr(
+        res,
+        (unsigned char *)
+        "qwertyuiopasdfghjklzxcvbnm!@#$%^&*()-=_+[]{};\"':,./<>?",
+        (unsigned char *)
+        "QWERTYUIOPASDFGHJKLZXCVBNM____________________________",
+        54);
+    return res;
+}
+
+
+/*
+ * field (or oneof member) that a projection mask can descend into
+ */
+static int
+mnpbc_field_has_submask(mnpbc_field_t *field)
+{
+    return field->cty != NULL &&
+        field->cty->kind == MNPBC_CONT_KMESSAGE &&
+        !mnpbc_field_is_lazy(field);
+}
+
+
 UNUSED static mnbytes_t *
 mnpbc_module_name_normalized(mnpbc_ctx_t *ctx)
 {
@@ -248,6 +423,12 @@ print_forward_decl(UNUSED mnbytes_t *key,
                        "%s%s;\n",
                        mnpbc_container_keyword(cont),
                        BDATA(cont->be.fqname));
+    if (cont->kind == MNPBC_CONT_KMESSAGE) {
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "struct %s_mask;\n",
+                                 BDATA(cont->be.fqname));
+    }
     return 0;
 }
 
@@ -315,7 +496,8 @@ print_field_repeated(mnpbc_field_t *field, mnbytestream_t *bs)
                             "    struct {\n");
     (void)bytestream_nprintf(bs,
                             1024,
-                            "        size_t sz;\n");
+                            "        size_t sz;\n"
+                            "        size_t cap;\n");
     print_field_single(field, bs, "        ");
 
     (void)bytestream_nprintf(bs,
@@ -337,6 +519,11 @@ print_field(mnpbc_field_t **field, mnbytestream_t *bs)
         res =print_field_repeated(*field, bs);
     } else {
         res = print_field_single(*field, bs, "    ");
+        if (mnpbc_field_is_lazy(*field)) {
+            (void)bytestream_nprintf(bs, 1024,
+                                     "    mnbytes_t *_mnpbcc_lazy_%s;\n",
+                                     BDATA((*field)->be.name));
+        }
     }
 
     return res;
@@ -380,7 +567,10 @@ print_decl_recursive(mnpbc_container_t *cont, mnbytestream_t *bs)
                        BDATA(cont->be.fqname));
 
     if (cont->kind == MNPBC_CONT_KMESSAGE) {
-        (void)bytestream_nprintf(bs, 1024, "    ssize_t _mnpbcc_rawsz;\n");
+        (void)bytestream_nprintf(bs, 1024,
+                                 "    ssize_t _mnpbcc_rawsz;\n"
+                                 "    /* as of the last _sz */\n"
+                                 "    size_t _mnpbcc_cachedsz;\n");
     }
 
     mnpbc_container_traverse_fields(cont, (array_traverser_t)print_field, bs);
@@ -417,6 +607,12 @@ print_alloc_decl_field(mnpbc_field_t **field, mnbytestream_t *bs)
         cont = (*field)->parent;
         kwc = mnpbc_container_keyword(cont);
 
+        (void)bytestream_nprintf(bs, 1024,
+            "int %s_%s_reserve(%s%s *, size_t);\n",
+            BDATA(cont->be.fqname),
+            BDATA((*field)->be.name),
+            kwc,
+            BDATA(cont->be.fqname));
         (void)bytestream_nprintf(bs, 1024,
             "%s%s *%s_%s_alloc(%s%s *, int);\n",
             kwf == NULL ? "" : kwf,
@@ -439,6 +635,119 @@ print_alloc_decl(mnpbc_container_t *cont, mnbytestream_t *bs)
 }
 
 
+static int
+print_get_decl_field(mnpbc_field_t **field, mnbytestream_t *bs)
+{
+    if (mnpbc_field_is_lazy(*field)) {
+        mnpbc_container_t *cont;
+        char *kwf, *kwc;
+
+        kwf = mnpbc_container_keyword((*field)->cty);
+
+        cont = (*field)->parent;
+        kwc = mnpbc_container_keyword(cont);
+
+        (void)bytestream_nprintf(bs, 1024,
+            "%s%s *%s_get_%s(%s%s *);\n",
+            kwf,
+            BDATA((*field)->cty->be.fqname),
+            BDATA(cont->be.fqname),
+            BDATA((*field)->be.name),
+            kwc,
+            BDATA(cont->be.fqname));
+    }
+    return 0;
+}
+
+
+static void
+print_get_decl(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnpbc_container_traverse_fields(cont,
+                                     (array_traverser_t)print_get_decl_field,
+                                     bs);
+}
+
+
+/*
+ * Projection mask of a message: a bit per field in declaration order,
+ * oneof members counted one by one, and a mask per embedded message,
+ * NULL for all of it.
+ */
+static void
+print_mask_decl(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnbytes_t *name;
+    mnpbc_field_t **field;
+    mnarray_iter_t it;
+    int nbits;
+
+    name = mnpbc_container_name_upper(cont);
+    nbits = 0;
+
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        if ((*field)->cty != NULL &&
+            (*field)->cty->kind == MNPBC_CONT_KONEOF) {
+            mnpbc_field_t **ufield;
+            mnarray_iter_t uit;
+
+            for (ufield = array_first(&(*field)->cty->fields, &uit);
+                 ufield != NULL;
+                 ufield = array_next(&(*field)->cty->fields, &uit)) {
+                (void)bytestream_nprintf(bs, 1024,
+                    "#define %s_MASK_%s (%d)\n",
+                    BDATA(name),
+                    BDATA((*ufield)->be.name),
+                    nbits++);
+            }
+        } else {
+            (void)bytestream_nprintf(bs, 1024,
+                "#define %s_MASK_%s (%d)\n",
+                BDATA(name),
+                BDATA((*field)->be.name),
+                nbits++);
+        }
+    }
+
+    (void)bytestream_nprintf(bs, 1024,
+        "struct %s_mask {\n"
+        "    uint64_t bits[%d];\n",
+        BDATA(cont->be.fqname),
+        nbits > 0 ? (nbits + 63) / 64 : 1);
+
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        if ((*field)->cty != NULL &&
+            (*field)->cty->kind == MNPBC_CONT_KONEOF) {
+            mnpbc_field_t **ufield;
+            mnarray_iter_t uit;
+
+            for (ufield = array_first(&(*field)->cty->fields, &uit);
+                 ufield != NULL;
+                 ufield = array_next(&(*field)->cty->fields, &uit)) {
+                if (mnpbc_field_has_submask(*ufield)) {
+                    (void)bytestream_nprintf(bs, 1024,
+                        "    const struct %s_mask *%s;\n",
+                        BDATA((*ufield)->cty->be.fqname),
+                        BDATA((*ufield)->be.name));
+                }
+            }
+        } else if (mnpbc_field_has_submask(*field)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    const struct %s_mask *%s;\n",
+                BDATA((*field)->cty->be.fqname),
+                BDATA((*field)->be.name));
+        }
+    }
+
+    (void)bytestream_nprintf(bs, 1024, "};\n");
+    BYTES_DECREF(&name);
+}
+
+
 static int
 print_method_decl(UNUSED mnbytes_t *key,
                   mnpbc_container_t *cont,
@@ -455,13 +764,21 @@ print_method_decl(UNUSED mnbytes_t *key,
 
     kw = mnpbc_container_keyword(cont);
 
+    print_mask_decl(cont, bs);
     (void)bytestream_nprintf(bs,
                              1024,
                              "%s%s *%s_new(void);\n",
                              kw,
                              BDATA(cont->be.fqname),
                              BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "%s%s *%s_new_arena(mnpb_arena_t *);\n",
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname));
     print_alloc_decl(cont, bs);
+    print_get_decl(cont, bs);
     (void)bytestream_nprintf(bs,
                              1024,
                              "int %s_init(%s%s *);\n",
@@ -477,99 +794,252 @@ print_method_decl(UNUSED mnbytes_t *key,
                              BDATA(cont->be.fqname));
     (void)bytestream_nprintf(bs,
                              1024,
-                             "ssize_t %s("
-                             "mnbytestream_t *, void *, %s%s *);\n",
-                             BDATA(cont->be.decode),
+                             "ssize_t %s_cached("
+                             "mnbytestream_t *, %s%s *);\n",
+                             BDATA(cont->be.encode),
                              kw,
                              BDATA(cont->be.fqname));
     (void)bytestream_nprintf(bs,
                              1024,
-                             "size_t %s(%s%s *);\n",
-                             BDATA(cont->be.sz),
+                             "ssize_t %s_iov("
+                             "mnpb_iov_t *, %s%s *);\n",
+                             BDATA(cont->be.encode),
                              kw,
                              BDATA(cont->be.fqname));
     (void)bytestream_nprintf(bs,
                              1024,
-                             "ssize_t %s(%s%s *, ssize_t);\n",
-                             BDATA(cont->be.rawsz),
+                             "ssize_t %s_iov_cached("
+                             "mnpb_iov_t *, %s%s *);\n",
+                             BDATA(cont->be.encode),
                              kw,
                              BDATA(cont->be.fqname));
     (void)bytestream_nprintf(bs,
                              1024,
                              "ssize_t %s("
+                             "mnpb_rbuf_t *, %s%s *);\n",
+                             BDATA(cont->be.rencode),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s_reverse("
                              "mnbytestream_t *, %s%s *);\n",
-                             BDATA(cont->be.dump),
+                             BDATA(cont->be.encode),
                              kw,
                              BDATA(cont->be.fqname));
     (void)bytestream_nprintf(bs,
                              1024,
-                             "int %s_fini(%s%s *);\n",
-                             BDATA(cont->be.fqname),
+                             "ssize_t %s("
+                             "mnbytestream_t *, void *, %s%s *);\n",
+                             BDATA(cont->be.decode),
                              kw,
                              BDATA(cont->be.fqname));
     (void)bytestream_nprintf(bs,
                              1024,
-                             "void %s_destroy(%s%s **);\n\n",
+                             "ssize_t %s_unpack_projected(mnbytestream_t *, "
+                             "void *, %s%s *, const struct %s_mask *);\n",
                              BDATA(cont->be.fqname),
                              kw,
+                             BDATA(cont->be.fqname),
                              BDATA(cont->be.fqname));
-    return 0;
-}
-
-
-/*
- * Implementation, *.proto.c
- */
-static void
-print_impl_pre(mnpbc_ctx_t *ctx, mnbytestream_t *bs)
-{
-    (void)bytestream_nprintf(bs,
-                            1024,
-                            "/* autogenerated by mnpbc */\n"
-                            "#include <limits.h>\n"
-                            "#include <stdlib.h>\n"
-                            "#include <stdbool.h>\n"
-                            "#include <stdint.h>\n"
-                            "#include <string.h>\n"
-                            "#include <mncommon/dumpm.h>\n"
-                            "#include <mncommon/util.h>\n"
-                            "#include \"%s\"\n",
-                            BDATA(ctx->nameout0));
-}
-
-
-static void
-print_new(mnpbc_container_t *cont, mnbytestream_t *bs)
-{
-    char *kw;
-
-    kw = mnpbc_container_keyword(cont);
-
     (void)bytestream_nprintf(bs,
                              1024,
-                             "%s%s *\n"
-                             "%s_new(void)\n"
-                             "{\n",
+                             "ssize_t %s_unpack_resume(mnpb_decoder_t *, "
+                             "mnbytestream_t *, void *, size_t, %s%s *);\n",
+                             BDATA(cont->be.fqname),
                              kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s_unpack_arena(mnbytestream_t *, "
+                             "void *, mnpb_arena_t *, %s%s *);\n",
                              BDATA(cont->be.fqname),
+                             kw,
                              BDATA(cont->be.fqname));
-
     (void)bytestream_nprintf(bs,
                              1024,
-                             "    %s%s *res;\n"
-                             "    if ((res = malloc(sizeof(%s%s))) != NULL) "
-                                 "{ memset(res, 0, sizeof(%s%s)); "
-                                 "res->_mnpbcc_rawsz = INT_MAX; }\n"
-                             "    return res;\n",
+                             "ssize_t %s_unpack_allocator(mnbytestream_t *, "
+                             "void *, const mnpb_allocator_t *, %s%s *);\n",
+                             BDATA(cont->be.fqname),
                              kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int %s_fini_allocator("
+                             "const mnpb_allocator_t *, %s%s *);\n",
                              BDATA(cont->be.fqname),
                              kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s_stream_read(mnpb_stream_t *, "
+                             "%s%s *);\n",
                              BDATA(cont->be.fqname),
                              kw,
                              BDATA(cont->be.fqname));
-
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s_stream_write(mnpb_stream_t *, "
+                             "%s%s *);\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s_rec_read(mnpb_recfile_t *, size_t, "
+                             "%s%s *);\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s_rec_write(mnpb_recwriter_t *, "
+                             "int64_t, %s%s *);\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int %s_parallel_scan(mnpb_recfile_t *, int, "
+                             "int (*)(%s%s *, size_t, void *), void *);\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "size_t %s(%s%s *);\n",
+                             BDATA(cont->be.sz),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s(%s%s *, ssize_t);\n",
+                             BDATA(cont->be.rawsz),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t %s("
+                             "mnbytestream_t *, %s%s *);\n",
+                             BDATA(cont->be.dump),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int %s_fini(%s%s *);\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int %s_clear(%s%s *);\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "void %s_destroy(%s%s **);\n\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+    return 0;
+}
+
+
+/*
+ * Implementation, *.proto.c
+ */
+static void
+print_impl_pre(mnpbc_ctx_t *ctx, mnbytestream_t *bs)
+{
+    (void)bytestream_nprintf(bs,
+                            1024,
+                            "/* autogenerated by mnpbc */\n"
+                            "#include <limits.h>\n"
+                            "#include <stddef.h>\n"
+                            "#include <stdlib.h>\n"
+                            "#include <stdbool.h>\n"
+                            "#include <stdint.h>\n"
+                            "#include <string.h>\n"
+                            "#include <mncommon/bytestream_aux.h>\n"
+                            "#include <mncommon/dumpm.h>\n"
+                            "#include <mncommon/util.h>\n"
+                            "#include \"%s\"\n",
+                            BDATA(ctx->nameout0));
+}
+
+
+/*
+ * statistics counters of the type, see MNPB_STATS_ENTER()
+ */
+static void
+print_stats_type(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "#ifdef MNPB_STATS\n"
+                             "static mnpb_stats_type_t %s_stats_type = "
+                                "{ \"%s\", 0 };\n"
+                             "#endif\n",
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname));
+}
+
+
+static void
+print_new(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "%s%s *\n"
+                             "%s_new(void)\n"
+                             "{\n",
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname));
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "    %s%s *res;\n"
+                             "    if ((res = mnpb_malloc("
+                                        "sizeof(%s%s))) != NULL) "
+                                 "{ memset(res, 0, sizeof(%s%s)); "
+                                 "res->_mnpbcc_rawsz = INT_MAX; }\n"
+                             "    return res;\n",
+                             kw,
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+
     (void)bytestream_nprintf(bs, 1024, "}\n");
 
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "%s%s *\n"
+                             "%s_new_arena(mnpb_arena_t *arena)\n"
+                             "{\n"
+                             "    %s%s *res;\n"
+                             "    if ((res = mnpb_arena_alloc(arena, "
+                                 "sizeof(%s%s))) != NULL) "
+                                 "{ memset(res, 0, sizeof(%s%s)); "
+                                 "res->_mnpbcc_rawsz = INT_MAX; }\n"
+                             "    return res;\n"
+                             "}\n",
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
 }
 
 
@@ -579,6 +1049,7 @@ print_alloc_field(mnpbc_field_t **field, mnbytestream_t *bs)
     if ((*field)->flags.repeated) {
         mnpbc_container_t *cty, *cont;
         char *kwf, *kwc;
+        const char *name;
 
         cty = (*field)->cty;
         kwf = mnpbc_container_keyword(cty);
@@ -586,43 +1057,130 @@ print_alloc_field(mnpbc_field_t **field, mnbytestream_t *bs)
         cont = (*field)->parent;
         kwc = mnpbc_container_keyword(cont);
 
+        name = (const char *)BDATA((*field)->be.name);
+
+        /*
+         * reserve: grow the capacity to at least cap elements
+         */
         (void)bytestream_nprintf(bs, 1024,
-            "%s%s *\n"
-            "%s_%s_alloc(%s%s *msg, int n)\n"
+            "int\n"
+            "%s_%s_reserve(%s%s *msg, size_t cap)\n"
             "{\n"
             "    %s%s*tmp;\n"
-            "    if (n > 0) {\n"
-            "        if ((tmp = realloc(msg->%s.data, "
-                        "sizeof(msg->%s.data[0]) * "
-                        "(msg->%s.sz + n))) != NULL) {\n"
-            "            msg->%s.data = tmp;\n"
-            "            memset(tmp + msg->%s.sz, 0, "
-                            "sizeof(msg->%s.data[0]) * n);\n"
-            "           tmp = msg->%s.data + msg->%s.sz;\n"
-            "           msg->%s.sz += n;\n"
-            "       }\n"
-            "   } else {\n"
-            "       tmp = NULL;\n"
-            "   }\n"
-            "   return tmp;\n"
+            "    if (cap > msg->%s.cap) {\n"
+            "        if ((tmp = mnpb_realloc(msg->%s.data, "
+                        "sizeof(msg->%s.data[0]) * msg->%s.cap, "
+                        "sizeof(msg->%s.data[0]) * cap)) == NULL) {\n"
+            "            return MNPB_EMEMORY;\n"
+            "        }\n"
+            "        msg->%s.data = tmp;\n",
+            BDATA(cont->be.fqname),
+            name,
+            kwc,
+            BDATA(cont->be.fqname),
+            kwf == NULL ? "" : kwf,
+            BDATA(cty->be.fqname),
+            name,
+            name,
+            name,
+            name,
+            name,
+            name);
+        if (mnpbc_field_retains(*field)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "        memset(tmp + msg->%s.cap, 0, "
+                        "sizeof(msg->%s.data[0]) * (cap - msg->%s.cap));\n",
+                name,
+                name,
+                name);
+        }
+        (void)bytestream_nprintf(bs, 1024,
+            "        msg->%s.cap = cap;\n"
+            "    }\n"
+            "    return 0;\n"
             "}\n",
+            name);
+
+        /*
+         * alloc: append n zeroed elements, doubling the capacity
+         */
+        (void)bytestream_nprintf(bs, 1024,
+            "%s%s%s *\n"
+            "%s_%s_alloc%s(%s%s *msg, int n)\n"
+            "{\n"
+            "    %s%s*tmp;\n"
+            "    if (n > 0) {\n"
+            "        if (msg->%s.sz + n > msg->%s.cap) {\n"
+            "            size_t cap = msg->%s.cap * 2;\n"
+            "            if (cap < msg->%s.sz + n) { "
+                            "cap = msg->%s.sz + n; }\n"
+            "            if (%s_%s_reserve(msg, cap) != 0) { "
+                            "return NULL; }\n"
+            "        }\n"
+            "        tmp = msg->%s.data + msg->%s.sz;\n",
+            mnpbc_field_retains_bytes(*field) ? "static " : "",
             kwf == NULL ? "" : kwf,
             BDATA(cty->be.fqname),
             BDATA(cont->be.fqname),
-            BDATA((*field)->be.name),
+            name,
+            mnpbc_field_retains_bytes(*field) ? "_retained" : "",
             kwc,
             BDATA(cont->be.fqname),
             kwf == NULL ? "" : kwf,
             BDATA(cty->be.fqname),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name),
-            BDATA((*field)->be.name));
+            name,
+            name,
+            name,
+            name,
+            name,
+            BDATA(cont->be.fqname),
+            name,
+            name,
+            name);
+        /*
+         * elements kept past sz are zeroed by _reserve, or cleared
+         */
+        if (!mnpbc_field_retains(*field)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "        memset(tmp, 0, sizeof(msg->%s.data[0]) * n);\n",
+                name);
+        }
+        (void)bytestream_nprintf(bs, 1024,
+            "        msg->%s.sz += n;\n"
+            "    } else {\n"
+            "        tmp = NULL;\n"
+            "    }\n"
+            "    return tmp;\n"
+            "}\n",
+            name);
+
+        /*
+         * kept strings and bytes are released for anything but the
+         * decoder
+         */
+        if (mnpbc_field_retains_bytes(*field)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "%s%s *\n"
+                "%s_%s_alloc(%s%s *msg, int n)\n"
+                "{\n"
+                "    %s%s*tmp;\n"
+                "    if ((tmp = %s_%s_alloc_retained(msg, n)) != NULL) {\n"
+                "        for (int i = 0; i < n; ++i) { "
+                        "mnpb_bytes_decref(&tmp[i]); }\n"
+                "    }\n"
+                "    return tmp;\n"
+                "}\n",
+                kwf == NULL ? "" : kwf,
+                BDATA(cty->be.fqname),
+                BDATA(cont->be.fqname),
+                name,
+                kwc,
+                BDATA(cont->be.fqname),
+                kwf == NULL ? "" : kwf,
+                BDATA(cty->be.fqname),
+                BDATA(cont->be.fqname),
+                name);
+        }
     }
     return 0;
 }
@@ -637,6 +1195,68 @@ print_alloc(mnpbc_container_t *cont, mnbytestream_t *bs)
 }
 
 
+/*
+ * Lazy accessor: decode the raw data kept by _unpack on first call.
+ */
+static int
+print_get_field(mnpbc_field_t **field, mnbytestream_t *bs)
+{
+    mnpbc_container_t *cty, *cont;
+    char *kwf, *kwc;
+
+    if (!mnpbc_field_is_lazy(*field)) {
+        return 0;
+    }
+
+    cty = (*field)->cty;
+    kwf = mnpbc_container_keyword(cty);
+
+    cont = (*field)->parent;
+    kwc = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs, 1024,
+        "%s%s *\n"
+        "%s_get_%s(%s%s *msg)\n"
+        "{\n"
+        "    if (msg->_mnpbcc_lazy_%s != NULL) {\n"
+        "        mnbytestream_t bs;\n"
+        "        bytestream_from_bytes(&bs, msg->_mnpbcc_lazy_%s);\n"
+        "        SEOD(&bs) = BSZ(msg->_mnpbcc_lazy_%s);\n"
+        "        (void)%s(&msg->%s, SEOD(&bs));\n"
+        "        if (%s(&bs, NULL, &msg->%s) < 0) { return NULL; }\n"
+        "        mnpb_bytes_decref(&msg->_mnpbcc_lazy_%s);\n"
+        "    }\n"
+        "    return &msg->%s;\n"
+        "}\n",
+        kwf,
+        BDATA(cty->be.fqname),
+        BDATA(cont->be.fqname),
+        BDATA((*field)->be.name),
+        kwc,
+        BDATA(cont->be.fqname),
+        BDATA((*field)->be.name),
+        BDATA((*field)->be.name),
+        BDATA((*field)->be.name),
+        BDATA(cty->be.rawsz),
+        BDATA((*field)->be.name),
+        BDATA(cty->be.decode),
+        BDATA((*field)->be.name),
+        BDATA((*field)->be.name),
+        BDATA((*field)->be.name));
+
+    return 0;
+}
+
+
+static void
+print_get(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnpbc_container_traverse_fields(cont,
+                                     (array_traverser_t)print_get_field,
+                                     bs);
+}
+
+
 static int
 print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
 {
@@ -651,31 +1271,34 @@ print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
             BDATA((*field)->ty),
             BDATA((*field)->pb.name));
 
-    } else if (bytes_cmp(cty->pb.name, &_bytes) == 0 ||
-               bytes_cmp(cty->pb.name, &_string) == 0) {
+    } else if (!mnpbc_container_is_view(cty) &&
+               (bytes_cmp(cty->pb.name, &_bytes) == 0 ||
+                bytes_cmp(cty->pb.name, &_string) == 0)) {
         /*
          * BYTES_DECREF(&cont->%s);
          */
         if ((*field)->flags.repeated) {
             (void)bytestream_nprintf(bs, 1024,
                 "    if (msg->%s.data != NULL) { "
-                    "for (size_t i = 0; i < msg->%s.sz; ++i) { "
-                        "BYTES_DECREF(&msg->%s.data[i]); "
+                    "for (size_t i = 0; i < msg->%s.cap; ++i) { "
+                        "mnpb_bytes_decref(&msg->%s.data[i]); "
                     "} "
-                    "free(msg->%s.data); "
+                    "mnpb_free(msg->%s.data); "
                     "msg->%s.data = NULL; "
                     "msg->%s.sz = 0; "
+                    "msg->%s.cap = 0; "
                 "}\n",
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
+                BDATA((*field)->be.name),
                 BDATA((*field)->be.name));
         } else {
             (void)bytestream_nprintf(bs,
                                      1024,
-                                     "    BYTES_DECREF(&msg->%s);\n",
+                                     "    mnpb_bytes_decref(&msg->%s);\n",
                                      BDATA((*field)->be.name));
         }
 
@@ -683,12 +1306,13 @@ print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
         if ((*field)->flags.repeated) {
             (void)bytestream_nprintf(bs, 1024,
                 "    if (msg->%s.data != NULL) { "
-                "for (size_t i = 0; i < msg->%s.sz; ++i) { "
+                "for (size_t i = 0; i < msg->%s.cap; ++i) { "
                     "%s_fini(&msg->%s.data[i]); "
                 "} "
-                "free(msg->%s.data); "
+                "mnpb_free(msg->%s.data); "
                 "msg->%s.data = NULL; "
                 "msg->%s.sz = 0; "
+                "msg->%s.cap = 0; "
                 "}\n",
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
@@ -696,6 +1320,7 @@ print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
+                BDATA((*field)->be.name),
                 BDATA((*field)->be.name));
         } else {
             (void)bytestream_nprintf(bs,
@@ -703,6 +1328,13 @@ print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
                                      "    %s_fini(&msg->%s);\n",
                                      BDATA(cty->be.fqname),
                                      BDATA((*field)->be.name));
+            if (mnpbc_field_is_lazy(*field)) {
+                (void)bytestream_nprintf(bs,
+                                         1024,
+                                         "    mnpb_bytes_decref("
+                                         "&msg->_mnpbcc_lazy_%s);\n",
+                                         BDATA((*field)->be.name));
+            }
         }
 
     } else if (cty->kind == MNPBC_CONT_KONEOF) {
@@ -730,11 +1362,12 @@ print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
             }
             //assert(ucty->kind == MNPBC_CONT_KBUILTIN);
 
-            if (bytes_cmp(ucty->pb.name, &_bytes) == 0 ||
-                bytes_cmp(ucty->pb.name, &_string) == 0) {
+            if (!mnpbc_container_is_view(ucty) &&
+                (bytes_cmp(ucty->pb.name, &_bytes) == 0 ||
+                 bytes_cmp(ucty->pb.name, &_string) == 0)) {
                 (void)bytestream_nprintf(bs, 1024,
                     "    case %"PRId64": "
-                        "BYTES_DECREF(&msg->%s.data.%s); "
+                        "mnpb_bytes_decref(&msg->%s.data.%s); "
                         "break;\n",
                     (*ufield)->fnum,
                     BDATA((*field)->be.name),
@@ -766,12 +1399,13 @@ print_fini_field(mnpbc_field_t **field, mnbytestream_t *bs)
         if ((*field)->flags.repeated) {
             (void)bytestream_nprintf(bs, 1024,
                 "    if (msg->%s.data != NULL) { "
-                        "free(msg->%s.data); msg->%s.data = NULL; "
-                        "msg->%s.sz = 0; "
+                        "mnpb_free(msg->%s.data); msg->%s.data = NULL; "
+                        "msg->%s.sz = 0; msg->%s.cap = 0; "
                         "}\n",
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
                 BDATA((*field)->be.name),
+                BDATA((*field)->be.name),
                 BDATA((*field)->be.name));
         } else {
             (void)bytestream_nprintf(bs, 1024,
@@ -801,6 +1435,14 @@ print_fini(mnpbc_container_t *cont, mnbytestream_t *bs)
                              kw,
                              BDATA(cont->be.fqname));
 
+    if (cont->ctx->flags.tables) {
+        (void)bytestream_nprintf(bs, 1024,
+                                 "    return mnpb_tbl_fini(&%s_desc, msg);\n"
+                                 "}\n",
+                                 BDATA(cont->be.fqname));
+        return;
+    }
+
     mnpbc_container_traverse_fields(cont,
                                      (array_traverser_t)print_fini_field,
                                      bs);
@@ -809,40 +1451,14 @@ print_fini(mnpbc_container_t *cont, mnbytestream_t *bs)
 }
 
 
-static void
-print_destroy(mnpbc_container_t *cont, mnbytestream_t *bs)
-{
-    char *kw;
-
-    assert(cont->kind == MNPBC_CONT_KMESSAGE);
-
-    kw = mnpbc_container_keyword(cont);
-
-    (void)bytestream_nprintf(bs,
-                             1024,
-                             "void %s_destroy(%s%s **msg)\n"
-                             "{\n",
-                             BDATA(cont->be.fqname),
-                             kw,
-                             BDATA(cont->be.fqname));
-
-    (void)bytestream_nprintf(bs, 1024,
-                             "    if (*msg != NULL) { "
-                                 "%s_fini(*msg); "
-                                 "free(*msg); "
-                                 "*msg = NULL; "
-                             "}\n",
-                             BDATA(cont->be.fqname));
-    (void)bytestream_nprintf(bs, 1024, "}\n");
-}
-
-
 static int
-print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
+print_clear_field(mnpbc_field_t **field, mnbytestream_t *bs)
 {
     mnpbc_container_t *cty;
+    const char *name;
 
     cty = (*field)->cty;
+    name = (const char *)BDATA((*field)->be.name);
 
     if (cty == NULL) {
         assert((*field)->wtype == MNPB_WT_UNDEF);
@@ -852,17 +1468,181 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
             BDATA((*field)->ty),
             BDATA((*field)->pb.name));
 
-    } else if ((*field)->wtype == MNPB_WT_INTERN) {
-        mnpbc_field_t **ufield;
-        mnarray_iter_t it;
+    } else if ((*field)->flags.repeated) {
+        if (cty->kind == MNPBC_CONT_KMESSAGE) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    for (size_t i = 0; i < msg->%s.sz; ++i) { "
+                    "%s_clear(&msg->%s.data[i]); "
+                "}\n",
+                name,
+                BDATA(cty->be.fqname),
+                name);
+        }
+        (void)bytestream_nprintf(bs, 1024, "    msg->%s.sz = 0;\n", name);
 
+    } else if (!mnpbc_container_is_view(cty) &&
+               (bytes_cmp(cty->pb.name, &_bytes) == 0 ||
+                bytes_cmp(cty->pb.name, &_string) == 0)) {
         /*
-         * MNPB_WT_INTERN is not a "valid" wire type.  I use it as
-         * a sentinel for oneof fields.
-         *
-         * oneof: runtime key calculation
+         * absent is NULL, nowhere to keep the storage
          */
-        assert(cty->kind == MNPBC_CONT_KONEOF);
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "    mnpb_bytes_decref(&msg->%s);\n",
+                                 name);
+
+    } else if (cty->kind == MNPBC_CONT_KMESSAGE) {
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "    %s_clear(&msg->%s);\n",
+                                 BDATA(cty->be.fqname),
+                                 name);
+        if (mnpbc_field_is_lazy(*field)) {
+            (void)bytestream_nprintf(bs,
+                                     1024,
+                                     "    mnpb_bytes_decref("
+                                     "&msg->_mnpbcc_lazy_%s);\n",
+                                     name);
+        }
+
+    } else if (cty->kind == MNPBC_CONT_KONEOF) {
+        (void)print_fini_field(field, bs);
+        (void)bytestream_nprintf(bs, 1024,
+            "    memset(&msg->%s, 0, sizeof(msg->%s));\n",
+            name,
+            name);
+
+    } else {
+        (void)bytestream_nprintf(bs, 1024,
+            "    memset(&msg->%s, 0, sizeof(msg->%s));\n",
+            name,
+            name);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Reset to the state of _new, keeping the storage of repeated fields.
+ */
+static void
+print_clear(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int\n%s_clear(%s%s *msg)\n{\n"
+                             "    msg->_mnpbcc_rawsz = INT_MAX;\n"
+                             "    msg->_mnpbcc_cachedsz = 0;\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+
+    mnpbc_container_traverse_fields(cont,
+                                     (array_traverser_t)print_clear_field,
+                                     bs);
+
+    (void)bytestream_nprintf(bs, 1024, "    return 0;\n}\n");
+}
+
+
+static void
+print_destroy(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "void %s_destroy(%s%s **msg)\n"
+                             "{\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname));
+
+    (void)bytestream_nprintf(bs, 1024,
+                             "    if (*msg != NULL) { "
+                                 "%s_fini(*msg); "
+                                 "mnpb_free(*msg); "
+                                 "*msg = NULL; "
+                             "}\n",
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs, 1024, "}\n");
+}
+
+
+/*
+ * print_pack_field() emits the body of either _pack_cached, or
+ * _pack_iov_cached where bs is the scratch buffer of the iov
+ */
+typedef struct _mnpbc_pack_target {
+    mnbytestream_t *bs;
+    int iov;
+} mnpbc_pack_target_t;
+
+
+/*
+ * string and bytes that _pack_iov may reference instead of copying,
+ * NULL for everything else
+ */
+static const char *
+mnpbc_iov_encoder(mnpbc_container_t *ty)
+{
+    if (ty->kind != MNPBC_CONT_KBUILTIN) {
+        return NULL;
+    }
+    if (mnpbc_container_is_view(ty)) {
+        return "mnpb_iov_enview";
+    }
+    if (bytes_cmp(ty->pb.name, &_string) == 0) {
+        return "mnpb_iov_enstr";
+    }
+    if (bytes_cmp(ty->pb.name, &_bytes) == 0) {
+        return "mnpb_iov_enbytes";
+    }
+    return NULL;
+}
+
+
+static int
+print_pack_field(mnpbc_field_t **field, mnpbc_pack_target_t *tgt)
+{
+    mnbytestream_t *bs;
+    mnpbc_container_t *cty;
+    const char *ienc;
+    int width;
+
+    bs = tgt->bs;
+    cty = (*field)->cty;
+
+    if (cty == NULL) {
+        assert((*field)->wtype == MNPB_WT_UNDEF);
+
+        (void)bytestream_nprintf(bs, 1024,
+            "    //(external:%s) %s\n",
+            BDATA((*field)->ty),
+            BDATA((*field)->pb.name));
+
+    } else if ((*field)->wtype == MNPB_WT_INTERN) {
+        mnpbc_field_t **ufield;
+        mnarray_iter_t it;
+
+        /*
+         * MNPB_WT_INTERN is not a "valid" wire type.  I use it as
+         * a sentinel for oneof fields.
+         *
+         * oneof: runtime key calculation
+         */
+        assert(cty->kind == MNPBC_CONT_KONEOF);
         assert(!(*field)->flags.repeated);
 
         (void)bytestream_nprintf(bs, 1024,
@@ -892,70 +1672,80 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
                  * embedded tag: ldelim + fnum
                  */
                 (void)bytestream_nprintf(bs, 1024,
-                    "        if ((nwritten = mnpb_envarint(bs, "
-                            "0x%08"PRIx64")) < 0) { "
+                    "        if ((nwritten = mnpb_entag(bs, "
+                            "0x%"PRIx64"ull, %d)) < 0) { "
                             "res = nwritten; "
                             "goto end; "
                         "} "
                         "res += nwritten;\n",
-                    MNPB_MAKEKEY(MNPB_WT_LDELIM, (*ufield)->fnum));
+                    MNPBC_TAG(MNPB_MAKEKEY(MNPB_WT_LDELIM, (*ufield)->fnum)));
 
                 /*
                  * embedded message, encode as bytes
                  */
                 (void)bytestream_nprintf(bs, 1024,
                     "        if ((nwritten = mnpb_envarint(bs, "
-                            "%s(%smsg->%s.data.%s))) < 0) { "
+                            "msg->%s.data.%s._mnpbcc_cachedsz)) < 0) { "
                             "res = nwritten; "
                             "goto end; "
                         "} "
                         "res += nwritten;\n",
-                    BDATA(ucty->be.sz),
-                    ucty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
                     BDATA((*field)->be.name),
                     BDATA((*ufield)->be.name));
 
                 (void)bytestream_nprintf(bs, 1024,
-                    "        if ((nwritten = %s(bs, %smsg->%s.data.%s)) < 0) { "
+                    "        if ((nwritten = %s%s(%s, "
+                            "&msg->%s.data.%s)) < 0) { "
                         "res = nwritten; "
                         "goto end; "
                     "} "
                     "res += nwritten;\n",
                     BDATA(ucty->be.encode),
-                    ucty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
+                    tgt->iov ? "_iov_cached" : "_cached",
+                    tgt->iov ? "iov" : "bs",
                     BDATA((*field)->be.name),
                     BDATA((*ufield)->be.name));
 
             } else {
-                (void)bytestream_nprintf(bs, 1024,
-                    "        if (msg->%s.data.%s == (%s)%s) { "
-                                "break; "
-                                "}\n",
-                    BDATA((*field)->be.name),
-                    BDATA((*ufield)->be.name),
-                    BDATA(ucty->be.fqname),
-                    MNPB_WT_NUMERIC((*ufield)->wtype) ? "0" : "NULL");
+                if (mnpbc_container_is_view(ucty)) {
+                    (void)bytestream_nprintf(bs, 1024,
+                        "        if (msg->%s.data.%s.data == NULL) { "
+                                    "break; "
+                                    "}\n",
+                        BDATA((*field)->be.name),
+                        BDATA((*ufield)->be.name));
+                } else {
+                    (void)bytestream_nprintf(bs, 1024,
+                        "        if (msg->%s.data.%s == (%s)%s) { "
+                                    "break; "
+                                    "}\n",
+                        BDATA((*field)->be.name),
+                        BDATA((*ufield)->be.name),
+                        BDATA(ucty->be.fqname),
+                        MNPB_WT_NUMERIC((*ufield)->wtype) ? "0" : "NULL");
+                }
 
                 /*
                  * normal tag: wtype + fnum
                  */
                 (void)bytestream_nprintf(bs, 1024,
-                    "        if ((nwritten = mnpb_envarint(bs, "
-                            "0x%08"PRIx64")) < 0) { "
+                    "        if ((nwritten = mnpb_entag(bs, "
+                            "0x%"PRIx64"ull, %d)) < 0) { "
                             "res = nwritten; "
                             "goto end; "
                         "} "
                         "res += nwritten;\n",
-                    MNPB_MAKEKEY((*ufield)->wtype, (*ufield)->fnum));
+                    MNPBC_TAG(MNPB_MAKEKEY((*ufield)->wtype, (*ufield)->fnum)));
 
+                ienc = tgt->iov ? mnpbc_iov_encoder(ucty) : NULL;
                 (void)bytestream_nprintf(bs, 1024,
-                    "        if ((nwritten = %s(bs, %smsg->%s.data.%s)) < 0) { "
+                    "        if ((nwritten = %s(%s, msg->%s.data.%s)) < 0) { "
                         "res = nwritten; "
                         "goto end; "
                     "} "
                     "res += nwritten;\n",
-                    BDATA(ucty->be.encode),
-                    ucty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
+                    ienc != NULL ? ienc : (char *)BDATA(ucty->be.encode),
+                    ienc != NULL ? "iov" : "bs",
                     BDATA((*field)->be.name),
                     BDATA((*ufield)->be.name));
 
@@ -979,25 +1769,44 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
          */
 
         /* sz */
-        (void)bytestream_nprintf(bs, 1024,
-            "    sz = 0; "
-            "for (size_t i = 0; i < msg->%s.sz; ++i) { "
-                "sz += %s(%smsg->%s.data[i]); "
-            "}\n",
-            BDATA((*field)->be.name),
-            BDATA(cty->be.sz),
-            cty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
-            BDATA((*field)->be.name));
+        if ((width = mnpbc_field_fixed_width(*field)) > 0) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    sz = msg->%s.sz * %d;\n",
+                BDATA((*field)->be.name),
+                width);
+        } else if (cty->kind == MNPBC_CONT_KMESSAGE) {
+            /*
+             * each element carries its own length
+             */
+            (void)bytestream_nprintf(bs, 1024,
+                "    sz = 0; "
+                "for (size_t i = 0; i < msg->%s.sz; ++i) { "
+                    "size_t esz = msg->%s.data[i]._mnpbcc_cachedsz; "
+                    "sz += mnpb_szvarint(esz) + esz; "
+                "}\n",
+                BDATA((*field)->be.name),
+                BDATA((*field)->be.name));
+        } else {
+            (void)bytestream_nprintf(bs, 1024,
+                "    sz = 0; "
+                "for (size_t i = 0; i < msg->%s.sz; ++i) { "
+                    "sz += %s(msg->%s.data[i]); "
+                "}\n",
+                BDATA((*field)->be.name),
+                BDATA(cty->be.sz),
+                BDATA((*field)->be.name));
+        }
 
         (void)bytestream_nprintf(bs, 1024, "    if (sz > 0) {\n");
 
         (void)bytestream_nprintf(bs, 1024,
-            "        if ((nwritten = mnpb_envarint(bs, 0x%08"PRIx64")) < 0) { "
+            "        if ((nwritten = mnpb_entag(bs, "
+                    "0x%"PRIx64"ull, %d)) < 0) { "
                      "res = nwritten; "
                      "goto end; "
             "} "
             "res += nwritten;\n",
-            MNPB_MAKEKEY(MNPB_WT_LDELIM, (*field)->fnum));
+            MNPBC_TAG(MNPB_MAKEKEY(MNPB_WT_LDELIM, (*field)->fnum)));
 
         (void)bytestream_nprintf(bs, 1024,
             "        if ((nwritten = mnpb_envarint(bs, sz)) < 0) { "
@@ -1008,29 +1817,56 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
         /*
          * array
          */
+        if (width > 0) {
+            /*
+             * fixed-width run, written out as is
+             */
+            (void)bytestream_nprintf(bs, 1024,
+                "        if ((nwritten = mnpb_enpacked_fixed(bs, "
+                        "msg->%s.data, sz)) < 0) { "
+                    "res = nwritten; "
+                    "goto end; "
+                "} "
+                "res += nwritten;\n"
+                "    }\n",
+                BDATA((*field)->be.name));
+            goto end;
+        }
+
         (void)bytestream_nprintf(bs, 1024,
             "        for (size_t i = 0; i < msg->%s.sz; ++i) { ",
             BDATA((*field)->be.name));
         if (cty->kind == MNPBC_CONT_KMESSAGE) {
             (void)bytestream_nprintf(bs, 1024,
-                "if ((nwritten = mnpb_envarint(bs, %s(&msg->%s.data[i]))) < 0) { "
+                "if ((nwritten = mnpb_envarint(bs, "
+                        "msg->%s.data[i]._mnpbcc_cachedsz)) < 0) { "
                     "res = nwritten; goto end; "
                 "} "
-                "res += nwritten; ",
-                BDATA(cty->be.sz),
+                "res += nwritten; "
+                "if ((nwritten = %s%s(%s, &msg->%s.data[i])) < 0) { "
+                    "res = nwritten; "
+                    "goto end; "
+                "} "
+                "res += nwritten; "
+            "}\n",
+                BDATA((*field)->be.name),
+                BDATA(cty->be.encode),
+                tgt->iov ? "_iov_cached" : "_cached",
+                tgt->iov ? "iov" : "bs",
                 BDATA((*field)->be.name));
-        }
-
-        (void)bytestream_nprintf(bs, 1024,
-                     "if ((nwritten = %s(bs, %smsg->%s.data[i])) < 0) { "
-                         "res = nwritten; "
-                         "goto end; "
-                     "} "
-                     "res += nwritten; "
+        } else {
+            ienc = tgt->iov ? mnpbc_iov_encoder(cty) : NULL;
+            (void)bytestream_nprintf(bs, 1024,
+                "if ((nwritten = %s(%s, msg->%s.data[i])) < 0) { "
+                    "res = nwritten; "
+                    "goto end; "
+                "} "
+                "res += nwritten; "
             "}\n",
-            BDATA(cty->be.encode),
-            cty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
-            BDATA((*field)->be.name));
+                ienc != NULL ? ienc : (char *)BDATA(cty->be.encode),
+                ienc != NULL ? "iov" : "bs",
+                BDATA((*field)->be.name));
+        }
 
         (void)bytestream_nprintf(bs, 1024, "    }\n");
 
@@ -1038,7 +1874,11 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
         /*
          * normal tag: wtype + fnum
          */
-        if (cty->kind != MNPBC_CONT_KMESSAGE) {
+        if (mnpbc_container_is_view(cty)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    if (msg->%s.data != NULL) {\n",
+                BDATA((*field)->be.name));
+        } else if (cty->kind != MNPBC_CONT_KMESSAGE) {
             /* builtins and enums */
             (void)bytestream_nprintf(bs, 1024,
                 "    if (msg->%s != (%s%s)%s) {\n",
@@ -1047,19 +1887,44 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
                 BDATA(cty->be.fqname),
                 MNPB_WT_NUMERIC((*field)->wtype) ? "0" : "NULL");
         } else {
+            if (mnpbc_field_is_lazy(*field)) {
+                /*
+                 * never accessed, re-emit the raw data as is
+                 */
+                (void)bytestream_nprintf(bs, 1024,
+                    "    if (msg->_mnpbcc_lazy_%s != NULL) {\n"
+                    "        if ((nwritten = mnpb_entag(bs, "
+                                "0x%"PRIx64"ull, %d)) < 0) { "
+                            "res = nwritten; "
+                            "goto end; "
+                        "} "
+                        "res += nwritten;\n"
+                    "        if ((nwritten = %s(%s, "
+                                "msg->_mnpbcc_lazy_%s)) < 0) { "
+                            "res = nwritten; "
+                            "goto end; "
+                        "} "
+                        "res += nwritten;\n"
+                    "    } else\n",
+                    BDATA((*field)->be.name),
+                    MNPBC_TAG(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)),
+                    tgt->iov ? "mnpb_iov_enbytes" : "mnpb_enbytes",
+                    tgt->iov ? "iov" : "bs",
+                    BDATA((*field)->be.name));
+            }
             (void)bytestream_nprintf(bs, 1024,
-                "    if ((sz = %s(&msg->%s)) != 0) {\n",
-                BDATA(cty->be.sz),
+                "    if ((sz = msg->%s._mnpbcc_cachedsz) != 0) {\n",
                 BDATA((*field)->be.name));
         }
 
         (void)bytestream_nprintf(bs, 1024,
-            "        if ((nwritten = mnpb_envarint(bs, 0x%08"PRIx64")) < 0) { "
+            "        if ((nwritten = mnpb_entag(bs, "
+                    "0x%"PRIx64"ull, %d)) < 0) { "
                 "res = nwritten; "
                 "goto end; "
             "} "
             "res += nwritten;\n",
-            MNPB_MAKEKEY((*field)->wtype, (*field)->fnum));
+            MNPBC_TAG(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)));
 
         if (cty->kind == MNPBC_CONT_KMESSAGE) {
             /*
@@ -1073,19 +1938,34 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
                 "res += nwritten;\n");
         }
 
-        (void)bytestream_nprintf(bs, 1024,
-            "        if ((nwritten = %s(bs, %smsg->%s)) < 0) { "
-                "res = nwritten; "
-                "goto end; "
-            "} "
-            "res += nwritten;\n",
-            BDATA(cty->be.encode),
-            cty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
-            BDATA((*field)->be.name));
+        if (cty->kind == MNPBC_CONT_KMESSAGE) {
+            (void)bytestream_nprintf(bs, 1024,
+                "        if ((nwritten = %s%s(%s, &msg->%s)) < 0) { "
+                    "res = nwritten; "
+                    "goto end; "
+                "} "
+                "res += nwritten;\n",
+                BDATA(cty->be.encode),
+                tgt->iov ? "_iov_cached" : "_cached",
+                tgt->iov ? "iov" : "bs",
+                BDATA((*field)->be.name));
+        } else {
+            ienc = tgt->iov ? mnpbc_iov_encoder(cty) : NULL;
+            (void)bytestream_nprintf(bs, 1024,
+                "        if ((nwritten = %s(%s, msg->%s)) < 0) { "
+                    "res = nwritten; "
+                    "goto end; "
+                "} "
+                "res += nwritten;\n",
+                ienc != NULL ? ienc : (char *)BDATA(cty->be.encode),
+                ienc != NULL ? "iov" : "bs",
+                BDATA((*field)->be.name));
+        }
 
         (void)bytestream_nprintf(bs, 1024, "    }\n");
     }
 
+end:
     return 0;
 }
 
@@ -1093,39 +1973,132 @@ print_pack_field(mnpbc_field_t **field, mnbytestream_t *bs)
 static void
 print_pack(mnpbc_container_t *cont, mnbytestream_t *bs)
 {
+    mnpbc_pack_target_t tgt = { bs, 0 };
     char *kw;
 
     assert(cont->kind == MNPBC_CONT_KMESSAGE);
 
     kw = mnpbc_container_keyword(cont);
 
+    if (cont->ctx->flags.tables) {
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "ssize_t\n"
+                                 "%s_cached(mnbytestream_t *bs, %s%s *msg)\n"
+                                 "{\n"
+                                 "    return mnpb_tbl_pack_cached(bs, "
+                                    "&%s_desc, msg);\n"
+                                 "}\n",
+                                 BDATA(cont->be.encode),
+                                 kw,
+                                 BDATA(cont->be.fqname),
+                                 BDATA(cont->be.fqname));
+    } else {
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "ssize_t\n"
+                                 "%s_cached(mnbytestream_t *bs, %s%s *msg)\n"
+                                 "{\n"
+                                 "    ssize_t res = 0;\n"
+                                 "    ssize_t nwritten;\n"
+                                 "    size_t sz;\n"
+                                 "    MNPB_STATS_ENTER(&%s_stats_type);\n\n",
+                                 BDATA(cont->be.encode),
+                                 kw,
+                                 BDATA(cont->be.fqname),
+                                 BDATA(cont->be.fqname));
+
+        mnpbc_container_traverse_fields(cont,
+                                         (array_traverser_t)print_pack_field,
+                                         &tgt);
+
+        (void)bytestream_nprintf(bs, 1024,
+                                 "end:\n"
+                                 "    MNPB_STATS_LEAVE(res, 1);\n"
+                                 "    return res;\n}"
+                                 "\n");
+    }
+
+    /*
+     * one pass to refresh the cached sizes of the whole tree, then
+     * write it out
+     */
     (void)bytestream_nprintf(bs,
                              1024,
                              "ssize_t\n"
                              "%s(mnbytestream_t *bs, %s%s *msg)\n"
                              "{\n"
+                             "    (void)%s(msg);\n"
+                             "    return %s_cached(bs, msg);\n"
+                             "}\n",
+                             BDATA(cont->be.encode),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.sz),
+                             BDATA(cont->be.encode));
+}
+
+
+static void
+print_pack_iov(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnpbc_pack_target_t tgt = { bs, 1 };
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_iov_cached(mnpb_iov_t *iov, %s%s *msg)\n"
+                             "{\n"
+                             "    mnbytestream_t *bs = &iov->scratch;\n"
                              "    ssize_t res = 0;\n"
                              "    ssize_t nwritten;\n"
-                             "    size_t sz;\n\n",
+                             "    size_t sz;\n"
+                             "    MNPB_STATS_ENTER(&%s_stats_type);\n\n",
                              BDATA(cont->be.encode),
                              kw,
+                             BDATA(cont->be.fqname),
                              BDATA(cont->be.fqname));
 
     mnpbc_container_traverse_fields(cont,
                                      (array_traverser_t)print_pack_field,
-                                     bs);
+                                     &tgt);
 
     (void)bytestream_nprintf(bs, 1024,
                              "end:\n"
+                             "    MNPB_STATS_LEAVE(res, 1);\n"
                              "    return res;\n}"
                              "\n");
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_iov(mnpb_iov_t *iov, %s%s *msg)\n"
+                             "{\n"
+                             "    (void)%s(msg);\n"
+                             "    return %s_iov_cached(iov, msg);\n"
+                             "}\n",
+                             BDATA(cont->be.encode),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.sz),
+                             BDATA(cont->be.encode));
 }
 
 
+/*
+ * Reverse encoder: fields last to first, every value before its key,
+ * every payload before its length
+ */
 static int
-print_unpack_field(mnpbc_field_t **field, mnbytestream_t *bs)
+print_pack_reverse_field(mnpbc_field_t **field, mnbytestream_t *bs)
 {
     mnpbc_container_t *cty;
+    int width;
 
     cty = (*field)->cty;
 
@@ -1139,315 +2112,1413 @@ print_unpack_field(mnpbc_field_t **field, mnbytestream_t *bs)
 
     } else if ((*field)->wtype == MNPB_WT_INTERN) {
         mnpbc_field_t **ufield;
-        mnpbc_field_t **cfield;
-        mnarray_iter_t uit;
-        mnarray_iter_t cit;
+        mnarray_iter_t it;
 
         /*
-         * MNPB_WT_INTERN is not a "valid" wire type.  I use it as
-         * a sentinel for oneof fields.
-         *
-         * oneof: runtime key calculation
+         * oneof
          */
         assert(cty->kind == MNPBC_CONT_KONEOF);
         assert(!(*field)->flags.repeated);
 
-        for (ufield = array_first(&cty->fields, &uit);
+        (void)bytestream_nprintf(bs, 1024,
+            "    switch (msg->%s.fnum) {\n",
+            BDATA((*field)->be.name));
+
+        for (ufield = array_first(&cty->fields, &it);
              ufield != NULL;
-             ufield = array_next(&cty->fields, &uit)) {
+             ufield = array_next(&cty->fields, &it)) {
             mnpbc_container_t *ucty;
 
             assert(!(*ufield)->flags.repeated);
             ucty = (*ufield)->cty;
+
             if (ucty == NULL) {
                 /* external? */
                 continue;
             }
-            //assert(ucty->kind == MNPBC_CONT_KBUILTIN);
-            //
-            //
-            //
-            //
-            //
-            //
-            //
+
             (void)bytestream_nprintf(bs, 1024,
-                "        case %"PRId64":\n",
+                "    case %"PRId64":\n",
                 (*ufield)->fnum);
 
-            /* cleanup old messages, strings and/or bytes */
-            (void)bytestream_nprintf(bs, 1024,
-                "            switch (msg->%s.fnum) {\n",
-                BDATA((*field)->be.name));
+            if (ucty->kind == MNPBC_CONT_KMESSAGE) {
+                /*
+                 * embedded message, then its length
+                 */
+                (void)bytestream_nprintf(bs, 1024,
+                    "        if ((nwritten = %s(rb, "
+                            "&msg->%s.data.%s)) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "res += nwritten;\n"
+                    "        if ((nwritten = mnpb_renvarint(rb, "
+                            "nwritten)) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "res += nwritten;\n",
+                    BDATA(ucty->be.rencode),
+                    BDATA((*field)->be.name),
+                    BDATA((*ufield)->be.name));
 
-            for (cfield = array_first(&cty->fields, &cit);
-                 cfield != NULL;
-                 cfield = array_next(&cty->fields, &cit)) {
-                mnpbc_container_t *ccty;
+                (void)bytestream_nprintf(bs, 1024,
+                    "        if ((nwritten = mnpb_rentag(rb, "
+                            "0x%"PRIx64"ull, %d)) < 0) { "
+                            "res = nwritten; "
+                            "goto end; "
+                        "} "
+                        "res += nwritten;\n",
+                    MNPBC_TAG(MNPB_MAKEKEY(MNPB_WT_LDELIM, (*ufield)->fnum)));
 
-                ccty = (*cfield)->cty;
-                if (ccty->kind == MNPBC_CONT_KMESSAGE) {
+            } else {
+                if (mnpbc_container_is_view(ucty)) {
                     (void)bytestream_nprintf(bs, 1024,
-                        "            case %"PRId64": %s_fini(&msg->%s.data.%s); break;\n",
-                        (*cfield)->fnum,
-                        BDATA(ccty->be.fqname),
+                        "        if (msg->%s.data.%s.data == NULL) { "
+                                    "break; "
+                                    "}\n",
                         BDATA((*field)->be.name),
-                        BDATA((*cfield)->be.name));
+                        BDATA((*ufield)->be.name));
                 } else {
-                    if (!MNPB_WT_NUMERIC((*cfield)->wtype)) {
-                        (void)bytestream_nprintf(bs, 1024,
-                            "            case %"PRId64": "
-                                "BYTES_DECREF(&msg->%s.data.%s); break;\n",
-                            (*cfield)->fnum,
-                            BDATA((*field)->be.name),
-                            BDATA((*cfield)->be.name));
-                    }
+                    (void)bytestream_nprintf(bs, 1024,
+                        "        if (msg->%s.data.%s == (%s)%s) { "
+                                    "break; "
+                                    "}\n",
+                        BDATA((*field)->be.name),
+                        BDATA((*ufield)->be.name),
+                        BDATA(ucty->be.fqname),
+                        MNPB_WT_NUMERIC((*ufield)->wtype) ? "0" : "NULL");
                 }
-            }
-            (void)bytestream_nprintf(bs, 1024,
-                "            default: break;\n"
-                "            }\n");
 
-            /* write new value */
-            if (ucty->kind == MNPBC_CONT_KMESSAGE) {
-                assert((*ufield)->wtype == MNPB_WT_LDELIM);
                 (void)bytestream_nprintf(bs, 1024,
-                    "            if (wtype != %d) { res = MNPB_ETYPE; "
-                                    "goto end; }\n"
-                    "            if ((nread = mnpb_devarint(bs, fd, &sz)) "
-                                    "< 0) { res = nread; goto end; } "
-                                    "res += nread;\n"
-                    "            msg->%s.data.%s._mnpbcc_rawsz = sz;\n"
-                    "            if ((nread = %s(bs, fd, &msg->%s.data.%s)) "
-                                    "< 0) { res = nread; goto end;}\n"
-                    "            // if (nread != (ssize_t)sz) { "
-                                    "res = -2; goto end; }\n"
-                    "            msg->%s.fnum = %"PRId64"; "
-                                    "res += nread; break;\n",
-                    (*ufield)->wtype,
-                    BDATA((*field)->be.name),
-                    BDATA((*ufield)->be.name),
-                    BDATA(ucty->be.decode),
-                    BDATA((*field)->be.name),
-                    BDATA((*ufield)->be.name),
+                    "        if ((nwritten = %s(rb, msg->%s.data.%s)) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "res += nwritten;\n",
+                    BDATA(ucty->be.rencode),
                     BDATA((*field)->be.name),
-                    (*ufield)->fnum);
+                    BDATA((*ufield)->be.name));
 
-            } else {
                 (void)bytestream_nprintf(bs, 1024,
-                    "            if ((nread = %s(bs, fd, wtype, "
-                                    "&msg->%s.data.%s)) < 0) { "
-                                     "res = nread; goto end; }\n"
-                    "            msg->%s.fnum = %"PRId64"; "
-                                    "res += nread; break;\n",
-                    BDATA(ucty->be.decode),
-                    BDATA((*field)->be.name),
-                    BDATA((*ufield)->be.name),
-                    BDATA((*field)->be.name),
-                    (*ufield)->fnum);
+                    "        if ((nwritten = mnpb_rentag(rb, "
+                            "0x%"PRIx64"ull, %d)) < 0) { "
+                            "res = nwritten; "
+                            "goto end; "
+                        "} "
+                        "res += nwritten;\n",
+                    MNPBC_TAG(MNPB_MAKEKEY((*ufield)->wtype, (*ufield)->fnum)));
             }
 
+            (void)bytestream_nprintf(bs, 1024,
+                "        break;\n");
+        }
 
+        (void)bytestream_nprintf(bs, 1024,
+            "    default: break;\n"
+            "    }\n");
 
+    } else if ((*field)->flags.repeated) {
+        /*
+         * packed: elements last to first, sz is what they took
+         */
+        if ((width = mnpbc_field_fixed_width(*field)) > 0) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    if ((nwritten = mnpb_rendata(rb, "
+                        "msg->%s.data, msg->%s.sz * %d)) < 0) { "
+                    "res = nwritten; "
+                    "goto end; "
+                "} "
+                "sz = nwritten;\n",
+                BDATA((*field)->be.name),
+                BDATA((*field)->be.name),
+                width);
 
+        } else if (cty->kind == MNPBC_CONT_KMESSAGE) {
+            /*
+             * each element carries its own length
+             */
+            (void)bytestream_nprintf(bs, 1024,
+                "    sz = 0; "
+                "for (size_t i = msg->%s.sz; i > 0; --i) { "
+                    "if ((nwritten = %s(rb, &msg->%s.data[i - 1])) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "sz += nwritten; "
+                    "if ((nwritten = mnpb_renvarint(rb, nwritten)) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "sz += nwritten; "
+                "}\n",
+                BDATA((*field)->be.name),
+                BDATA(cty->be.rencode),
+                BDATA((*field)->be.name));
 
-#if 0
-            if (ucty->kind == MNPBC_CONT_KMESSAGE) {
-                assert((*ufield)->wtype == MNPB_WT_LDELIM);
-                FAIL("print_unpack_field");
-
-            } else if (ucty->kind == MNPBC_CONT_KENUM) {
-                FAIL("print_unpack_field");
+        } else {
+            (void)bytestream_nprintf(bs, 1024,
+                "    sz = 0; "
+                "for (size_t i = msg->%s.sz; i > 0; --i) { "
+                    "if ((nwritten = %s(rb, msg->%s.data[i - 1])) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "sz += nwritten; "
+                "}\n",
+                BDATA((*field)->be.name),
+                BDATA(cty->be.rencode),
+                BDATA((*field)->be.name));
+        }
 
-            } else if (ucty->kind == MNPBC_CONT_KBUILTIN) {
-                mnpbc_field_t **cfield;
-                mnarray_iter_t cit;
+        (void)bytestream_nprintf(bs, 1024,
+            "    if (sz > 0) {\n"
+            "        res += sz;\n"
+            "        if ((nwritten = mnpb_renvarint(rb, sz)) < 0) { "
+                     "res = nwritten; "
+                     "goto end; "
+            "} "
+            "res += nwritten;\n"
+            "        if ((nwritten = mnpb_rentag(rb, "
+                    "0x%"PRIx64"ull, %d)) < 0) { "
+                     "res = nwritten; "
+                     "goto end; "
+            "} "
+            "res += nwritten;\n"
+            "    }\n",
+            MNPBC_TAG(MNPB_MAKEKEY(MNPB_WT_LDELIM, (*field)->fnum)));
 
-                (void)bytestream_nprintf(bs, 1024,
-                    "        case %"PRId64":\n",
-                    (*ufield)->fnum);
+    } else if (cty->kind == MNPBC_CONT_KMESSAGE) {
+        if (mnpbc_field_is_lazy(*field)) {
+            /*
+             * never accessed, re-emit the raw data as is
+             */
+            (void)bytestream_nprintf(bs, 1024,
+                "    if (msg->_mnpbcc_lazy_%s != NULL) {\n"
+                "        if ((nwritten = mnpb_renbytes(rb, "
+                            "msg->_mnpbcc_lazy_%s)) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "res += nwritten;\n"
+                "        if ((nwritten = mnpb_rentag(rb, "
+                            "0x%"PRIx64"ull, %d)) < 0) { "
+                        "res = nwritten; "
+                        "goto end; "
+                    "} "
+                    "res += nwritten;\n"
+                "    } else\n",
+                BDATA((*field)->be.name),
+                BDATA((*field)->be.name),
+                MNPBC_TAG(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)));
+        }
 
-                /* cleanup old strings and/or bytes */
-                (void)bytestream_nprintf(bs, 1024,
-                    "            switch (msg->%s.fnum) {\n",
-                    BDATA((*field)->be.name));
+        /*
+         * embedded message, then its length, empty ones are omitted
+         */
+        (void)bytestream_nprintf(bs, 1024,
+            "    if ((nwritten = %s(rb, &msg->%s)) < 0) { "
+                "res = nwritten; "
+                "goto end; "
+            "} else if ((sz = nwritten) > 0) {\n"
+            "        res += sz;\n"
+            "        if ((nwritten = mnpb_renvarint(rb, sz)) < 0) { "
+                "res = nwritten; "
+                "goto end; "
+            "} "
+            "res += nwritten;\n"
+            "        if ((nwritten = mnpb_rentag(rb, "
+                    "0x%"PRIx64"ull, %d)) < 0) { "
+                "res = nwritten; "
+                "goto end; "
+            "} "
+            "res += nwritten;\n"
+            "    }\n",
+            BDATA(cty->be.rencode),
+            BDATA((*field)->be.name),
+            MNPBC_TAG(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)));
 
-                for (cfield = array_first(&cty->fields, &cit);
-                     cfield != NULL;
-                     cfield = array_next(&cty->fields, &cit)) {
+    } else {
+        if (mnpbc_container_is_view(cty)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    if (msg->%s.data != NULL) {\n",
+                BDATA((*field)->be.name));
+        } else {
+            /* builtins and enums */
+            (void)bytestream_nprintf(bs, 1024,
+                "    if (msg->%s != (%s%s)%s) {\n",
+                BDATA((*field)->be.name),
+                cty->kind == MNPBC_CONT_KENUM ? "enum " : "",
+                BDATA(cty->be.fqname),
+                MNPB_WT_NUMERIC((*field)->wtype) ? "0" : "NULL");
+        }
 
-                    if (cfield == ufield) {
-                        continue;
-                    }
+        (void)bytestream_nprintf(bs, 1024,
+            "        if ((nwritten = %s(rb, msg->%s)) < 0) { "
+                "res = nwritten; "
+                "goto end; "
+            "} "
+            "res += nwritten;\n"
+            "        if ((nwritten = mnpb_rentag(rb, "
+                    "0x%"PRIx64"ull, %d)) < 0) { "
+                "res = nwritten; "
+                "goto end; "
+            "} "
+            "res += nwritten;\n"
+            "    }\n",
+            BDATA(cty->be.rencode),
+            BDATA((*field)->be.name),
+            MNPBC_TAG(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)));
+    }
 
-                    if (!MNPB_WT_NUMERIC((*cfield)->wtype)) {
-                        (void)bytestream_nprintf(bs, 1024,
-                            "            case %"PRId64": "
-                                "BYTES_DECREF(&msg->%s.data.%s); break;\n",
-                            (*cfield)->fnum,
-                            BDATA((*field)->be.name),
-                            BDATA((*cfield)->be.name));
-                    }
-                }
-                (void)bytestream_nprintf(bs, 1024,
-                    "            default: break;\n"
-                    "            }\n");
+    return 0;
+}
 
-                /* write new value */
-                (void)bytestream_nprintf(bs, 1024,
-                    "            if ((nread = %s(bs, fd, wtype, "
-                                    "&msg->%s.data.%s)) < 0) { "
-                                     "res = nread; goto end; }\n"
-                    "            msg->%s.fnum = %"PRId64"; "
-                                    "res += nread; break;\n",
-                    BDATA(ucty->be.decode),
-                    BDATA((*field)->be.name),
-                    BDATA((*ufield)->be.name),
-                    BDATA((*field)->be.name),
-                    (*ufield)->fnum);
 
-            } else {
-                FAIL("print_unpack_field");
-            }
-#endif
-        }
+static void
+print_pack_reverse(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
 
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
 
+    kw = mnpbc_container_keyword(cont);
 
-    } else if ((*field)->flags.repeated) {
-        mnpbc_container_t *cont;
-        char *kwf;
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s(mnpb_rbuf_t *rb, %s%s *msg)\n"
+                             "{\n"
+                             "    ssize_t res = 0;\n"
+                             "    ssize_t nwritten;\n"
+                             "    size_t sz;\n"
+                             "    MNPB_STATS_ENTER(&%s_stats_type);\n\n",
+                             BDATA(cont->be.rencode),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname));
 
-        /*
-         * packed
-         */
-        assert(cty->kind != MNPBC_CONT_KONEOF);
-        assert((*field)->wtype != MNPB_WT_INTERN);
-        /*
-         * wither enum or message or builtin
-         */
-        kwf = mnpbc_container_keyword(cty);
+    mnpbc_container_traverse_fields_reverse(
+        cont, (array_traverser_t)print_pack_reverse_field, bs);
 
-        cont = (*field)->parent;
-        assert(cont!= NULL);
+    (void)bytestream_nprintf(bs, 1024,
+                             "end:\n"
+                             "    MNPB_STATS_LEAVE(res, 1);\n"
+                             "    return res;\n}"
+                             "\n");
 
-        (void)bytestream_nprintf(bs, 1024,
-            "        case %"PRId64":\n"
-            "            if (wtype != %d) { res = MNPB_ETYPE; goto end; }\n"
-            "            if ((nread = mnpb_devarint(bs, fd, &sz)) < 0) { "
-                            "res = nread; goto end; } res += nread;\n"
-            "            for (nread_item = 0, nread = 0; "
-                                "nread_item < (ssize_t)sz; ) {\n"
-            "                %s%s *item;\n"
-            "                //uint64_t etag;\n"
-            "                uint64_t esz;\n"
-            "                if ((item = %s_%s_alloc(msg, 1)) == NULL) { "
-                                "res = MNPB_EMEMORY; goto end; }\n"
-            ,
-            (*field)->fnum,
-            MNPB_WT_LDELIM,
-            kwf == NULL ? "" : kwf,
-            BDATA(cty->be.fqname),
-            BDATA(cont->be.fqname),
-            BDATA((*field)->be.name));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_reverse(mnbytestream_t *bs, %s%s *msg)\n"
+                             "{\n"
+                             "    mnpb_rbuf_t rb;\n"
+                             "    ssize_t res;\n\n"
+                             "    mnpb_rbuf_init(&rb, 256);\n"
+                             "    if ((res = %s(&rb, msg)) > 0) {\n"
+                             "        if (bytestream_cat(bs, res, "
+                                        "MNPB_RBUF_DATA(&rb)) < 0) {\n"
+                             "            res = MNPB_EIO;\n"
+                             "        }\n"
+                             "    }\n"
+                             "    mnpb_rbuf_fini(&rb);\n"
+                             "    return res;\n"
+                             "}\n",
+                             BDATA(cont->be.encode),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.rencode));
+}
 
-        if (cty->kind == MNPBC_CONT_KMESSAGE) {
-            (void)bytestream_nprintf(bs, 1024,
-                "                if ((nread = mnpb_devarint(bs, fd, "
-                                    "&esz)) < 0) { "
-                                    "res = nread; goto end; } "
-                                    "item->_mnpbcc_rawsz = esz; "
-                                    "nread_item += nread;\n"
-                );
-            (void)bytestream_nprintf(bs, 1024,
-                "                if ((nread = %s(bs, fd, item)) < 0) { "
-                                    "res = nread; goto end; } "
-                                    "nread_item += nread;\n",
-                BDATA(cty->be.decode));
 
-        } else if (cty->kind == MNPBC_CONT_KENUM) {
-            (void)bytestream_nprintf(bs, 1024,
-                "                { int64_t v; if ((nread = "
-                                    "%s(bs, fd, -1, &v)) < 0) { "
-                                    "res = nread; goto end; } *item = v; "
-                                    "nread_item += nread; }\n",
-                BDATA(cty->be.decode));
+/*
+ * decoder call for an embedded message into dst, through the projection
+ * of the submask when projected
+ */
+static mnbytes_t *
+mnpbc_unpack_call(mnpbc_container_t *cty,
+                  const char *dst,
+                  mnbytes_t *submask,
+                  bool projected)
+{
+    mnbytes_t *res;
 
-        } else if (cty->kind == MNPBC_CONT_KBUILTIN) {
-            (void)bytestream_nprintf(bs, 1024,
-                "                if ((nread = %s(bs, fd, -1, item)) < 0) { "
-                                    "res = nread; goto end; } "
-                                    "nread_item += nread;\n",
-                BDATA(cty->be.decode));
+    if (projected) {
+        res = bytes_printf("(mask->%s != NULL ? "
+                           "%s_unpack_projected(bs, fd, %s, mask->%s) : "
+                           "%s(bs, fd, %s))",
+                           BDATA(submask),
+                           BDATA(cty->be.fqname),
+                           dst,
+                           BDATA(submask),
+                           BDATA(cty->be.decode),
+                           dst);
+    } else {
+        res = bytes_printf("%s(bs, fd, %s)", BDATA(cty->be.decode), dst);
+    }
+    BYTES_INCREF(res);
+    return res;
+}
 
-        } else {
-            FAIL("print_unpack_field");
+
+/*
+ * field the unrolled encoder writes after this one, that is the next one
+ * declared in the message, and after a oneof member the field next to
+ * the oneof; NULL if none, or if it is itself a oneof, whose key is not
+ * known in advance
+ */
+static mnpbc_field_t *
+mnpbc_field_next(mnpbc_field_t *field)
+{
+    mnpbc_container_t *cont;
+    mnpbc_field_t **f;
+    mnarray_iter_t it;
+    bool found;
+
+    cont = field->parent;
+    if (cont->kind == MNPBC_CONT_KONEOF) {
+        mnpbc_field_t *oneof;
+
+        for (oneof = NULL, f = array_first(&cont->parent->fields, &it);
+             f != NULL;
+             f = array_next(&cont->parent->fields, &it)) {
+            if ((*f)->cty == cont) {
+                oneof = *f;
+                break;
+            }
+        }
+        assert(oneof != NULL);
+        field = oneof;
+        cont = oneof->parent;
+    }
+
+    for (found = false, f = array_first(&cont->fields, &it);
+         f != NULL;
+         f = array_next(&cont->fields, &it)) {
+        if (*f == field) {
+            found = true;
+        } else if (found && (*f)->cty != NULL) {
+            return (*f)->wtype == MNPB_WT_INTERN ? NULL : *f;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * whether a field is reachable by tag prediction: any but the first one
+ * in the message, oneof members excepted
+ */
+static bool
+mnpbc_field_predicted(mnpbc_field_t *field)
+{
+    mnpbc_field_t **f;
+    mnarray_iter_t it;
+
+    if (field->parent->kind != MNPBC_CONT_KMESSAGE) {
+        return false;
+    }
+    for (f = array_first(&field->parent->fields, &it);
+         f != NULL;
+         f = array_next(&field->parent->fields, &it)) {
+        if (*f == field) {
+            break;
         }
+        if ((*f)->cty != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
+static void
+print_unpack_case(mnpbc_field_t *field, mnbytestream_t *bs, bool projected)
+{
+    (void)bytestream_nprintf(bs, 1024,
+        "        case %"PRId64":\n",
+        field->fnum);
+    if (!projected && mnpbc_field_predicted(field)) {
         (void)bytestream_nprintf(bs, 1024,
-            "            }\n"
-            "            res += nread_item; break;\n"
-            );
+            "        field_%"PRId64":\n",
+            field->fnum);
+    }
+}
 
-    } else {
-        if (cty->kind == MNPBC_CONT_KMESSAGE) {
-            assert((*field)->wtype == MNPB_WT_LDELIM);
-            (void)bytestream_nprintf(bs, 1024,
-                "        case %"PRId64":\n"
-                "            if (wtype != %d) { res = MNPB_ETYPE; goto end; }\n"
-                "            if ((nread = mnpb_devarint(bs, fd, &sz)) < 0) { "
-                                "res = nread; goto end; } res += nread;\n"
-                "            msg->%s._mnpbcc_rawsz = (ssize_t)sz;\n"
-                "            if ((nread = %s(bs, fd, &msg->%s)) < 0) { "
-                                "res = nread; goto end; }\n"
-                "            // if (nread != (ssize_t)sz) { "
-                                "res = -2; goto end; }\n"
-                "            res += nread; break;\n"
-                ,
-                (*field)->fnum,
-                (*field)->wtype,
-                BDATA((*field)->be.name),
-                BDATA(cty->be.decode),
-                BDATA((*field)->be.name));
 
-        } else if (cty->kind == MNPBC_CONT_KENUM) {
+/*
+ * End of a case: if the next key in the buffer is that of the field
+ * encoded next, take it without decoding the key and going through the
+ * switch.  Never past the end of the message, which is where the
+ * parent's fields begin.
+ */
+static void
+print_unpack_next(mnpbc_field_t *field, mnbytestream_t *bs, bool projected)
+{
+    mnpbc_field_t *next;
+
+    if (!projected && (next = mnpbc_field_next(field)) != NULL) {
+        int wtype;
+
+        wtype = next->flags.repeated ? MNPB_WT_LDELIM : next->wtype;
+        (void)bytestream_nprintf(bs, 1024,
+            "            if (res < msg->_mnpbcc_rawsz && "
+                            "mnpb_match_tag(bs, 0x%"PRIx64"ull, %d)) { "
+                "res += %d; tag = %"PRId64"; wtype = %d; "
+                "goto field_%"PRId64"; "
+            "}\n",
+            MNPBC_TAG(MNPB_MAKEKEY(wtype, next->fnum)),
+            mnpbc_tag_sz(MNPB_MAKEKEY(wtype, next->fnum)),
+            next->fnum,
+            wtype,
+            next->fnum);
+    }
+    (void)bytestream_nprintf(bs, 1024, "            break;\n");
+}
+
+
+static int
+print_unpack_field_ex(mnpbc_field_t **field,
+                      mnbytestream_t *bs,
+                      bool projected)
+{
+    mnpbc_container_t *cty;
+
+    cty = (*field)->cty;
+
+    if (cty == NULL) {
+        assert((*field)->wtype == MNPB_WT_UNDEF);
+
+        (void)bytestream_nprintf(bs, 1024,
+            "    //(external:%s) %s\n",
+            BDATA((*field)->ty),
+            BDATA((*field)->pb.name));
+
+    } else if ((*field)->wtype == MNPB_WT_INTERN) {
+        mnpbc_field_t **ufield;
+        mnpbc_field_t **cfield;
+        mnarray_iter_t uit;
+        mnarray_iter_t cit;
+
+        /*
+         * MNPB_WT_INTERN is not a "valid" wire type.  I use it as
+         * a sentinel for oneof fields.
+         *
+         * oneof: runtime key calculation
+         */
+        assert(cty->kind == MNPBC_CONT_KONEOF);
+        assert(!(*field)->flags.repeated);
+
+        for (ufield = array_first(&cty->fields, &uit);
+             ufield != NULL;
+             ufield = array_next(&cty->fields, &uit)) {
+            mnpbc_container_t *ucty;
+
+            assert(!(*ufield)->flags.repeated);
+            ucty = (*ufield)->cty;
+            if (ucty == NULL) {
+                /* external? */
+                continue;
+            }
+            //assert(ucty->kind == MNPBC_CONT_KBUILTIN);
+            //
+            //
+            //
+            //
+            //
+            //
+            //
+            print_unpack_case(*ufield, bs, projected);
+
+            /* cleanup old messages, strings and/or bytes */
             (void)bytestream_nprintf(bs, 1024,
-                "        case %"PRId64":\n"
-                "            { int64_t v; "
-                                "if ((nread = %s(bs, fd, wtype, &v)) < 0) { "
-                                     "res = nread; goto end; "
-                                "} "
-                                "msg->%s = v; "
-                            "}\n"
-                "            res += nread; break;\n",
-                (*field)->fnum,
-                BDATA(cty->be.decode),
+                "            switch (msg->%s.fnum) {\n",
                 BDATA((*field)->be.name));
-        } else if (cty->kind == MNPBC_CONT_KBUILTIN) {
-            /*
-             * normal tag: wtype + fnum
-             */
+
+            for (cfield = array_first(&cty->fields, &cit);
+                 cfield != NULL;
+                 cfield = array_next(&cty->fields, &cit)) {
+                mnpbc_container_t *ccty;
+
+                ccty = (*cfield)->cty;
+                if (ccty->kind == MNPBC_CONT_KMESSAGE) {
+                    (void)bytestream_nprintf(bs, 1024,
+                        "            case %"PRId64": %s_fini(&msg->%s.data.%s); break;\n",
+                        (*cfield)->fnum,
+                        BDATA(ccty->be.fqname),
+                        BDATA((*field)->be.name),
+                        BDATA((*cfield)->be.name));
+                } else {
+                    if (!MNPB_WT_NUMERIC((*cfield)->wtype) &&
+                        !mnpbc_container_is_view(ccty)) {
+                        (void)bytestream_nprintf(bs, 1024,
+                            "            case %"PRId64": "
+                                "mnpb_bytes_decref(&msg->%s.data.%s); "
+                                "break;\n",
+                            (*cfield)->fnum,
+                            BDATA((*field)->be.name),
+                            BDATA((*cfield)->be.name));
+                    }
+                }
+            }
             (void)bytestream_nprintf(bs, 1024,
-                "        case %"PRId64":\n"
-                "            if ((nread = %s(bs, fd, wtype, &msg->%s)) < 0) { "
-                                 "res = nread; goto end; }\n"
-                "            res += nread; break;\n",
-                (*field)->fnum,
-                BDATA(cty->be.decode),
-                BDATA((*field)->be.name));
+                "            default: break;\n"
+                "            }\n");
 
-        } else {
-            FAIL("print_unpack_field");
-        }
-    }
+            /* write new value */
+            if (ucty->kind == MNPBC_CONT_KMESSAGE) {
+                mnbytes_t *dst, *call;
 
-//end:
-    return 0;
+                assert((*ufield)->wtype == MNPB_WT_LDELIM);
+                dst = bytes_printf("&msg->%s.data.%s",
+                                   BDATA((*field)->be.name),
+                                   BDATA((*ufield)->be.name));
+                BYTES_INCREF(dst);
+                call = mnpbc_unpack_call(ucty,
+                                         BCDATA(dst),
+                                         (*ufield)->be.name,
+                                         projected);
+                (void)bytestream_nprintf(bs, 1024,
+                    "            if ((nread = mnpb_devarint(bs, fd, &sz)) "
+                                    "< 0) { res = nread; goto end; } "
+                                    "res += nread;\n"
+                    "            msg->%s.data.%s._mnpbcc_rawsz = sz;\n"
+                    "            if ((nread = %s) "
+                                    "< 0) { res = nread; goto end;}\n"
+                    "            // if (nread != (ssize_t)sz) { "
+                                    "res = -2; goto end; }\n"
+                    "            msg->%s.fnum = %"PRId64"; "
+                                    "res += nread;\n",
+                    BDATA((*field)->be.name),
+                    BDATA((*ufield)->be.name),
+                    BDATA(call),
+                    BDATA((*field)->be.name),
+                    (*ufield)->fnum);
+                BYTES_DECREF(&call);
+                BYTES_DECREF(&dst);
+
+            } else {
+                (void)bytestream_nprintf(bs, 1024,
+                    "            if ((nread = %s(bs, fd, wtype, "
+                                    "&msg->%s.data.%s)) < 0) { "
+                                     "res = nread; goto end; }\n"
+                    "            msg->%s.fnum = %"PRId64"; "
+                                    "res += nread;\n",
+                    BDATA(ucty->be.decode),
+                    BDATA((*field)->be.name),
+                    BDATA((*ufield)->be.name),
+                    BDATA((*field)->be.name),
+                    (*ufield)->fnum);
+            }
+            print_unpack_next(*ufield, bs, projected);
+
+
+
+
+
+#if 0
+            if (ucty->kind == MNPBC_CONT_KMESSAGE) {
+                assert((*ufield)->wtype == MNPB_WT_LDELIM);
+                FAIL("print_unpack_field");
+
+            } else if (ucty->kind == MNPBC_CONT_KENUM) {
+                FAIL("print_unpack_field");
+
+            } else if (ucty->kind == MNPBC_CONT_KBUILTIN) {
+                mnpbc_field_t **cfield;
+                mnarray_iter_t cit;
+
+                (void)bytestream_nprintf(bs, 1024,
+                    "        case %"PRId64":\n",
+                    (*ufield)->fnum);
+
+                /* cleanup old strings and/or bytes */
+                (void)bytestream_nprintf(bs, 1024,
+                    "            switch (msg->%s.fnum) {\n",
+                    BDATA((*field)->be.name));
+
+                for (cfield = array_first(&cty->fields, &cit);
+                     cfield != NULL;
+                     cfield = array_next(&cty->fields, &cit)) {
+
+                    if (cfield == ufield) {
+                        continue;
+                    }
+
+                    if (!MNPB_WT_NUMERIC((*cfield)->wtype)) {
+                        (void)bytestream_nprintf(bs, 1024,
+                            "            case %"PRId64": "
+                                "mnpb_bytes_decref(&msg->%s.data.%s); "
+                                "break;\n",
+                            (*cfield)->fnum,
+                            BDATA((*field)->be.name),
+                            BDATA((*cfield)->be.name));
+                    }
+                }
+                (void)bytestream_nprintf(bs, 1024,
+                    "            default: break;\n"
+                    "            }\n");
+
+                /* write new value */
+                (void)bytestream_nprintf(bs, 1024,
+                    "            if ((nread = %s(bs, fd, wtype, "
+                                    "&msg->%s.data.%s)) < 0) { "
+                                     "res = nread; goto end; }\n"
+                    "            msg->%s.fnum = %"PRId64"; "
+                                    "res += nread; break;\n",
+                    BDATA(ucty->be.decode),
+                    BDATA((*field)->be.name),
+                    BDATA((*ufield)->be.name),
+                    BDATA((*field)->be.name),
+                    (*ufield)->fnum);
+
+            } else {
+                FAIL("print_unpack_field");
+            }
+#endif
+        }
+
+
+
+    } else if ((*field)->flags.repeated) {
+        mnpbc_container_t *cont;
+        char *kwf;
+
+        /*
+         * packed
+         */
+        assert(cty->kind != MNPBC_CONT_KONEOF);
+        assert((*field)->wtype != MNPB_WT_INTERN);
+        /*
+         * wither enum or message or builtin
+         */
+        kwf = mnpbc_container_keyword(cty);
+
+        cont = (*field)->parent;
+        assert(cont!= NULL);
+
+        if (cty->be.decode_packed != NULL) {
+            int width;
+
+            print_unpack_case(*field, bs, projected);
+            (void)bytestream_nprintf(bs, 1024,
+                "            if ((nread = mnpb_devarint(bs, fd, &sz)) < 0) { "
+                                "res = nread; goto end; } res += nread;\n");
+
+            if ((width = mnpbc_field_fixed_width(*field)) > 0) {
+                /*
+                 * fixed-width run: the element count is known upfront
+                 */
+                (void)bytestream_nprintf(bs, 1024,
+                    "            if (sz > (uint64_t)SSIZE_MAX || "
+                                    "sz %% %d != 0) { "
+                                    "res = MNPB_ESIZE; goto end; }\n"
+                    "            nread_item = (ssize_t)(sz / %d);\n",
+                    width,
+                    width);
+            } else {
+                /*
+                 * varint run: count the elements first
+                 */
+                (void)bytestream_nprintf(bs, 1024,
+                    "            if ((nread_item = mnpb_count_packed_varint("
+                                    "bs, fd, sz)) < 0) { "
+                                    "res = nread_item; goto end; }\n");
+            }
+
+            /*
+             * allocate once, decode the whole run in bulk; _alloc()
+             * takes an int
+             */
+            (void)bytestream_nprintf(bs, 1024,
+                "            if (nread_item > INT_MAX) { "
+                                "res = MNPB_ESIZE; goto end; }\n"
+                "            {\n"
+                "                %s%s *item = NULL;\n"
+                "                if (nread_item > 0 && "
+                                    "(item = %s_%s_alloc(msg, "
+                                    "(int)nread_item)) == NULL) { "
+                                    "res = MNPB_EMEMORY; goto end; }\n"
+                "                if ((nread = %s(bs, fd, sz, %sitem, "
+                                    "(size_t)nread_item)) < 0) { "
+                                    "res = nread; goto end; }\n"
+                "            }\n"
+                "            res += (ssize_t)sz;\n"
+                ,
+                kwf == NULL ? "" : kwf,
+                BDATA(cty->be.fqname),
+                BDATA(cont->be.fqname),
+                BDATA((*field)->be.name),
+                BDATA(cty->be.decode_packed),
+                cty->kind == MNPBC_CONT_KENUM ? "(int *)" : "");
+            print_unpack_next(*field, bs, projected);
+
+            goto end;
+        }
+
+        print_unpack_case(*field, bs, projected);
+        (void)bytestream_nprintf(bs, 1024,
+            "            if ((nread = mnpb_devarint(bs, fd, &sz)) < 0) { "
+                            "res = nread; goto end; } res += nread;\n"
+            "            for (nread_item = 0, nread = 0; "
+                                "nread_item < (ssize_t)sz; ) {\n"
+            "                %s%s *item;\n"
+            "                //uint64_t etag;\n"
+            "                uint64_t esz;\n"
+            "                if ((item = %s_%s_alloc%s(msg, 1)) == NULL) { "
+                                "res = MNPB_EMEMORY; goto end; }\n"
+            ,
+            kwf == NULL ? "" : kwf,
+            BDATA(cty->be.fqname),
+            BDATA(cont->be.fqname),
+            BDATA((*field)->be.name),
+            mnpbc_field_retains_bytes(*field) ? "_retained" : "");
+
+        if (cty->kind == MNPBC_CONT_KMESSAGE) {
+            (void)bytestream_nprintf(bs, 1024,
+                "                if ((nread = mnpb_devarint(bs, fd, "
+                                    "&esz)) < 0) { "
+                                    "res = nread; goto end; } "
+                                    "item->_mnpbcc_rawsz = esz; "
+                                    "nread_item += nread;\n"
+                );
+            mnbytes_t *call;
+
+            call = mnpbc_unpack_call(cty,
+                                     "item",
+                                     (*field)->be.name,
+                                     projected);
+            (void)bytestream_nprintf(bs, 1024,
+                "                if ((nread = %s) < 0) { "
+                                    "res = nread; goto end; } "
+                                    "nread_item += nread;\n",
+                BDATA(call));
+            BYTES_DECREF(&call);
+
+        } else if (cty->kind == MNPBC_CONT_KENUM) {
+            (void)bytestream_nprintf(bs, 1024,
+                "                { int64_t v; if ((nread = "
+                                    "%s(bs, fd, -1, &v)) < 0) { "
+                                    "res = nread; goto end; } *item = v; "
+                                    "nread_item += nread; }\n",
+                BDATA(cty->be.decode));
+
+        } else if (cty->kind == MNPBC_CONT_KBUILTIN) {
+            (void)bytestream_nprintf(bs, 1024,
+                "                if ((nread = %s(bs, fd, -1, item)) < 0) { "
+                                    "res = nread; goto end; } "
+                                    "nread_item += nread;\n",
+                BDATA(cty->be.decode));
+
+        } else {
+            FAIL("print_unpack_field");
+        }
+
+        (void)bytestream_nprintf(bs, 1024,
+            "            }\n"
+            "            res += nread_item;\n"
+            );
+        print_unpack_next(*field, bs, projected);
+
+    } else {
+        if (mnpbc_field_is_lazy(*field)) {
+            /*
+             * keep the raw data, decode on first access
+             */
+            print_unpack_case(*field, bs, projected);
+            (void)bytestream_nprintf(bs, 1024,
+                "            if ((nread = mnpb_devarint(bs, fd, &sz)) < 0) { "
+                                "res = nread; goto end; } res += nread;\n"
+                "            mnpb_bytes_decref(&msg->_mnpbcc_lazy_%s);\n"
+                "            if ((nread = mnpb_deslice(bs, fd, sz, "
+                                "&msg->_mnpbcc_lazy_%s)) < 0) { "
+                                "res = nread; goto end; }\n"
+                "            BYTES_INCREF(msg->_mnpbcc_lazy_%s);\n"
+                "            res += nread;\n"
+                ,
+                BDATA((*field)->be.name),
+                BDATA((*field)->be.name),
+                BDATA((*field)->be.name));
+
+        } else if (cty->kind == MNPBC_CONT_KMESSAGE) {
+            mnbytes_t *dst, *call;
+
+            assert((*field)->wtype == MNPB_WT_LDELIM);
+            dst = bytes_printf("&msg->%s", BDATA((*field)->be.name));
+            BYTES_INCREF(dst);
+            call = mnpbc_unpack_call(cty,
+                                     BCDATA(dst),
+                                     (*field)->be.name,
+                                     projected);
+            print_unpack_case(*field, bs, projected);
+            (void)bytestream_nprintf(bs, 1024,
+                "            if ((nread = mnpb_devarint(bs, fd, &sz)) < 0) { "
+                                "res = nread; goto end; } res += nread;\n"
+                "            msg->%s._mnpbcc_rawsz = (ssize_t)sz;\n"
+                "            if ((nread = %s) < 0) { "
+                                "res = nread; goto end; }\n"
+                "            // if (nread != (ssize_t)sz) { "
+                                "res = -2; goto end; }\n"
+                "            res += nread;\n"
+                ,
+                BDATA((*field)->be.name),
+                BDATA(call));
+            BYTES_DECREF(&call);
+            BYTES_DECREF(&dst);
+
+        } else if (cty->kind == MNPBC_CONT_KENUM) {
+            print_unpack_case(*field, bs, projected);
+            (void)bytestream_nprintf(bs, 1024,
+                "            { int64_t v; "
+                                "if ((nread = %s(bs, fd, wtype, &v)) < 0) { "
+                                     "res = nread; goto end; "
+                                "} "
+                                "msg->%s = v; "
+                            "}\n"
+                "            res += nread;\n",
+                BDATA(cty->be.decode),
+                BDATA((*field)->be.name));
+        } else if (cty->kind == MNPBC_CONT_KBUILTIN) {
+            /*
+             * normal tag: wtype + fnum
+             */
+            print_unpack_case(*field, bs, projected);
+            (void)bytestream_nprintf(bs, 1024,
+                "            if ((nread = %s(bs, fd, wtype, &msg->%s)) < 0) { "
+                                 "res = nread; goto end; }\n"
+                "            res += nread;\n",
+                BDATA(cty->be.decode),
+                BDATA((*field)->be.name));
+
+        } else {
+            FAIL("print_unpack_field");
+        }
+        print_unpack_next(*field, bs, projected);
+    }
+
+end:
+    return 0;
+}
+
+
+static int
+print_unpack_field(mnpbc_field_t **field, mnbytestream_t *bs)
+{
+    return print_unpack_field_ex(field, bs, false);
+}
+
+
+static int
+print_unpack_projected_field(mnpbc_field_t **field, mnbytestream_t *bs)
+{
+    return print_unpack_field_ex(field, bs, true);
+}
+
+
+/*
+ * Whether tag is selected by the mask, unknown tags never are.
+ */
+static void
+print_mask_isset(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnpbc_field_t **field;
+    mnarray_iter_t it;
+    int nbits;
+
+    (void)bytestream_nprintf(bs, 1024,
+        "static int\n"
+        "%s_mask_isset(const struct %s_mask *mask, uint64_t tag)\n{\n"
+        "    switch (tag) {\n",
+        BDATA(cont->be.fqname),
+        BDATA(cont->be.fqname));
+
+    nbits = 0;
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        if ((*field)->cty != NULL &&
+            (*field)->cty->kind == MNPBC_CONT_KONEOF) {
+            mnpbc_field_t **ufield;
+            mnarray_iter_t uit;
+
+            for (ufield = array_first(&(*field)->cty->fields, &uit);
+                 ufield != NULL;
+                 ufield = array_next(&(*field)->cty->fields, &uit)) {
+                (void)bytestream_nprintf(bs, 1024,
+                    "    case %"PRId64": return MNPB_MASK_ISSET(mask, %d);\n",
+                    (*ufield)->fnum,
+                    nbits++);
+            }
+        } else {
+            (void)bytestream_nprintf(bs, 1024,
+                "    case %"PRId64": return MNPB_MASK_ISSET(mask, %d);\n",
+                (*field)->fnum,
+                nbits++);
+        }
+    }
+
+    (void)bytestream_nprintf(bs, 1024,
+        "    default: return 0;\n"
+        "    }\n"
+        "}\n");
+}
+
+
+/*
+ * field of tag in the message, oneof members included, NULL if none or
+ * external
+ */
+static mnpbc_field_t *
+mnpbc_container_field_by_fnum(mnpbc_container_t *cont, int64_t fnum)
+{
+    mnpbc_field_t **field;
+    mnarray_iter_t it;
+
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        if ((*field)->cty == NULL) {
+            continue;
+        }
+        if ((*field)->cty->kind == MNPBC_CONT_KONEOF) {
+            mnpbc_field_t *ufield;
+
+            if ((ufield = mnpbc_container_field_by_fnum(
+                            (*field)->cty, fnum)) != NULL) {
+                return ufield;
+            }
+        } else if ((*field)->fnum == fnum) {
+            return *field;
+        }
+    }
+    return NULL;
+}
+
+
+static void
+print_unpack_slot_sparse(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnpbc_field_t **field;
+    mnarray_iter_t it;
+
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        if ((*field)->cty == NULL) {
+            continue;
+        }
+        if ((*field)->cty->kind == MNPBC_CONT_KONEOF) {
+            print_unpack_slot_sparse((*field)->cty, bs);
+        } else if ((*field)->fnum >= MNPBC_SLOT_DENSE) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    case %"PRId64": "
+                    "return (0x%02x >> wtype) & 1 ? %"PRId64" : -1;\n",
+                (*field)->fnum,
+                mnpbc_field_wtypes(*field),
+                (*field)->fnum);
+        }
+    }
+}
+
+
+/*
+ * Dispatch of a decoded key: the tag if wtype is one its field accepts,
+ * -1 if not, 0 for an unknown tag.  Single byte keys, tags below
+ * MNPBC_SLOT_DENSE, are looked up by the key itself, others go through
+ * a switch the compiler turns into a binary search.
+ */
+static void
+print_unpack_slot(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    int64_t fnum;
+
+    (void)bytestream_nprintf(bs, 1024,
+        "static int64_t\n"
+        "%s_slot(uint64_t tag, int wtype)\n{\n"
+        "    static const int8_t dense[%d] = {\n",
+        BDATA(cont->be.fqname),
+        MNPBC_SLOT_DENSE << 3);
+
+    for (fnum = 0; fnum < MNPBC_SLOT_DENSE; ++fnum) {
+        mnpbc_field_t *field;
+        int wtypes;
+        int i;
+
+        if ((field = mnpbc_container_field_by_fnum(cont, fnum)) == NULL) {
+            wtypes = 0;
+        } else {
+            wtypes = mnpbc_field_wtypes(field);
+        }
+        (void)bytestream_nprintf(bs, 1024, "       ");
+        for (i = 0; i < 8; ++i) {
+            (void)bytestream_nprintf(bs, 1024,
+                " %d,",
+                field == NULL ? 0 : (wtypes >> i) & 1 ? (int)fnum : -1);
+        }
+        (void)bytestream_nprintf(bs, 1024, "\n");
+    }
+
+    (void)bytestream_nprintf(bs, 1024,
+        "    };\n"
+        "    if (tag < %d) {\n"
+        "        return dense[(tag << 3) | (uint64_t)wtype];\n"
+        "    }\n"
+        "    switch (tag) {\n",
+        MNPBC_SLOT_DENSE);
+    print_unpack_slot_sparse(cont, bs);
+    (void)bytestream_nprintf(bs, 1024,
+        "    default: return 0;\n"
+        "    }\n"
+        "}\n");
+}
+
+
+/*
+ * The regular decoder, or the projected one, which skips fields not in
+ * the mask without building them, and descends into embedded messages
+ * with their own masks.
+ */
+static void
+print_unpack_ex(mnpbc_container_t *cont, mnbytestream_t *bs, bool projected)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    if (projected) {
+        print_mask_isset(cont, bs);
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "ssize_t\n"
+                                 "%s_unpack_projected(mnbytestream_t *bs, "
+                                 "void *fd, %s%s *msg, "
+                                 "const struct %s_mask *mask)\n{\n",
+                                 BDATA(cont->be.fqname),
+                                 kw,
+                                 BDATA(cont->be.fqname),
+                                 BDATA(cont->be.fqname));
+    } else {
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "ssize_t\n"
+                                 "%s(mnbytestream_t *bs, void *fd, "
+                                 "%s%s *msg)\n{\n",
+                                 BDATA(cont->be.decode),
+                                 kw,
+                                 BDATA(cont->be.fqname));
+        if (cont->ctx->flags.tables) {
+            (void)bytestream_nprintf(bs,
+                                     1024,
+                                     "    return mnpb_tbl_unpack(bs, fd, "
+                                        "&%s_desc, msg);\n"
+                                     "}\n",
+                                     BDATA(cont->be.fqname));
+            return;
+        }
+    }
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "    ssize_t res = 0;\n"
+                             "    ssize_t nread = 0;\n"
+                             "    ssize_t nread_item;\n"
+                             "    uint64_t sz;\n"
+                             "    MNPB_STATS_ENTER(&%s_stats_type);\n"
+                             "    while (res < msg->_mnpbcc_rawsz) {\n"
+                             "        uint64_t tag;\n"
+                             "        int wtype;\n"
+                             "        if ((nread = mnpb_unpack_key("
+                                          "bs, fd, &tag, &wtype)) < 0) { "
+                                          "res = nread; goto end; }\n"
+                             "        res += nread;\n",
+                             BDATA(cont->be.fqname));
+
+    if (projected) {
+        (void)bytestream_nprintf(bs,
+                                 1024,
+                                 "        if (!%s_mask_isset(mask, tag)) {\n"
+                                 "            if ((nread = mnpb_devoid(bs, "
+                                            "fd, tag, wtype)) < 0) { "
+                                            "res = nread; goto end; "
+                                            "} res += nread; continue;\n"
+                                 "        }\n",
+                                 BDATA(cont->be.fqname));
+    }
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "        switch (%s_slot(tag, wtype)) {\n"
+                             "        case -1:\n"
+                             "            res = MNPB_ETYPE; goto end;\n",
+                             BDATA(cont->be.fqname));
+
+    mnpbc_container_traverse_fields(
+        cont,
+        projected ?
+            (array_traverser_t)print_unpack_projected_field :
+            (array_traverser_t)print_unpack_field,
+        bs);
+
+    (void)bytestream_nprintf(bs, 1024,
+                             "        default:\n"
+                             "            if ((nread = mnpb_devoid(bs, fd, "
+                                            "tag, wtype)) < 0) { "
+                                            "res = nread; goto end; "
+                                            "} res += nread; break;\n"
+                             "        }\n"
+                             "    }\n"
+                             "end:\n"
+                             "    MNPB_STATS_LEAVE(res, 0);\n"
+                             "    return res;\n}\n");
+}
+
+
+static void
+print_unpack(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    print_unpack_slot(cont, bs);
+    print_unpack_ex(cont, bs, false);
+    print_unpack_ex(cont, bs, true);
+}
+
+
+/*
+ * Non-blocking entry point: wait for a whole length-delimited frame,
+ * then run the regular decoder over the buffered data.
+ */
+static void
+print_unpack_resume(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_unpack_resume(mnpb_decoder_t *dec, "
+                             "mnbytestream_t *bs, void *fd, size_t budget, "
+                             "%s%s *msg)\n{\n"
+                             "    ssize_t res;\n"
+                             "    if ((res = mnpb_decoder_next("
+                                        "dec, bs, fd, budget)) < 0) { "
+                                        "goto end; }\n"
+                             "    (void)%s(msg, res);\n"
+                             "    res = %s(bs, fd, msg);\n"
+                             "end:\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.rawsz),
+                             BDATA(cont->be.decode));
+}
+
+
+/*
+ * Decode with every allocation taken from the arena.
+ */
+static void
+print_unpack_arena(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_unpack_arena(mnbytestream_t *bs, void *fd, "
+                             "mnpb_arena_t *arena, %s%s *msg)\n{\n"
+                             "    ssize_t res;\n"
+                             "    mnpb_arena_t *prev;\n"
+                             "    prev = mnpb_arena_enter(arena);\n"
+                             "    res = %s(bs, fd, msg);\n"
+                             "    (void)mnpb_arena_enter(prev);\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.decode));
+}
+
+
+/*
+ * Decode, and finalize, under the given allocator, NULL for the heap.
+ */
+static void
+print_allocator(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_unpack_allocator(mnbytestream_t *bs, "
+                             "void *fd, const mnpb_allocator_t *allocator, "
+                             "%s%s *msg)\n{\n"
+                             "    ssize_t res;\n"
+                             "    const mnpb_allocator_t *prev;\n"
+                             "    prev = mnpb_allocator_enter(allocator);\n"
+                             "    res = %s(bs, fd, msg);\n"
+                             "    (void)mnpb_allocator_enter(prev);\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.decode));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int\n"
+                             "%s_fini_allocator("
+                             "const mnpb_allocator_t *allocator, "
+                             "%s%s *msg)\n{\n"
+                             "    int res;\n"
+                             "    const mnpb_allocator_t *prev;\n"
+                             "    prev = mnpb_allocator_enter(allocator);\n"
+                             "    res = %s_fini(msg);\n"
+                             "    (void)mnpb_allocator_enter(prev);\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname));
+}
+
+
+/*
+ * Read the next frame of the stream into msg, which is either zeroed or
+ * left over from the previous read.  Without an arena msg is cleared,
+ * and decoded into its own storage; with one, the arena is reset
+ * instead, and msg must never be passed to _fini.
+ */
+static void
+print_stream_read(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             2048,
+                             "ssize_t\n"
+                             "%s_stream_read(mnpb_stream_t *st, "
+                             "%s%s *msg)\n{\n"
+                             "    ssize_t res;\n"
+                             "    if ((res = mnpb_stream_next(st)) < 0) { "
+                                        "goto end; }\n"
+                             "    if (st->arena != NULL) {\n"
+                             "        mnpb_arena_reset(st->arena);\n"
+                             "        memset(msg, 0, sizeof(*msg));\n"
+                             "        (void)%s(msg, res);\n"
+                             "        res = %s_unpack_arena(&st->bs, st->fd, "
+                                        "st->arena, msg);\n"
+                             "    } else {\n"
+                             "        (void)%s_clear(msg);\n"
+                             "        (void)%s(msg, res);\n"
+                             "        res = %s(&st->bs, st->fd, msg);\n"
+                             "    }\n"
+                             "end:\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.rawsz),
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.rawsz),
+                             BDATA(cont->be.decode));
+}
+
+
+/*
+ * Append msg to the stream as a delimited frame, write out the buffer
+ * once it reaches flushsz.
+ */
+static void
+print_stream_write(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             2048,
+                             "ssize_t\n"
+                             "%s_stream_write(mnpb_stream_t *st, "
+                             "%s%s *msg)\n{\n"
+                             "    ssize_t res;\n"
+                             "    ssize_t nwritten;\n"
+                             "    if ((res = mnpb_envarint(&st->bs, "
+                                        "%s(msg))) < 0) { goto end; }\n"
+                             "    if ((nwritten = %s_cached(&st->bs, msg)) "
+                                        "< 0) { res = nwritten; goto end; }\n"
+                             "    res += nwritten;\n"
+                             "    st->writing = true;\n"
+                             "    if ((size_t)SEOD(&st->bs) >= st->flushsz && "
+                                        "mnpb_stream_flush(st) != 0) { "
+                                        "res = MNPB_EIO; }\n"
+                             "end:\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.sz),
+                             BDATA(cont->be.encode));
+}
+
+
+/*
+ * Decode record n of the file, straight out of the mapping.
+ */
+static void
+print_rec_read(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "ssize_t\n"
+                             "%s_rec_read(mnpb_recfile_t *rf, size_t n, "
+                             "%s%s *msg)\n{\n"
+                             "    ssize_t res;\n"
+                             "    if ((res = mnpb_recfile_seek(rf, n)) < 0) { "
+                                        "goto end; }\n"
+                             "    (void)%s(msg, res);\n"
+                             "    res = %s(&rf->bs, NULL, msg);\n"
+                             "end:\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.rawsz),
+                             BDATA(cont->be.decode));
 }
 
 
+/*
+ * Append msg to the record file under key.
+ */
 static void
-print_unpack(mnpbc_container_t *cont, mnbytestream_t *bs)
+print_rec_write(mnpbc_container_t *cont, mnbytestream_t *bs)
 {
     char *kw;
 
@@ -1458,39 +3529,83 @@ print_unpack(mnpbc_container_t *cont, mnbytestream_t *bs)
     (void)bytestream_nprintf(bs,
                              1024,
                              "ssize_t\n"
-                             "%s(mnbytestream_t *bs, void *fd, "
+                             "%s_rec_write(mnpb_recwriter_t *w, int64_t key, "
                              "%s%s *msg)\n{\n"
-                             "    ssize_t res = 0;\n"
-                             "    ssize_t nread = 0;\n"
-                             "    ssize_t nread_item;\n"
-                             "    uint64_t sz;\n"
-                             "    while (res < msg->_mnpbcc_rawsz) {\n"
-                             "        uint64_t tag;\n"
-                             "        int wtype;\n"
-                             "        if ((nread = mnpb_unpack_key("
-                                          "bs, fd, &tag, &wtype)) < 0) { "
-                                          "res = nread; goto end; }\n"
-                             "        res += nread;\n"
-                             "        switch (tag) {\n"
-                             ,
-                             BDATA(cont->be.decode),
+                             "    ssize_t res;\n"
+                             "    int ares;\n"
+                             "    if ((res = %s_stream_write(&w->st, msg)) "
+                                        "< 0) { goto end; }\n"
+                             "    ares = mnpb_recwriter_add(w, key);\n"
+                             "    w->off += (uint64_t)res;\n"
+                             "    if (ares != 0) { res = ares; }\n"
+                             "end:\n"
+                             "    return res;\n}\n",
+                             BDATA(cont->be.fqname),
                              kw,
+                             BDATA(cont->be.fqname),
                              BDATA(cont->be.fqname));
+}
 
-    mnpbc_container_traverse_fields(cont,
-                                     (array_traverser_t)print_unpack_field,
-                                     bs);
 
-    (void)bytestream_nprintf(bs, 1024,
-                             "        default:\n"
-                             "            if ((nread = mnpb_devoid(bs, fd, "
-                                            "tag, wtype)) < 0) { "
-                                            "res = nread; goto end; "
-                                            "} res += nread; break;\n"
-                             "        }\n"
-                             "    }\n"
-                             "end:\n"
-                             "    return res;\n}\n");
+/*
+ * Decode every record of the file on nthreads threads, and pass each to
+ * the callback, msg is released when the callback returns.
+ */
+static void
+print_parallel_scan(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    char *kw;
+
+    assert(cont->kind == MNPBC_CONT_KMESSAGE);
+
+    kw = mnpbc_container_keyword(cont);
+
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "struct _%s_scan {\n"
+                             "    int (*cb)(%s%s *, size_t, void *);\n"
+                             "    void *udata;\n"
+                             "};\n"
+                             "static int\n"
+                             "%s_scan_rec(mnbytestream_t *bs, ssize_t sz, "
+                             "size_t n, void *udata)\n{\n"
+                             "    struct _%s_scan *scan = udata;\n"
+                             "    %s%s msg;\n"
+                             "    ssize_t res;\n"
+                             "    memset(&msg, 0, sizeof(msg));\n"
+                             "    (void)%s(&msg, sz);\n"
+                             "    if ((res = %s(bs, NULL, &msg)) >= 0) { "
+                                        "res = scan->cb(&msg, n, "
+                                        "scan->udata); }\n"
+                             "    (void)%s_fini(&msg);\n"
+                             "    return (int)res;\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.rawsz),
+                             BDATA(cont->be.decode),
+                             BDATA(cont->be.fqname));
+    (void)bytestream_nprintf(bs,
+                             1024,
+                             "int\n"
+                             "%s_parallel_scan(mnpb_recfile_t *rf, "
+                             "int nthreads, "
+                             "int (*cb)(%s%s *, size_t, void *), "
+                             "void *udata)\n{\n"
+                             "    struct _%s_scan scan;\n"
+                             "    scan.cb = cb;\n"
+                             "    scan.udata = udata;\n"
+                             "    return mnpb_parallel_scan(rf, nthreads, "
+                                        "%s_scan_rec, &scan);\n}\n",
+                             BDATA(cont->be.fqname),
+                             kw,
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname),
+                             BDATA(cont->be.fqname));
 }
 
 
@@ -1546,9 +3661,24 @@ print_sz_field(mnpbc_field_t **field, mnbytestream_t *bs)
 
             if (ucty->kind == MNPBC_CONT_KMESSAGE) {
                 (void)bytestream_nprintf(bs, 1024,
-                    "        res += mnpb_szvarint(0x%08"PRId64") + "
-                                "%s(&msg->%s.data.%s); break;\n",
-                    MNPB_MAKEKEY(MNPB_WT_LDELIM, (*ufield)->fnum),
+                    "        n = %s(&msg->%s.data.%s); "
+                                "res += %d + "
+                                "mnpb_szvarint(n) + n; break;\n",
+                    BDATA(ucty->be.sz),
+                    BDATA((*field)->be.name),
+                    BDATA((*ufield)->be.name),
+                    mnpbc_tag_sz(MNPB_MAKEKEY(MNPB_WT_LDELIM,
+                                              (*ufield)->fnum)));
+
+            } else if (mnpbc_container_is_view(ucty)) {
+                (void)bytestream_nprintf(bs, 1024,
+                    "        if (msg->%s.data.%s.data != NULL) { "
+                                "res += %d + "
+                                "%s(msg->%s.data.%s); } break;\n",
+                    BDATA((*field)->be.name),
+                    BDATA((*ufield)->be.name),
+                    mnpbc_tag_sz(MNPB_MAKEKEY((*ufield)->wtype,
+                                              (*ufield)->fnum)),
                     BDATA(ucty->be.sz),
                     BDATA((*field)->be.name),
                     BDATA((*ufield)->be.name));
@@ -1556,13 +3686,14 @@ print_sz_field(mnpbc_field_t **field, mnbytestream_t *bs)
             } else {
                 (void)bytestream_nprintf(bs, 1024,
                     "        if (msg->%s.data.%s != (%s)%s) { "
-                                "res += mnpb_szvarint(0x%08"PRId64") + "
+                                "res += %d + "
                                 "%s(msg->%s.data.%s); } break;\n",
                     BDATA((*field)->be.name),
                     BDATA((*ufield)->be.name),
                     BDATA(ucty->be.fqname),
                     MNPB_WT_NUMERIC((*ufield)->wtype) ? "0" : "NULL",
-                    MNPB_MAKEKEY((*ufield)->wtype, (*ufield)->fnum),
+                    mnpbc_tag_sz(MNPB_MAKEKEY((*ufield)->wtype,
+                                              (*ufield)->fnum)),
                     BDATA(ucty->be.sz),
                     BDATA((*field)->be.name),
                     BDATA((*ufield)->be.name));
@@ -1575,52 +3706,86 @@ print_sz_field(mnpbc_field_t **field, mnbytestream_t *bs)
             "    }\n");
 
     } else if ((*field)->flags.repeated) {
-        (void)bytestream_nprintf(bs, 1024,
-            "    n = 0;\n");
+        int width;
 
-        (void)bytestream_nprintf(bs, 1024,
-            "    for (size_t i = 0; i < msg->%s.sz; ++i) { "
-            "n += %s(%smsg->%s.data[i]); "
-            "}\n",
-            BDATA((*field)->be.name),
-            BDATA(cty->be.sz),
-            cty->kind == MNPBC_CONT_KMESSAGE ? "&" : "",
-            BDATA((*field)->be.name));
+        if ((width = mnpbc_field_fixed_width(*field)) > 0) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    n = msg->%s.sz * %d;\n",
+                BDATA((*field)->be.name),
+                width);
+        } else {
+            (void)bytestream_nprintf(bs, 1024,
+                "    n = 0;\n");
+
+            if (cty->kind == MNPBC_CONT_KMESSAGE) {
+                /*
+                 * each element carries its own length
+                 */
+                (void)bytestream_nprintf(bs, 1024,
+                    "    for (size_t i = 0; i < msg->%s.sz; ++i) { "
+                    "ssize_t esz = %s(&msg->%s.data[i]); "
+                    "n += mnpb_szvarint(esz) + esz; "
+                    "}\n",
+                    BDATA((*field)->be.name),
+                    BDATA(cty->be.sz),
+                    BDATA((*field)->be.name));
+            } else {
+                (void)bytestream_nprintf(bs, 1024,
+                    "    for (size_t i = 0; i < msg->%s.sz; ++i) { "
+                    "n += %s(msg->%s.data[i]); "
+                    "}\n",
+                    BDATA((*field)->be.name),
+                    BDATA(cty->be.sz),
+                    BDATA((*field)->be.name));
+            }
+        }
 
         (void)bytestream_nprintf(bs, 1024,
             "    if (n > 0) { "
-            "res += mnpb_szvarint(0x%08"PRIx64") + mnpb_szvarint(n) + n; }\n",
-            MNPB_MAKEKEY(MNPB_WT_LDELIM, (*field)->fnum));
+            "res += %d + mnpb_szvarint(n) + n; }\n",
+            mnpbc_tag_sz(MNPB_MAKEKEY(MNPB_WT_LDELIM, (*field)->fnum)));
 
     } else {
         if ((cty)->kind == MNPBC_CONT_KMESSAGE) {
             assert((*field)->wtype == MNPB_WT_LDELIM);
+            if (mnpbc_field_is_lazy(*field)) {
+                (void)bytestream_nprintf(bs, 1024,
+                    "    if (msg->_mnpbcc_lazy_%s != NULL) { "
+                    "res += %d + "
+                    "mnpb_szbytes(msg->_mnpbcc_lazy_%s); "
+                    "} else\n",
+                    BDATA((*field)->be.name),
+                    mnpbc_tag_sz(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)),
+                    BDATA((*field)->be.name));
+            }
             (void)bytestream_nprintf(bs, 1024,
                 "    if ((n = %s(&msg->%s)) > 0) { "
-                "res += mnpb_szvarint(0x%08"PRIx64") + n; "
+                "res += %d + "
+                "mnpb_szvarint(n) + n; "
                 "}\n",
                 BDATA(cty->be.sz),
                 BDATA((*field)->be.name),
-                MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)
+                mnpbc_tag_sz(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum))
                 );
 
         } else if ((*field)->wtype == MNPB_WT_LDELIM) {
             (void)bytestream_nprintf(bs, 1024,
-                "    if (msg->%s != NULL) { "
-                "res += mnpb_szvarint(0x%08"PRIx64") + %s(msg->%s); "
+                "    if (msg->%s%s != NULL) { "
+                "res += %d + %s(msg->%s); "
                 "}\n",
                 BDATA((*field)->be.name),
-                MNPB_MAKEKEY((*field)->wtype, (*field)->fnum),
+                mnpbc_container_is_view(cty) ? ".data" : "",
+                mnpbc_tag_sz(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)),
                 BDATA(cty->be.sz),
                 BDATA((*field)->be.name));
 
         } else if (MNPB_WT_NUMERIC((*field)->wtype)) {
             (void)bytestream_nprintf(bs, 1024,
                 "    if (msg->%s != 0) { "
-                "res += mnpb_szvarint(0x%08"PRIx64") + %s(msg->%s); "
+                "res += %d + %s(msg->%s); "
                 "}\n",
                 BDATA((*field)->be.name),
-                MNPB_MAKEKEY((*field)->wtype, (*field)->fnum),
+                mnpbc_tag_sz(MNPB_MAKEKEY((*field)->wtype, (*field)->fnum)),
                 BDATA(cty->be.sz),
                 BDATA((*field)->be.name));
 
@@ -1645,18 +3810,30 @@ print_sz(mnpbc_container_t *cont, mnbytestream_t *bs)
     (void)bytestream_nprintf(bs,
                              1024,
                              "size_t\n"
-                             "%s(%s%s *msg)\n{\n"
-                             "    ssize_t res = 0;\n"
-                             "    ssize_t n;\n",
+                             "%s(%s%s *msg)\n{\n",
                              BDATA(cont->be.sz),
                              kw,
                              BDATA(cont->be.fqname));
 
+    if (cont->ctx->flags.tables) {
+        (void)bytestream_nprintf(bs, 1024,
+                                 "    return mnpb_tbl_sz(&%s_desc, msg);\n"
+                                 "}\n",
+                                 BDATA(cont->be.fqname));
+        return;
+    }
+
+    (void)bytestream_nprintf(bs, 1024,
+                             "    ssize_t res = 0;\n"
+                             "    ssize_t n;\n");
+
     mnpbc_container_traverse_fields(cont,
                                      (array_traverser_t)print_sz_field,
                                      bs);
 
-    (void)bytestream_nprintf(bs, 1024, "    return res;\n}\n");
+    (void)bytestream_nprintf(bs, 1024,
+                             "    msg->_mnpbcc_cachedsz = res;\n"
+                             "    return res;\n}\n");
 }
 
 
@@ -1784,6 +3961,14 @@ print_dump_field(mnpbc_field_t **field, mnbytestream_t *bs)
         (void)bytestream_nprintf(bs, 1024,
             "    res += bytestream_cat(bs, 2, \"] \");\n");
     } else {
+        if (mnpbc_field_is_lazy(*field)) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    if (msg->_mnpbcc_lazy_%s != NULL) { "
+                "res += mnpb_dumpbytes(bs, msg->_mnpbcc_lazy_%s); "
+                "} else\n",
+                BDATA((*field)->be.name),
+                BDATA((*field)->be.name));
+        }
         (void)bytestream_nprintf(bs, 1024,
             "    res += %s(bs, %smsg->%s);\n",
             BDATA(cty->be.dump),
@@ -1810,11 +3995,20 @@ print_dump(mnpbc_container_t *cont, mnbytestream_t *bs)
     (void)bytestream_nprintf(bs,
                              1024,
                              "ssize_t\n"
-                             "%s(mnbytestream_t *bs, %s%s *msg)\n{\n"
-                             "    ssize_t res = 0;\n",
+                             "%s(mnbytestream_t *bs, %s%s *msg)\n{\n",
                              BDATA(cont->be.dump),
                              kw,
                              BDATA(cont->be.fqname));
+
+    if (cont->ctx->flags.tables) {
+        (void)bytestream_nprintf(bs, 1024,
+                                 "    return mnpb_tbl_dump(bs, &%s_desc, msg);\n"
+                                 "}\n",
+                                 BDATA(cont->be.fqname));
+        return;
+    }
+
+    (void)bytestream_nprintf(bs, 1024, "    ssize_t res = 0;\n");
     (void)bytestream_nprintf(bs, 1024,
         "    res += bytestream_cat(bs, 2, \"{ \");\n");
 
@@ -1830,6 +4024,330 @@ print_dump(mnpbc_container_t *cont, mnbytestream_t *bs)
 }
 
 
+/*
+ * Descriptor tables, mnpbc -T
+ */
+static const char *
+mnpbc_field_tkind(mnpbc_field_t *field)
+{
+    mnpbc_container_t *cty;
+    unsigned i;
+    struct {
+        mnbytes_t *pbname;
+        const char *kind;
+    } builtins[] = {
+        {&_double, "MNPB_TK_DOUBLE"},
+        {&_float, "MNPB_TK_FLOAT"},
+        {&_int32, "MNPB_TK_INT32"},
+        {&_int64, "MNPB_TK_INT64"},
+        {&_uint32, "MNPB_TK_UINT32"},
+        {&_uint64, "MNPB_TK_UINT64"},
+        {&_sint32, "MNPB_TK_SINT32"},
+        {&_sint64, "MNPB_TK_SINT64"},
+        {&_fixed32, "MNPB_TK_FIXED32"},
+        {&_fixed64, "MNPB_TK_FIXED64"},
+        {&_sfixed32, "MNPB_TK_SFIXED32"},
+        {&_sfixed64, "MNPB_TK_SFIXED64"},
+        {&_bool, "MNPB_TK_BOOL"},
+    };
+
+    cty = field->cty;
+    if (cty->kind == MNPBC_CONT_KMESSAGE) {
+        return "MNPB_TK_MESSAGE";
+    } else if (cty->kind == MNPBC_CONT_KENUM) {
+        return "MNPB_TK_ENUM";
+    } else if (cty->kind == MNPBC_CONT_KONEOF) {
+        return "MNPB_TK_ONEOF";
+    } else if (bytes_cmp(cty->pb.name, &_string) == 0) {
+        return mnpbc_container_is_view(cty) ?
+            "MNPB_TK_STRVIEW" : "MNPB_TK_STRING";
+    } else if (bytes_cmp(cty->pb.name, &_bytes) == 0) {
+        return mnpbc_container_is_view(cty) ?
+            "MNPB_TK_BYTESVIEW" : "MNPB_TK_BYTES";
+    }
+    for (i = 0; i < countof(builtins); ++i) {
+        if (bytes_cmp(cty->pb.name, builtins[i].pbname) == 0) {
+            return builtins[i].kind;
+        }
+    }
+    FAIL("mnpbc_field_tkind");
+    return NULL;
+}
+
+
+/*
+ * one field or oneof member, name is the member designator in the
+ * message struct
+ */
+static void
+print_desc_field(mnpbc_container_t *cont,
+                 mnpbc_field_t *field,
+                 const char *name,
+                 const char *oneof,
+                 mnbytestream_t *bs)
+{
+    uint64_t key;
+    int wtype;
+
+    /* repeated fields are packed */
+    wtype = field->flags.repeated ? MNPB_WT_LDELIM : field->wtype;
+    key = MNPB_MAKEKEY(wtype, field->fnum);
+    (void)bytestream_nprintf(bs, 1024,
+        "    { \"%s\", %"PRId64", 0x%"PRIx64"ull, %d, %d, %s, %d, "
+            "offsetof(struct %s, %s), "
+            "sizeof(((struct %s *)0)->%s%s), ",
+        BDATA(field->pb.name),
+        field->fnum,
+        MNPBC_TAG(key),
+        field->wtype,
+        mnpbc_field_tkind(field),
+        field->flags.repeated ? 1 : 0,
+        BDATA(cont->be.fqname),
+        name,
+        BDATA(cont->be.fqname),
+        name,
+        field->flags.repeated ? ".data[0]" : "");
+    if (field->cty->kind == MNPBC_CONT_KMESSAGE) {
+        (void)bytestream_nprintf(bs, 1024,
+            "&%s_desc, ", BDATA(field->cty->be.fqname));
+    } else {
+        (void)bytestream_nprintf(bs, 1024, "NULL, ");
+    }
+    (void)bytestream_nprintf(bs, 1024, "%s, 0 },\n", oneof);
+}
+
+
+typedef struct _mnpbc_desc_ent {
+    int64_t fnum;
+    mnbytes_t *ref;
+} mnpbc_desc_ent_t;
+
+
+static int
+mnpbc_desc_ent_cmp(const void *a, const void *b)
+{
+    const mnpbc_desc_ent_t *ea, *eb;
+
+    ea = a;
+    eb = b;
+    return ea->fnum < eb->fnum ? -1 : ea->fnum > eb->fnum ? 1 : 0;
+}
+
+
+static void
+print_desc(mnpbc_container_t *cont, mnbytestream_t *bs)
+{
+    mnpbc_field_t **field;
+    mnarray_iter_t it;
+    mnpbc_desc_ent_t *ents;
+    size_t nfields, nents, i;
+    bool has_oneof;
+
+    /*
+     * fields of external types have no descriptor, and are left alone
+     */
+    nfields = 0;
+    nents = 0;
+    has_oneof = false;
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        if ((*field)->cty == NULL) {
+            continue;
+        }
+        ++nfields;
+        if ((*field)->cty->kind == MNPBC_CONT_KONEOF) {
+            mnpbc_field_t **ufield;
+            mnarray_iter_t uit;
+
+            has_oneof = true;
+            for (ufield = array_first(&(*field)->cty->fields, &uit);
+                 ufield != NULL;
+                 ufield = array_next(&(*field)->cty->fields, &uit)) {
+                ++nents;
+            }
+        } else {
+            ++nents;
+        }
+    }
+
+    if ((ents = malloc(sizeof(*ents) * (nents + 1))) == NULL) {
+        FAIL("malloc");
+    }
+
+    if (has_oneof) {
+        (void)bytestream_nprintf(bs, 1024,
+            "static const mnpb_field_desc_t %s_fields[%zu];\n",
+            BDATA(cont->be.fqname),
+            nfields);
+    }
+
+    /*
+     * members of each oneof, pointing back to it
+     */
+    nents = 0;
+    i = 0;
+    for (field = array_first(&cont->fields, &it);
+         field != NULL;
+         field = array_next(&cont->fields, &it)) {
+        mnpbc_container_t *cty;
+        mnpbc_field_t **ufield;
+        mnarray_iter_t uit;
+        mnbytes_t *oneof;
+        size_t j;
+
+        if ((cty = (*field)->cty) == NULL) {
+            continue;
+        }
+        if (cty->kind != MNPBC_CONT_KONEOF) {
+            ents[nents].fnum = (*field)->fnum;
+            ents[nents].ref = bytes_printf("&%s_fields[%zu]",
+                                           BDATA(cont->be.fqname),
+                                           i);
+            ++nents;
+            ++i;
+            continue;
+        }
+
+        (void)bytestream_nprintf(bs, 1024,
+            "static const mnpb_field_desc_t %s_members[] = {\n",
+            BDATA(cty->be.fqname));
+        oneof = bytes_printf("&%s_fields[%zu]", BDATA(cont->be.fqname), i);
+        for (ufield = array_first(&cty->fields, &uit), j = 0;
+             ufield != NULL;
+             ufield = array_next(&cty->fields, &uit)) {
+            mnbytes_t *name;
+
+            if ((*ufield)->cty == NULL) {
+                continue;
+            }
+            name = bytes_printf("%s.data.%s",
+                                BDATA((*field)->be.name),
+                                BDATA((*ufield)->be.name));
+            print_desc_field(cont, *ufield, BCDATA(name), BCDATA(oneof), bs);
+            BYTES_DECREF(&name);
+            ents[nents].fnum = (*ufield)->fnum;
+            ents[nents].ref = bytes_printf("&%s_members[%zu]",
+                                           BDATA(cty->be.fqname),
+                                           j);
+            ++nents;
+            ++j;
+        }
+        (void)bytestream_nprintf(bs, 1024, "};\n");
+        BYTES_DECREF(&oneof);
+        ++i;
+    }
+
+    if (nfields > 0) {
+        (void)bytestream_nprintf(bs, 1024,
+            "static const mnpb_field_desc_t %s_fields[%zu] = {\n",
+            BDATA(cont->be.fqname),
+            nfields);
+        for (field = array_first(&cont->fields, &it);
+             field != NULL;
+             field = array_next(&cont->fields, &it)) {
+            mnpbc_container_t *cty;
+
+            if ((cty = (*field)->cty) == NULL) {
+                continue;
+            }
+            if (cty->kind != MNPBC_CONT_KONEOF) {
+                print_desc_field(cont,
+                                 *field,
+                                 BCDATA((*field)->be.name),
+                                 "NULL",
+                                 bs);
+                continue;
+            }
+
+            (void)bytestream_nprintf(bs, 1024,
+                "    { \"%s\", %"PRId64", 0, 0, %d, MNPB_TK_ONEOF, 0, "
+                    "offsetof(struct %s, %s.fnum), "
+                    "sizeof(((struct %s *)0)->%s.data), "
+                    "NULL, %s_members, "
+                    "countof(%s_members) },\n",
+                BDATA((*field)->pb.name),
+                (*field)->fnum,
+                (*field)->wtype,
+                BDATA(cont->be.fqname),
+                BDATA((*field)->be.name),
+                BDATA(cont->be.fqname),
+                BDATA((*field)->be.name),
+                BDATA(cty->be.fqname),
+                BDATA(cty->be.fqname));
+        }
+        (void)bytestream_nprintf(bs, 1024, "};\n");
+    }
+
+    /*
+     * for the decoder to find fields by number
+     */
+    if (nents > 0) {
+        qsort(ents, nents, sizeof(*ents), mnpbc_desc_ent_cmp);
+        (void)bytestream_nprintf(bs, 1024,
+            "static const mnpb_field_desc_t *const %s_byfnum[] = {\n",
+            BDATA(cont->be.fqname));
+        for (i = 0; i < nents; ++i) {
+            (void)bytestream_nprintf(bs, 1024,
+                "    %s,\n", BDATA(ents[i].ref));
+            BYTES_DECREF(&ents[i].ref);
+        }
+        (void)bytestream_nprintf(bs, 1024, "};\n");
+    }
+    free(ents);
+
+    (void)bytestream_nprintf(bs, 1024,
+        "static const mnpb_msg_desc_t %s_desc = {\n"
+        "    \"%s\",\n"
+        "    sizeof(struct %s),\n",
+        BDATA(cont->be.fqname),
+        BDATA(cont->be.fqname),
+        BDATA(cont->be.fqname));
+    if (nfields > 0) {
+        (void)bytestream_nprintf(bs, 1024,
+            "    %s_fields, countof(%s_fields),\n",
+            BDATA(cont->be.fqname),
+            BDATA(cont->be.fqname));
+    } else {
+        (void)bytestream_nprintf(bs, 1024, "    NULL, 0,\n");
+    }
+    if (nents > 0) {
+        (void)bytestream_nprintf(bs, 1024,
+            "    %s_byfnum, countof(%s_byfnum),\n",
+            BDATA(cont->be.fqname),
+            BDATA(cont->be.fqname));
+    } else {
+        (void)bytestream_nprintf(bs, 1024, "    NULL, 0,\n");
+    }
+    (void)bytestream_nprintf(bs, 1024,
+        "#ifdef MNPB_STATS\n"
+        "    &%s_stats_type,\n"
+        "#else\n"
+        "    NULL,\n"
+        "#endif\n"
+        "};\n",
+        BDATA(cont->be.fqname));
+}
+
+
+/*
+ * messages refer to each other's descriptors in any order
+ */
+static int
+print_desc_decl(UNUSED mnbytes_t *key,
+                mnpbc_container_t *cont,
+                mnbytestream_t *bs)
+{
+    if (cont->kind != MNPBC_CONT_KMESSAGE) {
+        return 0;
+    }
+    (void)bytestream_nprintf(bs, 1024,
+        "static const mnpb_msg_desc_t %s_desc;\n",
+        BDATA(cont->be.fqname));
+    return 0;
+}
+
+
 static int
 print_method_def(UNUSED mnbytes_t *key,
                  mnpbc_container_t *cont,
@@ -1839,13 +4357,29 @@ print_method_def(UNUSED mnbytes_t *key,
         return 0;
     }
 
+    print_stats_type(cont, bs);
+    if (cont->ctx->flags.tables) {
+        print_desc(cont, bs);
+    }
     print_new(cont, bs);
     print_alloc(cont, bs);
+    print_get(cont, bs);
     // print_init(cont, bs);
     print_fini(cont, bs);
+    print_clear(cont, bs);
     print_destroy(cont, bs);
     print_pack(cont, bs);
+    print_pack_iov(cont, bs);
+    print_pack_reverse(cont, bs);
     print_unpack(cont, bs);
+    print_unpack_resume(cont, bs);
+    print_unpack_arena(cont, bs);
+    print_allocator(cont, bs);
+    print_stream_read(cont, bs);
+    print_stream_write(cont, bs);
+    print_rec_read(cont, bs);
+    print_rec_write(cont, bs);
+    print_parallel_scan(cont, bs);
     print_sz(cont, bs);
     print_rawsz(cont, bs);
     print_dump(cont, bs);
@@ -1893,8 +4427,12 @@ set_be_methods(mnpbc_container_t *cont)
     if (cont->kind == MNPBC_CONT_KENUM) {
         mnpbc_container_set_be_encode(cont,
                                        bytes_printf("mnpb_envarint"));
+        mnpbc_container_set_be_rencode(cont,
+                                        bytes_printf("mnpb_renvarint"));
         mnpbc_container_set_be_decode(cont,
                                        bytes_printf("mnpb_unpack_int64"));
+        mnpbc_container_set_be_decode_packed(
+            cont, bytes_printf("mnpb_unpack_packed_enum"));
         mnpbc_container_set_be_sz(cont,
                                    bytes_printf("mnpb_szvarint"));
         mnpbc_container_set_be_dump(cont,
@@ -1904,6 +4442,8 @@ set_be_methods(mnpbc_container_t *cont)
                cont->kind == MNPBC_CONT_KONEOF) {
         mnpbc_container_set_be_encode(
             cont, bytes_printf("%s_pack", BDATA(cont->be.fqname)));
+        mnpbc_container_set_be_rencode(
+            cont, bytes_printf("%s_pack_rbuf", BDATA(cont->be.fqname)));
         mnpbc_container_set_be_decode(
             cont, bytes_printf("%s_unpack", BDATA(cont->be.fqname)));
         mnpbc_container_set_be_sz(
@@ -2005,6 +4545,11 @@ mnpbc_ctx_render_c(mnpbc_ctx_t *ctx)
     bytestream_rewind(&bs);
 
     print_impl_pre(ctx, &bs);
+    if (ctx->flags.tables) {
+        (void)mnpbc_ctx_traverse(ctx,
+                                 (hash_traverser_t)print_desc_decl,
+                                 &bs);
+    }
     (void)mnpbc_ctx_traverse(ctx, (hash_traverser_t)print_method_def, &bs);
 
     bytestream_produce_data(&bs, (void *)(intptr_t)fileno(ctx->out1));
@@ -2026,112 +4571,144 @@ mnpbc_ctx_init_c(mnpbc_ctx_t *ctx,
         const char *pbname;
         const char *fqname;
         const char *encode;
+        const char *rencode;
         const char *decode;
+        const char *decode_packed;
         const char *sz;
         const char *dump;
         int (*print_sz_field)(mnpbc_field_t *, mnbytestream_t *);
     } builtins[] = {
         {"float", "float",
          "mnpb_enfloat",
+         "mnpb_renfloat",
          "mnpb_unpack_float",
+         "mnpb_unpack_packed_float",
          "mnpb_szfloat",
          "mnpb_dumpfloat",
          NULL,
         },
         {"double", "double",
          "mnpb_endouble",
+         "mnpb_rendouble",
          "mnpb_unpack_double",
+         "mnpb_unpack_packed_double",
          "mnpb_szdouble",
          "mnpb_dumpdouble",
          NULL,
         },
         {"int32", "int32_t",
          "mnpb_pack_int32",
+         "mnpb_rpack_int32",
          "mnpb_unpack_int32",
+         "mnpb_unpack_packed_int32",
          "mnpb_sz_int32",
          "mnpb_dumpvarint",
          NULL,
         },
         {"int64", "int64_t",
          "mnpb_envarint",
+         "mnpb_renvarint",
          "mnpb_unpack_int64",
+         "mnpb_unpack_packed_int64",
          "mnpb_szvarint",
          "mnpb_dumpvarint",
          NULL,
         },
         {"uint32", "uint32_t",
          "mnpb_envarint",
+         "mnpb_renvarint",
          "mnpb_unpack_uint32",
+         "mnpb_unpack_packed_uint32",
          "mnpb_szvarint",
          "mnpb_dumpvarint",
          NULL,
         },
         {"uint64", "uint64_t",
          "mnpb_envarint",
+         "mnpb_renvarint",
          "mnpb_unpack_uint64",
+         "mnpb_unpack_packed_uint64",
          "mnpb_szvarint",
          "mnpb_dumpvarint",
          NULL,
         },
         {"sint32", "int32_t",
          "mnpb_enzz32",
+         "mnpb_renzz32",
          "mnpb_unpack_sint32",
+         "mnpb_unpack_packed_sint32",
          "mnpb_szzz32",
          "mnpb_dumpzz32",
          NULL,
         },
         {"sint64", "int64_t",
          "mnpb_enzz64",
+         "mnpb_renzz64",
          "mnpb_unpack_sint64",
+         "mnpb_unpack_packed_sint64",
          "mnpb_szzz64",
          "mnpb_dumpzz64",
          NULL,
         },
         {"fixed32", "uint32_t",
          "mnpb_enfi32",
+         "mnpb_renfi32",
          "mnpb_unpack_fixed32",
+         "mnpb_unpack_packed_fixed32",
          "mnpb_szfi32",
          "mnpb_dumpfi32",
          NULL,
         },
         {"fixed64", "uint64_t",
          "mnpb_enfi64",
+         "mnpb_renfi64",
          "mnpb_unpack_fixed64",
+         "mnpb_unpack_packed_fixed64",
          "mnpb_szfi64",
          "mnpb_dumpfi64",
          NULL,
         },
         {"sfixed32", "int32_t",
          "mnpb_enfi32",
+         "mnpb_renfi32",
          "mnpb_unpack_sfixed32",
+         "mnpb_unpack_packed_sfixed32",
          "mnpb_szfi32",
          "mnpb_dumpfi32",
          NULL,
         },
         {"sfixed64", "int64_t",
          "mnpb_enfi64",
+         "mnpb_renfi64",
          "mnpb_unpack_sfixed64",
+         "mnpb_unpack_packed_sfixed64",
          "mnpb_szfi64",
          "mnpb_dumpfi64",
          NULL,
         },
         {"bool", "bool",
          "mnpb_envarint",
+         "mnpb_renvarint",
          "mnpb_unpack_bool",
+         "mnpb_unpack_packed_bool",
          "mnpb_szvarint",
          "mnpb_dumpvarint",
          NULL,
         },
         {"string", "mnbytes_t *",
          "mnpb_enstr",
+         "mnpb_renstr",
          "mnpb_unpack_string",
+         NULL,
          "mnpb_szstr",
          "mnpb_dumpstr",
          NULL,
         },
         {"bytes", "mnbytes_t *",
          "mnpb_enbytes",
+         "mnpb_renbytes",
          "mnpb_unpack_bytes",
+         NULL,
          "mnpb_szbytes",
          "mnpb_dumpbytes",
          NULL,
@@ -2148,14 +4725,49 @@ mnpbc_ctx_init_c(mnpbc_ctx_t *ctx,
                                        bytes_new_from_str(builtins[i].fqname));
         mnpbc_container_set_be_encode(cont,
                                        bytes_new_from_str(builtins[i].encode));
+        mnpbc_container_set_be_rencode(
+            cont, bytes_new_from_str(builtins[i].rencode));
         mnpbc_container_set_be_decode(cont,
                                        bytes_new_from_str(builtins[i].decode));
+        if (builtins[i].decode_packed != NULL) {
+            mnpbc_container_set_be_decode_packed(
+                cont, bytes_new_from_str(builtins[i].decode_packed));
+        }
         mnpbc_container_set_be_sz(cont,
                                    bytes_new_from_str(builtins[i].sz));
         mnpbc_container_set_be_dump(cont,
                                      bytes_new_from_str(builtins[i].dump));
     }
 
+    if (ctx->flags.views) {
+        struct {
+            mnbytes_t *pbname;
+            const char *dump;
+        } views[] = {
+            {&_string, "mnpb_dumpstrview"},
+            {&_bytes, "mnpb_dumpbytesview"},
+        };
+
+        for (i = 0; i < countof(views); ++i) {
+            mnpbc_container_t *cont;
+
+            cont = mnpbc_ctx_get_container(ctx, views[i].pbname);
+            assert(cont != NULL);
+            mnpbc_container_set_pb_fqname(cont,
+                                           bytes_new_from_str("mnpb_view_t"));
+            mnpbc_container_set_be_encode(cont,
+                                           bytes_new_from_str("mnpb_enview"));
+            mnpbc_container_set_be_rencode(
+                cont, bytes_new_from_str("mnpb_renview"));
+            mnpbc_container_set_be_decode(
+                cont, bytes_new_from_str("mnpb_unpack_view"));
+            mnpbc_container_set_be_sz(cont,
+                                       bytes_new_from_str("mnpb_szview"));
+            mnpbc_container_set_be_dump(cont,
+                                         bytes_new_from_str(views[i].dump));
+        }
+    }
+
     ctx->namein = namein;
     BYTES_INCREF(ctx->namein);
     if (nameout0 != NULL) {
@@ -168,8 +168,12 @@ mnpbc_container_new(void)
     res->be.name = NULL;
     res->be.fqname = NULL;
     res->be.encode = NULL;
+    res->be.rencode = NULL;
     res->be.decode = NULL;
+    res->be.decode_packed = NULL;
     res->be.sz = NULL;
+    res->be.rawsz = NULL;
+    res->be.dump = NULL;
     if (MNUNLIKELY(array_init(&res->fields,
                                sizeof(mnpbc_field_t *),
                                0,
@@ -201,8 +205,12 @@ mnpbc_container_destroy(mnpbc_container_t **cont)
         BYTES_DECREF(&(*cont)->be.name);
         BYTES_DECREF(&(*cont)->be.fqname);
         BYTES_DECREF(&(*cont)->be.encode);
+        BYTES_DECREF(&(*cont)->be.rencode);
         BYTES_DECREF(&(*cont)->be.decode);
+        BYTES_DECREF(&(*cont)->be.decode_packed);
         BYTES_DECREF(&(*cont)->be.sz);
+        BYTES_DECREF(&(*cont)->be.rawsz);
+        BYTES_DECREF(&(*cont)->be.dump);
         (void)array_fini(&(*cont)->fields);
         (void)array_fini(&(*cont)->containers);
         free(*cont);
@@ -248,6 +256,15 @@ mnpbc_container_set_be_encode(mnpbc_container_t *cont, mnbytes_t *encode)
 }
 
 
+void
+mnpbc_container_set_be_rencode(mnpbc_container_t *cont, mnbytes_t *rencode)
+{
+    BYTES_DECREF(&cont->be.rencode);
+    cont->be.rencode = rencode;
+    BYTES_INCREF(cont->be.rencode);
+}
+
+
 void
 mnpbc_container_set_be_decode(mnpbc_container_t *cont, mnbytes_t *decode)
 {
@@ -257,6 +274,16 @@ mnpbc_container_set_be_decode(mnpbc_container_t *cont, mnbytes_t *decode)
 }
 
 
+void
+mnpbc_container_set_be_decode_packed(mnpbc_container_t *cont,
+                                      mnbytes_t *decode_packed)
+{
+    BYTES_DECREF(&cont->be.decode_packed);
+    cont->be.decode_packed = decode_packed;
+    BYTES_INCREF(cont->be.decode_packed);
+}
+
+
 void
 mnpbc_container_set_be_sz(mnpbc_container_t *cont, mnbytes_t *sz)
 {
@@ -293,6 +320,24 @@ mnpbc_container_traverse_fields(mnpbc_container_t *cont,
 }
 
 
+void
+mnpbc_container_traverse_fields_reverse(mnpbc_container_t *cont,
+                                         array_traverser_t cb,
+                                         void *udata)
+{
+    mnpbc_field_t **field;
+    mnarray_iter_t it;
+
+    for (field = array_last(&cont->fields, &it);
+         field != NULL;
+         field = array_prev(&cont->fields, &it)) {
+        if (cb(field, udata) != 0) {
+            break;
+        }
+    }
+}
+
+
 void
 mnpbc_container_traverse_containers(mnpbc_container_t *cont,
                                      array_traverser_t cb,
@@ -652,6 +697,8 @@ mnpbc_ctx_init(mnpbc_ctx_t *ctx)
     ctx->in = NULL;
     ctx->out0 = NULL;
     ctx->out1 = NULL;
+    ctx->flags.views = 0;
+    ctx->flags.lazy = 0;
     hash_init(&ctx->containers,
               127,
               (hash_hashfn_t)bytes_hash,
@@ -1,7 +1,20 @@
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __BMI2__
+#   include <immintrin.h>
+#endif
 
 #include <mncommon/bytestream.h>
 #include <mncommon/dumpm.h>
@@ -14,32 +27,493 @@
 /*
  * protocol buffer runtime
  */
-#ifndef HAVE_FLSL
-#   ifdef __GCC__
-#       define flsl(v) (v ? ((sizeof(long) * 8) - __builtin_clzl(v)) : 0)
-#       define flsll(v) (v ? ((sizeof(long long) * 8) - __builtin_clzl(v)) : 0)
-#       define fls(v) (v ? ((sizeof(int) * 8) - __builtin_clzl(v)) : 0)
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#   define MNPB_LITTLE_ENDIAN
+#endif
+
+void mndiag_mncommon_str(int, char *, size_t);
+
+
+/*
+ * statistics
+ */
+#ifdef MNPB_STATS
+struct _mnpb_stats_block {
+    struct _mnpb_stats_block *next;
+    mnpb_stats_t *stats;
+    /* the counters as of the last reset, under the lock */
+    mnpb_stats_t *base;
+    size_t nstats;
+};
+
+static pthread_mutex_t _mnpb_stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+/* of the running threads */
+static struct _mnpb_stats_block *_mnpb_stats_blocks = NULL;
+/* what exited threads counted since the last reset */
+static mnpb_stats_t *_mnpb_stats_retired = NULL;
+static size_t _mnpb_stats_nretired = 0;
+static pthread_key_t _mnpb_stats_key;
+static pthread_once_t _mnpb_stats_once = PTHREAD_ONCE_INIT;
+/* type 0 has no name */
+static const char **_mnpb_stats_names = NULL;
+static size_t _mnpb_stats_ntypes = 1;
+
+static __thread struct _mnpb_stats_block *_mnpb_stats_block = NULL;
+static __thread size_t _mnpb_stats_cur = 0;
+static __thread bool _mnpb_stats_errseen = false;
+
+/*
+ * Counters are written by their own thread only, and read by the others
+ * with relaxed atomics, which keeps locked instructions off the
+ * counting path.  Hence they are never cleared: mnpb_stats_reset()
+ * takes a baseline, subtracted on collection.
+ */
+#define MNPB_STATS_ADD(st, field, n)                                    \
+    __atomic_store_n(&(st)->field,                                      \
+                     __atomic_load_n(&(st)->field, __ATOMIC_RELAXED) +  \
+                        (n),                                            \
+                     __ATOMIC_RELAXED)
+
+
+/*
+ * All fields of mnpb_stats_t are uint64_t.
+ */
+#define MNPB_STATS_NFIELDS (sizeof(mnpb_stats_t) / sizeof(uint64_t))
+
+
+/*
+ * Add the counters of the block since the last reset to n stats, under
+ * the lock.
+ */
+static void
+mnpb_stats_sum(mnpb_stats_t *stats,
+               size_t n,
+               struct _mnpb_stats_block *blk)
+{
+    for (size_t i = 0; i < n && i < blk->nstats; ++i) {
+        uint64_t *dst = (uint64_t *)&stats[i];
+        uint64_t *src = (uint64_t *)&blk->stats[i];
+        uint64_t *base = (uint64_t *)&blk->base[i];
+
+        for (size_t j = 0; j < MNPB_STATS_NFIELDS; ++j) {
+            dst[j] += __atomic_load_n(&src[j], __ATOMIC_RELAXED) - base[j];
+        }
+    }
+}
+
+
+/*
+ * At thread exit: fold the counters of the thread into the retired ones,
+ * and free its block.
+ */
+static void
+mnpb_stats_exit(void *arg)
+{
+    struct _mnpb_stats_block *blk, **pblk;
+
+    blk = arg;
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    for (pblk = &_mnpb_stats_blocks; *pblk != blk; pblk = &(*pblk)->next) {
+        ;
+    }
+    *pblk = blk->next;
+    if (blk->nstats > _mnpb_stats_nretired) {
+        mnpb_stats_t *retired;
+
+        /* else they are lost */
+        if ((retired = realloc(_mnpb_stats_retired,
+                               blk->nstats * sizeof(*retired))) != NULL) {
+            memset(retired + _mnpb_stats_nretired,
+                   0,
+                   (blk->nstats - _mnpb_stats_nretired) * sizeof(*retired));
+            _mnpb_stats_retired = retired;
+            _mnpb_stats_nretired = blk->nstats;
+        }
+    }
+    mnpb_stats_sum(_mnpb_stats_retired, _mnpb_stats_nretired, blk);
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+
+    _mnpb_stats_block = NULL;
+    free(blk->stats);
+    free(blk->base);
+    free(blk);
+}
+
+
+static void
+mnpb_stats_key_init(void)
+{
+    (void)pthread_key_create(&_mnpb_stats_key, mnpb_stats_exit);
+}
+
+
+/*
+ * Make room for the type id in the block of the thread, which may not
+ * exist yet.  Growing is under the lock, as others may be reading.
+ */
+static struct _mnpb_stats_block *
+mnpb_stats_grow(size_t id)
+{
+    struct _mnpb_stats_block *blk;
+    mnpb_stats_t *stats;
+    size_t n;
+
+    (void)pthread_once(&_mnpb_stats_once, mnpb_stats_key_init);
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    if ((blk = _mnpb_stats_block) == NULL) {
+        if ((blk = calloc(1, sizeof(*blk))) == NULL) {
+            goto end;
+        }
+        if (pthread_setspecific(_mnpb_stats_key, blk) != 0) {
+            free(blk);
+            blk = NULL;
+            goto end;
+        }
+        blk->next = _mnpb_stats_blocks;
+        _mnpb_stats_blocks = blk;
+        _mnpb_stats_block = blk;
+    }
+    n = id < _mnpb_stats_ntypes ? _mnpb_stats_ntypes : id + 1;
+    if (n > blk->nstats) {
+        if ((stats = realloc(blk->base, n * sizeof(*stats))) == NULL) {
+            blk = NULL;
+            goto end;
+        }
+        memset(stats + blk->nstats, 0, (n - blk->nstats) * sizeof(*stats));
+        blk->base = stats;
+        if ((stats = realloc(blk->stats, n * sizeof(*stats))) == NULL) {
+            blk = NULL;
+            goto end;
+        }
+        memset(stats + blk->nstats, 0, (n - blk->nstats) * sizeof(*stats));
+        blk->stats = stats;
+        blk->nstats = n;
+    }
+
+end:
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+    return blk;
+}
+
+
+static mnpb_stats_t *
+mnpb_stats_slot(void)
+{
+    struct _mnpb_stats_block *blk;
+
+    if ((blk = _mnpb_stats_block) == NULL ||
+        _mnpb_stats_cur >= blk->nstats) {
+        if ((blk = mnpb_stats_grow(_mnpb_stats_cur)) == NULL) {
+            return NULL;
+        }
+    }
+    return &blk->stats[_mnpb_stats_cur];
+}
+
+
+#define MNPB_STATS_INC(field)                  \
+    do {                                        \
+        mnpb_stats_t *_st;                      \
+        if ((_st = mnpb_stats_slot()) != NULL) {\
+            MNPB_STATS_ADD(_st, field, 1);      \
+        }                                       \
+    } while (0)
+
+
+static size_t
+mnpb_stats_register(mnpb_stats_type_t *ty)
+{
+    size_t res;
+
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    if ((res = __atomic_load_n(&ty->id, __ATOMIC_ACQUIRE)) == 0) {
+        const char **names;
+
+        if ((names = realloc(_mnpb_stats_names,
+                             (_mnpb_stats_ntypes + 1) *
+                                sizeof(*names))) != NULL) {
+            names[0] = NULL;
+            names[_mnpb_stats_ntypes] = ty->name;
+            _mnpb_stats_names = names;
+            res = _mnpb_stats_ntypes++;
+            __atomic_store_n(&ty->id, res, __ATOMIC_RELEASE);
+        }
+    }
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+    return res;
+}
+
+
+/*
+ * Make the type current for this thread, return the previous one.
+ */
+size_t
+mnpb_stats_enter(mnpb_stats_type_t *ty)
+{
+    size_t res;
+    size_t id;
+
+    if ((id = __atomic_load_n(&ty->id, __ATOMIC_ACQUIRE)) == 0) {
+        id = mnpb_stats_register(ty);
+    }
+    if ((res = _mnpb_stats_cur) == 0) {
+        _mnpb_stats_errseen = false;
+    }
+    _mnpb_stats_cur = id;
+    return res;
+}
+
+
+/*
+ * An error is counted by the innermost type only, the enclosing ones
+ * just pass it on.
+ */
+void
+mnpb_stats_leave(size_t prev, ssize_t res, int enc)
+{
+    mnpb_stats_t *st;
+
+    if ((st = mnpb_stats_slot()) != NULL) {
+        if (res >= 0) {
+            if (enc) {
+                MNPB_STATS_ADD(st, nencoded, 1);
+                MNPB_STATS_ADD(st, bencoded, res);
+            } else {
+                MNPB_STATS_ADD(st, ndecoded, 1);
+                MNPB_STATS_ADD(st, bdecoded, res);
+            }
+        } else if (!_mnpb_stats_errseen) {
+            if (-res < MNPB_STATS_NERROR) {
+                MNPB_STATS_ADD(st, nerror[-res], 1);
+            }
+            _mnpb_stats_errseen = true;
+        }
+    }
+    _mnpb_stats_cur = prev;
+}
+
+
+size_t
+mnpb_stats_ntypes(void)
+{
+    size_t res;
+
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    res = _mnpb_stats_ntypes;
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+    return res;
+}
+
+
+const char *
+mnpb_stats_name(size_t id)
+{
+    const char *res;
+
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    res = id < _mnpb_stats_ntypes && _mnpb_stats_names != NULL ?
+        _mnpb_stats_names[id] : NULL;
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+    return res;
+}
+
+
+static size_t
+mnpb_stats_collect(mnpb_stats_t *stats, size_t n, bool all)
+{
+    struct _mnpb_stats_block *blk;
+    size_t res;
+
+    memset(stats, 0, n * sizeof(*stats));
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    if (all) {
+        for (size_t i = 0; i < n && i < _mnpb_stats_nretired; ++i) {
+            stats[i] = _mnpb_stats_retired[i];
+        }
+    }
+    blk = all ? _mnpb_stats_blocks : _mnpb_stats_block;
+    for (; blk != NULL; blk = all ? blk->next : NULL) {
+        mnpb_stats_sum(stats, n, blk);
+    }
+    res = _mnpb_stats_ntypes;
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+    return res;
+}
+
+
+size_t
+mnpb_stats_thread(mnpb_stats_t *stats, size_t n)
+{
+    return mnpb_stats_collect(stats, n, false);
+}
+
+
+size_t
+mnpb_stats_aggregate(mnpb_stats_t *stats, size_t n)
+{
+    return mnpb_stats_collect(stats, n, true);
+}
+
+
+void
+mnpb_stats_reset(void)
+{
+    struct _mnpb_stats_block *blk;
+
+    (void)pthread_mutex_lock(&_mnpb_stats_mtx);
+    for (blk = _mnpb_stats_blocks; blk != NULL; blk = blk->next) {
+        for (size_t i = 0; i < blk->nstats; ++i) {
+            uint64_t *dst = (uint64_t *)&blk->base[i];
+            uint64_t *src = (uint64_t *)&blk->stats[i];
+
+            for (size_t j = 0; j < MNPB_STATS_NFIELDS; ++j) {
+                dst[j] = __atomic_load_n(&src[j], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    if (_mnpb_stats_retired != NULL) {
+        memset(_mnpb_stats_retired,
+               0,
+               _mnpb_stats_nretired * sizeof(*_mnpb_stats_retired));
+    }
+    (void)pthread_mutex_unlock(&_mnpb_stats_mtx);
+}
+#else
+#define MNPB_STATS_INC(field) do {} while (0)
+#endif
+
+
+/*
+ * bytestream_consume_data() with the refill counted.  A stream without
+ * read_more, over a record file mapping or a raw lazy field, ends at
+ * SEOD: fail instead of growing a buffer the stream does not own.
+ */
+static inline int
+mnpb_consume(mnbytestream_t *bs, void *fd)
+{
+    if (MNUNLIKELY(bs->read_more == NULL)) {
+        return MNPB_EIO;
+    }
+    MNPB_STATS_INC(nrefill);
+    return bytestream_consume_data(bs, fd);
+}
+
+
+#ifdef MNPB_LITTLE_ENDIAN
+/*
+ * Pack the low seven bits of each of the eight bytes of w together.
+ */
+static inline uint64_t
+mnpb_varint_squash(uint64_t w)
+{
+#   ifdef __BMI2__
+    return _pext_u64(w, 0x7f7f7f7f7f7f7f7full);
+#   else
+    w &= 0x7f7f7f7f7f7f7f7full;
+    w = ((w & 0x7f007f007f007f00ull) >> 1) | (w & 0x007f007f007f007full);
+    w = ((w & 0x3fff00003fff0000ull) >> 2) | (w & 0x00003fff00003fffull);
+    w = ((w & 0x0fffffff00000000ull) >> 4) | (w & 0x000000000fffffffull);
+    return w;
+#   endif
+}
+
+
+/*
+ * The reverse: spread the low 56 bits of v over the low seven bits of
+ * each of the eight bytes.
+ */
+static inline uint64_t
+mnpb_varint_spread(uint64_t v)
+{
+#   ifdef __BMI2__
+    return _pdep_u64(v, 0x7f7f7f7f7f7f7f7full);
 #   else
-#       error "Could not find/define flsl."
+    v = ((v & 0x00fffffff0000000ull) << 4) | (v & 0x000000000fffffffull);
+    v = ((v & 0x0fffc0000fffc000ull) << 2) | (v & 0x00003fff00003fffull);
+    v = ((v & 0x3f803f803f803f80ull) << 1) | (v & 0x007f007f007f007full);
+    return v;
 #   endif
+}
 #endif
 
-#if __STDC_VERSION__ >= 201112
-#   define MNFLS(v)                    \
-    _Generic(v,                        \
-             unsigned long long: flsll,\
-             long long: flsll,         \
-             default: flsl,            \
-             unsigned int: fls,        \
-             int: fls,                 \
-             )(v)                      \
 
+/*
+ * Make room for n more bytes past SEOD, so that the encoders can store
+ * without checking each byte.
+ */
+static inline int
+mnpb_reserve(mnbytestream_t *bs, size_t n)
+{
+    if (MNUNLIKELY((size_t)(bs->buf.sz - SEOD(bs)) < n)) {
+        if (bytestream_grow(bs,
+                            (size_t)bs->growsz > n ?
+                                (size_t)bs->growsz : n) != 0) {
+            return MNPB_EMEMORY;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Decode a varint from a buffer that is known to hold at least
+ * MNPB_VARINT_MAXSZ bytes.  Return the number of bytes consumed, or 0 if
+ * there is no terminating byte within MNPB_VARINT_MAXSZ (the caller then
+ * falls back to the byte-by-byte loop).
+ */
+static ssize_t
+mnpb_devarint_fast(const unsigned char *p, uint64_t *v)
+{
+#ifdef MNPB_LITTLE_ENDIAN
+    uint64_t w, stop;
+
+    memcpy(&w, p, sizeof(w));
+    /* msb clear marks the terminating byte */
+    stop = ~w & 0x8080808080808080ull;
+
+    if (stop != 0) {
+        int nbits;
+
+        nbits = __builtin_ctzll(stop) + 1;
+        if (nbits < 64) {
+            w &= (1ull << nbits) - 1;
+        }
+        *v = mnpb_varint_squash(w);
+        return nbits >> 3;
 
+    } else {
+        uint64_t r;
+
+        /* eight continuation bytes, 56 bits so far */
+        r = mnpb_varint_squash(w);
+        r |= (uint64_t)(p[8] & 0x7f) << 56;
+        if (!(p[8] & 0x80)) {
+            *v = r;
+            return 9;
+        }
+        r |= (uint64_t)p[9] << 63;
+        if (!(p[9] & 0x80)) {
+            *v = r;
+            return 10;
+        }
+        return 0;
+    }
 #else
-#   define MNFLS(v) flsl((long)(v))
+    uint64_t r;
+    int i;
+
+    r = 0;
+    for (i = 0; i < MNPB_VARINT_MAXSZ; ++i) {
+        r |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *v = r;
+            return i + 1;
+        }
+    }
+    return 0;
 #endif
+}
 
-void mndiag_mncommon_str(int, char *, size_t);
 
 ssize_t
 mnpb_devarint(mnbytestream_t *bs, void *fd, uint64_t *v)
@@ -47,6 +521,19 @@ mnpb_devarint(mnbytestream_t *bs, void *fd, uint64_t *v)
     ssize_t res;
     int i;
 
+    /*
+     * fast path: the whole varint is in the buffer, one bounds check
+     */
+    if (SAVAIL(bs) >= MNPB_VARINT_MAXSZ) {
+        if ((res = mnpb_devarint_fast((unsigned char *)SPDATA(bs), v)) > 0) {
+            SADVANCEPOS(bs, res);
+            return res;
+        }
+    }
+
+    /*
+     * slow path: at the buffer edge, refill as we go
+     */
     res = 0;
     *v = 0;
 
@@ -54,7 +541,7 @@ mnpb_devarint(mnbytestream_t *bs, void *fd, uint64_t *v)
         unsigned char c;
 
         if (SNEEDMORE(bs)) {
-            if ((res = bytestream_consume_data(bs, fd)) != 0) {
+            if ((res = mnpb_consume(bs, fd)) != 0) {
                 //char buf[64];
                 //mndiag_mncommon_str(res, buf, sizeof(buf));
                 //TRACE("res=%s", buf);
@@ -89,47 +576,75 @@ end:
 }
 
 
+/*
+ * One bounds check for the whole varint.  Up to 56 bits, all bytes are
+ * composed in a word and stored at once; the bytes past the varint are
+ * within the reserved room, and are overwritten by what comes next.
+ */
 ssize_t
 mnpb_envarint(mnbytestream_t *bs, uint64_t v)
 {
+    unsigned char *p;
     ssize_t res;
 
-    res = 0;
-    while (true) {
-        char c;
+    if (MNUNLIKELY(mnpb_reserve(bs, MNPB_VARINT_MAXSZ) != 0)) {
+        return MNPB_EMEMORY;
+    }
+    p = (unsigned char *)SDATA(bs, SEOD(bs));
+
+#ifdef MNPB_LITTLE_ENDIAN
+    if (MNLIKELY(v < (1ull << 56))) {
+        uint64_t w;
+
+        res = mnpb_szvarint(v);
+        /* continuation bits on all bytes but the last */
+        w = mnpb_varint_spread(v) |
+            (0x0080808080808080ull >> ((8 - res) * 8));
+        memcpy(p, &w, sizeof(w));
+        SADVANCEEOD(bs, res);
+        return res;
+    }
+#endif
 
-        c = v & 0x7f;
+    res = 0;
+    while (v >= 0x80) {
+        p[res++] = (unsigned char)(v | 0x80);
         v >>= 7;
-        if (v != 0) {
-            ++res;
-            SCATC(bs, c | 0x80);
-        } else {
-            ++res;
-            SCATC(bs, c);
-            break;
-        }
     }
+    p[res++] = (unsigned char)v;
+    SADVANCEEOD(bs, res);
 
     return res;
 }
 
 
+/*
+ * Tags are precomputed by mnpbc: the sz bytes of the key varint are in
+ * the low-order bytes of tag, first byte lowest.
+ */
 ssize_t
-mnpb_szvarint(uint64_t v)
+mnpb_entag(mnbytestream_t *bs, uint64_t tag, size_t sz)
 {
-    ssize_t res;
+    if (MNUNLIKELY(mnpb_reserve(bs, sizeof(tag)) != 0)) {
+        return MNPB_EMEMORY;
+    }
 
-    if (v == 0) {
-        res = 1;
-    } else {
-        int msb;
-        div_t d;
+#ifdef MNPB_LITTLE_ENDIAN
+    memcpy(SDATA(bs, SEOD(bs)), &tag, sizeof(tag));
+#else
+    {
+        unsigned char *p;
+        size_t i;
 
-        msb = MNFLS(v);
-        d = div(msb, 7);
-        res = d.quot + (d.rem ? 1 : 0);
+        p = (unsigned char *)SDATA(bs, SEOD(bs));
+        for (i = 0; i < sz; ++i) {
+            p[i] = (unsigned char)(tag >> (i * 8));
+        }
     }
-    return res;
+#endif
+    SADVANCEEOD(bs, sz);
+
+    return (ssize_t)sz;
 }
 
 
@@ -157,19 +672,11 @@ mnpb_enzz64(mnbytestream_t *bs, int64_t v)
 {
     uint64_t vv;
 
-    vv = (uint64_t)((v << 1) ^ (v >> 63));
+    vv = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
     return mnpb_envarint(bs, vv);
 }
 
 
-ssize_t
-mnpb_szzz64(int64_t v)
-{
-    v = (v << 1) ^ (v >> 63);
-    return mnpb_szvarint((uint64_t)v);
-}
-
-
 ssize_t
 mnpb_dumpzz64(mnbytestream_t *bs, int64_t v)
 {
@@ -194,21 +701,11 @@ mnpb_enzz32(mnbytestream_t *bs, int32_t v)
 {
     uint64_t vv;
 
-    vv = (uint64_t)((((uint32_t)v) << 1) ^ (((uint32_t)v) >> 31));
+    vv = (uint64_t)((((uint32_t)v) << 1) ^ (uint32_t)(v >> 31));
     return mnpb_envarint(bs, vv);
 }
 
 
-ssize_t
-mnpb_szzz32(int32_t v)
-{
-    UNUSED uint64_t vv;
-
-    vv = (uint64_t)((((uint32_t)v) << 1) ^ (((uint32_t)v) >> 31));
-    return mnpb_szvarint(v);
-}
-
-
 ssize_t
 mnpb_dumpzz32(mnbytestream_t *bs, int32_t v)
 {
@@ -228,7 +725,7 @@ mnpb_defi64(mnbytestream_t *bs, void *fd, uint64_t *v)
     res = sizeof(uint64_t);
 
     while (SAVAIL(bs) < (ssize_t)sizeof(uint64_t)) {
-        if ((res = bytestream_consume_data(bs, fd)) != 0) {
+        if ((res = mnpb_consume(bs, fd)) != 0) {
             //TRACE("res=%s", mncommon_diag_str(res));
             res = MNPB_EIO;
             goto end;
@@ -253,13 +750,6 @@ mnpb_enfi64(mnbytestream_t *bs, uint64_t v)
 }
 
 
-ssize_t
-mnpb_szfi64(uint64_t v)
-{
-    return sizeof(v);
-}
-
-
 ssize_t
 mnpb_dumpfi64(mnbytestream_t *bs, uint64_t v)
 {
@@ -279,7 +769,7 @@ mnpb_defi32(mnbytestream_t *bs, void *fd, uint32_t *v)
     res = sizeof(uint32_t);
 
     while (SAVAIL(bs) < (ssize_t)sizeof(uint32_t)) {
-        if ((res = bytestream_consume_data(bs, fd)) != 0) {
+        if ((res = mnpb_consume(bs, fd)) != 0) {
             //TRACE("res=%s", mncommon_diag_str(res));
             res = MNPB_EIO;
             goto end;
@@ -304,13 +794,6 @@ mnpb_enfi32(mnbytestream_t *bs, uint32_t v)
 }
 
 
-ssize_t
-mnpb_szfi32(uint32_t v)
-{
-    return sizeof(v);
-}
-
-
 ssize_t
 mnpb_dumpfi32(mnbytestream_t *bs, uint32_t v)
 {
@@ -330,7 +813,7 @@ mnpb_dedouble(mnbytestream_t *bs, void *fd, double *v)
     res = sizeof(double);
 
     while (SAVAIL(bs) < (ssize_t)sizeof(double)) {
-        if ((res = bytestream_consume_data(bs, fd)) != 0) {
+        if ((res = mnpb_consume(bs, fd)) != 0) {
             //TRACE("res=%s", mncommon_diag_str(res));
             res = MNPB_EIO;
             goto end;
@@ -355,13 +838,6 @@ mnpb_endouble(mnbytestream_t *bs, double v)
 }
 
 
-ssize_t
-mnpb_szdouble(double v)
-{
-    return sizeof(v);
-}
-
-
 ssize_t
 mnpb_dumpdouble(mnbytestream_t *bs, double v)
 {
@@ -381,7 +857,7 @@ mnpb_defloat(mnbytestream_t *bs, void *fd, float *v)
     res = sizeof(float);
 
     while (SAVAIL(bs) < (ssize_t)sizeof(float)) {
-        if ((res = bytestream_consume_data(bs, fd)) != 0) {
+        if ((res = mnpb_consume(bs, fd)) != 0) {
             //TRACE("res=%s", mncommon_diag_str(res));
             res = MNPB_EIO;
             goto end;
@@ -407,31 +883,267 @@ mnpb_enfloat(mnbytestream_t *bs, float v)
 
 
 ssize_t
-mnpb_szfloat(float v)
+mnpb_dumpfloat(mnbytestream_t *bs, float v)
 {
-    return sizeof(v);
+    return bytestream_nprintf(bs, 512, "%g", v);
 }
 
 
-ssize_t
-mnpb_dumpfloat(mnbytestream_t *bs, float v)
+/*
+ * Arena allocation.  While an arena is entered, decoded strings, bytes
+ * and repeated arrays are bump-allocated from it instead of the heap.
+ * Chunks are chained, and mnpb_arena_reset() releases everything at
+ * once.
+ */
+#define MNPB_ARENA_ALIGN(sz) (((sz) + 15) & ~((size_t)15))
+
+struct _mnpb_arena_chunk {
+    struct _mnpb_arena_chunk *next;
+    size_t sz;
+    char data[];
+};
+
+#if defined(__GNUC__)
+static __thread mnpb_arena_t *_mnpb_arena = NULL;
+#else
+static mnpb_arena_t *_mnpb_arena = NULL;
+#endif
+
+
+void
+mnpb_arena_init(mnpb_arena_t *arena, size_t chunksz)
 {
-    return bytestream_nprintf(bs, 512, "%g", v);
+    arena->chunks = NULL;
+    arena->pos = NULL;
+    arena->end = NULL;
+    arena->chunksz = chunksz;
 }
 
 
-ssize_t
-mnpb_debytes(mnbytestream_t *bs, void *fd, mnbytes_t **v)
+void
+mnpb_arena_fini(mnpb_arena_t *arena)
 {
-    ssize_t res;
-    ssize_t sz;
+    while (arena->chunks != NULL) {
+        struct _mnpb_arena_chunk *next;
 
-    if ((res = mnpb_devarint(bs, fd, (uint64_t *)&sz)) < 0) {
-        goto end;
-    }
-    if (sz > MNPB_MAX_BYTES) {
-        res = MNPB_ESIZE;
-        goto end;
+        next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->pos = NULL;
+    arena->end = NULL;
+}
+
+
+/*
+ * Keep the most recent chunk for reuse, release the rest.
+ */
+void
+mnpb_arena_reset(mnpb_arena_t *arena)
+{
+    if (arena->chunks != NULL) {
+        struct _mnpb_arena_chunk *head;
+
+        head = arena->chunks;
+        arena->chunks = head->next;
+        mnpb_arena_fini(arena);
+        head->next = NULL;
+        arena->chunks = head;
+        arena->pos = head->data;
+        arena->end = head->data + head->sz;
+    }
+}
+
+
+void *
+mnpb_arena_alloc(mnpb_arena_t *arena, size_t sz)
+{
+    void *res;
+
+    sz = MNPB_ARENA_ALIGN(sz);
+
+    if ((size_t)(arena->end - arena->pos) < sz) {
+        struct _mnpb_arena_chunk *chunk;
+        size_t csz;
+
+        csz = sz > arena->chunksz ? sz : arena->chunksz;
+        if ((chunk = malloc(sizeof(*chunk) + csz)) == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        chunk->sz = csz;
+        arena->chunks = chunk;
+        arena->pos = chunk->data;
+        arena->end = chunk->data + csz;
+    }
+
+    res = arena->pos;
+    arena->pos += sz;
+    return res;
+}
+
+
+/*
+ * The most recent allocation grows in place.
+ */
+void *
+mnpb_arena_realloc(mnpb_arena_t *arena, void *ptr, size_t oldsz, size_t sz)
+{
+    void *res;
+
+    if (ptr != NULL &&
+        (char *)ptr + MNPB_ARENA_ALIGN(oldsz) == arena->pos &&
+        (size_t)(arena->end - (char *)ptr) >= MNPB_ARENA_ALIGN(sz)) {
+        arena->pos = (char *)ptr + MNPB_ARENA_ALIGN(sz);
+        return ptr;
+    }
+
+    if ((res = mnpb_arena_alloc(arena, sz)) != NULL && ptr != NULL) {
+        memcpy(res, ptr, oldsz < sz ? oldsz : sz);
+    }
+    return res;
+}
+
+
+mnpb_arena_t *
+mnpb_arena_enter(mnpb_arena_t *arena)
+{
+    mnpb_arena_t *res;
+
+    res = _mnpb_arena;
+    _mnpb_arena = arena;
+    return res;
+}
+
+
+/*
+ * Pluggable allocation.  Under an allocator, what the heap would
+ * otherwise provide comes from it instead; an entered arena still takes
+ * precedence for what it covers.
+ */
+#if defined(__GNUC__)
+static __thread const mnpb_allocator_t *_mnpb_allocator = NULL;
+#else
+static const mnpb_allocator_t *_mnpb_allocator = NULL;
+#endif
+
+
+const mnpb_allocator_t *
+mnpb_allocator_enter(const mnpb_allocator_t *allocator)
+{
+    const mnpb_allocator_t *res;
+
+    res = _mnpb_allocator;
+    _mnpb_allocator = allocator;
+    return res;
+}
+
+
+void *
+mnpb_malloc(size_t sz)
+{
+    MNPB_STATS_INC(nalloc);
+    if (_mnpb_allocator != NULL) {
+        return _mnpb_allocator->alloc(_mnpb_allocator->ctx, sz);
+    }
+    return malloc(sz);
+}
+
+
+/*
+ * Under an entered arena, what is released may well come from it, and
+ * goes with it.
+ */
+void
+mnpb_free(void *ptr)
+{
+    if (_mnpb_arena != NULL) {
+        return;
+    }
+    if (_mnpb_allocator != NULL) {
+        if (_mnpb_allocator->free != NULL) {
+            _mnpb_allocator->free(_mnpb_allocator->ctx, ptr);
+        }
+        return;
+    }
+    free(ptr);
+}
+
+
+void *
+mnpb_realloc(void *ptr, size_t oldsz, size_t sz)
+{
+    MNPB_STATS_INC(nalloc);
+    if (_mnpb_arena != NULL) {
+        return mnpb_arena_realloc(_mnpb_arena, ptr, oldsz, sz);
+    }
+    if (_mnpb_allocator != NULL) {
+        return _mnpb_allocator->realloc(_mnpb_allocator->ctx, ptr, oldsz, sz);
+    }
+    return realloc(ptr, sz);
+}
+
+
+/*
+ * Arena bytes carry the static reference count of BYTES_INITIALIZER,
+ * so that BYTES_DECREF never frees them.
+ */
+static mnbytes_t _mnpb_arena_bytes = BYTES_INITIALIZER("");
+
+mnbytes_t *
+mnpb_bytes_new(const char *data, size_t sz, bool zt)
+{
+    mnbytes_t *res;
+
+    MNPB_STATS_INC(nalloc);
+    if (_mnpb_arena != NULL) {
+        res = mnpb_arena_alloc(_mnpb_arena, sizeof(mnbytes_t) + sz + zt);
+    } else if (_mnpb_allocator != NULL) {
+        res = _mnpb_allocator->alloc(_mnpb_allocator->ctx,
+                                     sizeof(mnbytes_t) + sz + zt);
+    } else {
+        return zt ?
+            bytes_new_from_str_len(data, sz) :
+            bytes_new_from_mem_len(data, sz);
+    }
+
+    if (res != NULL) {
+        res->nref = _mnpb_arena != NULL ? _mnpb_arena_bytes.nref : 0;
+        res->sz = sz + zt;
+        res->hash = 0;
+        memcpy(BDATA(res), data, sz);
+        if (zt) {
+            BDATA(res)[sz] = '\0';
+        }
+    }
+    return res;
+}
+
+
+void
+mnpb_bytes_decref(mnbytes_t **v)
+{
+    if (*v != NULL) {
+        if (--(*v)->nref <= 0) {
+            mnpb_free(*v);
+        }
+        *v = NULL;
+    }
+}
+
+
+ssize_t
+mnpb_debytes(mnbytestream_t *bs, void *fd, mnbytes_t **v)
+{
+    ssize_t res;
+    ssize_t sz;
+
+    if ((res = mnpb_devarint(bs, fd, (uint64_t *)&sz)) < 0) {
+        goto end;
+    }
+    if (sz > MNPB_MAX_BYTES) {
+        res = MNPB_ESIZE;
+        goto end;
     }
 
     if (sz == 0) {
@@ -440,14 +1152,17 @@ mnpb_debytes(mnbytestream_t *bs, void *fd, mnbytes_t **v)
     }
 
     while (SAVAIL(bs) < sz) {
-        if ((res = bytestream_consume_data(bs, fd)) != 0) {
+        if ((res = mnpb_consume(bs, fd)) != 0) {
             //TRACE("res=%s", mncommon_diag_str(res));
             res = MNPB_EIO;
             goto end;
         }
     }
 
-    *v = bytes_new_from_mem_len(SPDATA(bs), sz);
+    if ((*v = mnpb_bytes_new(SPDATA(bs), sz, false)) == NULL) {
+        res = MNPB_EMEMORY;
+        goto end;
+    }
     SADVANCEPOS(bs, sz);
     res += sz;
 
@@ -477,14 +1192,17 @@ mnpb_destr(mnbytestream_t *bs, void *fd, mnbytes_t **v)
     }
 
     while (SAVAIL(bs) < sz) {
-        if ((res = bytestream_consume_data(bs, fd)) != 0) {
+        if ((res = mnpb_consume(bs, fd)) != 0) {
             //TRACE("res=%s", mncommon_diag_str(res));
             res = MNPB_EIO;
             goto end;
         }
     }
 
-    *v = bytes_new_from_str_len(SPDATA(bs), sz);
+    if ((*v = mnpb_bytes_new(SPDATA(bs), sz, true)) == NULL) {
+        res = MNPB_EMEMORY;
+        goto end;
+    }
     SADVANCEPOS(bs, sz);
     res += sz;
 
@@ -588,6 +1306,100 @@ mnpb_dumpstr(mnbytestream_t *bs, mnbytes_t *v)
 }
 
 
+/*
+ * Views point into the input buffer, which is why they never refill it:
+ * a refill may move the buffer and leave earlier views dangling.  The
+ * caller has to have the whole message in the buffer, and keep it
+ * there for as long as the views are in use.
+ */
+ssize_t
+mnpb_deview(mnbytestream_t *bs, void *fd, mnpb_view_t *v)
+{
+    ssize_t res;
+    uint64_t sz;
+
+    if ((res = mnpb_devarint(bs, fd, &sz)) < 0) {
+        goto end;
+    }
+
+    if (sz == 0) {
+        v->data = NULL;
+        v->sz = 0;
+        goto end;
+    }
+
+    if ((uint64_t)SAVAIL(bs) < sz) {
+        res = MNPB_EIO;
+        goto end;
+    }
+
+    v->data = SPDATA(bs);
+    v->sz = sz;
+    SADVANCEPOS(bs, sz);
+    res += sz;
+
+end:
+    assert(res != 0);
+    return res;
+}
+
+
+ssize_t
+mnpb_enview(mnbytestream_t *bs, mnpb_view_t v)
+{
+    ssize_t res0, res1;
+
+    if (v.data == NULL) {
+        return 0;
+    }
+
+    if ((res0 = mnpb_envarint(bs, v.sz)) < 0) {
+        goto end;
+    }
+    if ((res1 = bytestream_cat(bs, v.sz, v.data)) < 0) {
+        res0 = MNPB_EIO;
+        goto end;
+    }
+    res0 += res1;
+
+end:
+    assert(res0 != 0);
+    return res0;
+}
+
+
+ssize_t
+mnpb_szview(mnpb_view_t v)
+{
+    if (v.data == NULL) {
+        return 0;
+    }
+    return mnpb_szvarint(v.sz) + v.sz;
+}
+
+
+ssize_t
+mnpb_dumpbytesview(mnbytestream_t *bs, mnpb_view_t v)
+{
+    if (v.data == NULL) {
+        return 0;
+    }
+
+    return bytestream_nprintf(bs, 512, "<bytes of %zd>", v.sz);
+}
+
+
+ssize_t
+mnpb_dumpstrview(mnbytestream_t *bs, mnpb_view_t v)
+{
+    if (v.data == NULL) {
+        return 0;
+    }
+
+    return bytestream_nprintf(bs, 8 + v.sz, "\"%.*s\"", (int)v.sz, v.data);
+}
+
+
 ssize_t
 mnpb_deldelim(mnbytestream_t *bs,
                void *fd,
@@ -708,13 +1520,6 @@ mnpb_pack_int32(mnbytestream_t *bs, int32_t v)
 }
 
 
-ssize_t
-mnpb_sz_int32(int32_t v)
-{
-    return mnpb_szvarint((uint32_t)v);
-}
-
-
 ssize_t
 mnpb_unpack_int32(mnbytestream_t *bs, void *fd, int wtype, int32_t *value)
 {
@@ -996,6 +1801,65 @@ end:
 }
 
 
+/*
+ * Decode over *v in place when nobody else holds it and it is large
+ * enough, as with elements kept by <msg>_clear().  Not under an arena,
+ * whose messages are never finalized.
+ */
+static ssize_t
+mnpb_deldelim_reuse(mnbytestream_t *bs, void *fd, mnbytes_t **v, bool zt)
+{
+    ssize_t res;
+    uint64_t sz;
+
+    if (*v == NULL || (*v)->nref != 1 || _mnpb_arena != NULL) {
+        mnpb_bytes_decref(v);
+        res = zt ? mnpb_destr(bs, fd, v) : mnpb_debytes(bs, fd, v);
+        BYTES_INCREF(*v);
+        return res;
+    }
+
+    if ((res = mnpb_devarint(bs, fd, &sz)) < 0) {
+        goto end;
+    }
+    if (sz > MNPB_MAX_BYTES) {
+        res = MNPB_ESIZE;
+        goto end;
+    }
+    if (sz == 0) {
+        mnpb_bytes_decref(v);
+        goto end;
+    }
+    while (SAVAIL(bs) < (ssize_t)sz) {
+        if (mnpb_consume(bs, fd) != 0) {
+            res = MNPB_EIO;
+            goto end;
+        }
+    }
+
+    if ((size_t)BSZ(*v) >= sz + zt) {
+        memcpy(BDATA(*v), SPDATA(bs), sz);
+        if (zt) {
+            BDATA(*v)[sz] = '\0';
+        }
+        (*v)->sz = sz + zt;
+        (*v)->hash = 0;
+    } else {
+        mnpb_bytes_decref(v);
+        if ((*v = mnpb_bytes_new(SPDATA(bs), sz, zt)) == NULL) {
+            res = MNPB_EMEMORY;
+            goto end;
+        }
+        BYTES_INCREF(*v);
+    }
+    SADVANCEPOS(bs, sz);
+    res += sz;
+
+end:
+    return res;
+}
+
+
 ssize_t
 mnpb_unpack_string(mnbytestream_t *bs, void *fd, int wtype, mnbytes_t **value)
 {
@@ -1006,9 +1870,7 @@ mnpb_unpack_string(mnbytestream_t *bs, void *fd, int wtype, mnbytes_t **value)
     }
 
     if (wtype == MNPB_WT_LDELIM) {
-        BYTES_DECREF(value);
-        nread = mnpb_destr(bs, fd, value);
-        BYTES_INCREF(*value);
+        nread = mnpb_deldelim_reuse(bs, fd, value, true);
 
     } else {
         nread = MNPB_ETYPE;
@@ -1030,9 +1892,32 @@ mnpb_unpack_bytes(mnbytestream_t *bs, void *fd, int wtype, mnbytes_t **value)
     }
 
     if (wtype == MNPB_WT_LDELIM) {
-        BYTES_DECREF(value);
-        nread = mnpb_debytes(bs, fd, value);
-        BYTES_INCREF(*value);
+        nread = mnpb_deldelim_reuse(bs, fd, value, false);
+
+    } else {
+        nread = MNPB_ETYPE;
+        goto end;
+    }
+
+end:
+    return nread;
+}
+
+
+ssize_t
+mnpb_unpack_view(mnbytestream_t *bs,
+                 void *fd,
+                 int wtype,
+                 mnpb_view_t *value)
+{
+    ssize_t nread;
+
+    if (wtype == -1) {
+        wtype = MNPB_WT_LDELIM;
+    }
+
+    if (wtype == MNPB_WT_LDELIM) {
+        nread = mnpb_deview(bs, fd, value);
 
     } else {
         nread = MNPB_ETYPE;
@@ -1065,34 +1950,69 @@ end:
 }
 
 
+/*
+ * Skip a length-delimited field without copying it out.  The data is
+ * discarded, so there is no MNPB_MAX_BYTES cap.
+ */
 ssize_t
-mnpb_devoid(mnbytestream_t *bs, void *fd, UNUSED uint64_t tag, int wtype)
+mnpb_deskip(mnbytestream_t *bs, void *fd)
 {
     ssize_t res;
-    union {
-        uint64_t i8;
-        uint32_t i4;
-        mnbytes_t *s;
-    } u;
+    uint64_t sz;
 
-    if (wtype == -1) {
-        wtype = MNPB_WT_LDELIM;
+    if ((res = mnpb_devarint(bs, fd, &sz)) < 0) {
+        goto end;
     }
 
-    switch (wtype) {
-        case MNPB_WT_VARINT:
-            res = mnpb_devarint(bs, fd, &u.i8);
-            break;
-
-        case MNPB_WT_64BIT:
-            res = mnpb_defi64(bs, fd, &u.i8);
-            break;
+    while (sz > 0) {
+        ssize_t navail;
 
-        case MNPB_WT_LDELIM:
-            u.s = NULL;
-            res = mnpb_debytes(bs, fd, &u.s);
-            BYTES_DECREF(&u.s);
-            break;
+        if ((navail = SAVAIL(bs)) <= 0) {
+            if (mnpb_consume(bs, fd) != 0) {
+                res = MNPB_EIO;
+                goto end;
+            }
+            continue;
+        }
+        if ((uint64_t)navail > sz) {
+            navail = (ssize_t)sz;
+        }
+        SADVANCEPOS(bs, navail);
+        sz -= (uint64_t)navail;
+        res += navail;
+    }
+
+end:
+    return res;
+}
+
+
+ssize_t
+mnpb_devoid(mnbytestream_t *bs, void *fd, UNUSED uint64_t tag, int wtype)
+{
+    ssize_t res;
+    union {
+        uint64_t i8;
+        uint32_t i4;
+    } u;
+
+    MNPB_STATS_INC(nvoid);
+    if (wtype == -1) {
+        wtype = MNPB_WT_LDELIM;
+    }
+
+    switch (wtype) {
+        case MNPB_WT_VARINT:
+            res = mnpb_devarint(bs, fd, &u.i8);
+            break;
+
+        case MNPB_WT_64BIT:
+            res = mnpb_defi64(bs, fd, &u.i8);
+            break;
+
+        case MNPB_WT_LDELIM:
+            res = mnpb_deskip(bs, fd);
+            break;
 
         case MNPB_WT_32BIT:
             res = mnpb_defi32(bs, fd, &u.i4);
@@ -1104,3 +2024,2365 @@ mnpb_devoid(mnbytestream_t *bs, void *fd, UNUSED uint64_t tag, int wtype)
 
     return res;
 }
+
+
+/*
+ * packed repeated fields; a run length comes off the wire and may be
+ * anything, what does not fit in ssize_t cannot be buffered
+ */
+static ssize_t
+mnpb_need_run(mnbytestream_t *bs, void *fd, size_t len)
+{
+    if (len > SSIZE_MAX) {
+        return MNPB_ESIZE;
+    }
+    while (SAVAIL(bs) < (ssize_t)len) {
+        if (mnpb_consume(bs, fd) != 0) {
+            return MNPB_EIO;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Copy out exactly len bytes, with no length prefix and no
+ * MNPB_MAX_BYTES cap: the raw wire data of an embedded message.  The
+ * length still has to fit the buffer and the copy.
+ */
+ssize_t
+mnpb_deslice(mnbytestream_t *bs, void *fd, size_t len, mnbytes_t **v)
+{
+    ssize_t res;
+
+    if (len > SSIZE_MAX || len > SIZE_MAX - sizeof(mnbytes_t) - 1) {
+        res = MNPB_ESIZE;
+        goto end;
+    }
+    if ((res = mnpb_need_run(bs, fd, len)) != 0) {
+        goto end;
+    }
+
+    if (len == 0) {
+        *v = NULL;
+    } else {
+        if ((*v = mnpb_bytes_new(SPDATA(bs), len, false)) == NULL) {
+            res = MNPB_EMEMORY;
+            goto end;
+        }
+        SADVANCEPOS(bs, len);
+    }
+    res = (ssize_t)len;
+
+end:
+    return res;
+}
+
+
+ssize_t
+mnpb_count_packed_varint(mnbytestream_t *bs, void *fd, size_t len)
+{
+    ssize_t res;
+    const unsigned char *p, *e;
+
+    if ((res = mnpb_need_run(bs, fd, len)) != 0) {
+        goto end;
+    }
+
+    /* one element per terminating byte */
+    p = (const unsigned char *)SPDATA(bs);
+    e = p + len;
+    for (; p + sizeof(uint64_t) <= e; p += sizeof(uint64_t)) {
+        uint64_t w;
+
+        memcpy(&w, p, sizeof(w));
+        res += __builtin_popcountll(~w & 0x8080808080808080ull);
+    }
+    for (; p < e; ++p) {
+        res += !(*p & 0x80);
+    }
+
+end:
+    return res;
+}
+
+
+#define MNPB_PACKED_INT32      0
+#define MNPB_PACKED_INT64      1
+#define MNPB_PACKED_UINT32     2
+#define MNPB_PACKED_UINT64     3
+#define MNPB_PACKED_SINT32     4
+#define MNPB_PACKED_SINT64     5
+#define MNPB_PACKED_BOOL       6
+#define MNPB_PACKED_ENUM       7
+
+static inline void
+mnpb_packed_store(void *out, size_t i, uint64_t v, int kind)
+{
+    switch (kind) {
+    case MNPB_PACKED_INT32:
+        ((int32_t *)out)[i] = (int32_t)(uint32_t)v;
+        break;
+
+    case MNPB_PACKED_INT64:
+        ((int64_t *)out)[i] = (int64_t)v;
+        break;
+
+    case MNPB_PACKED_UINT32:
+        ((uint32_t *)out)[i] = (uint32_t)v;
+        break;
+
+    case MNPB_PACKED_UINT64:
+        ((uint64_t *)out)[i] = v;
+        break;
+
+    case MNPB_PACKED_SINT32:
+        ((int32_t *)out)[i] = ((uint32_t)v >> 1) ^ ((int32_t)(v << 31) >> 31);
+        break;
+
+    case MNPB_PACKED_SINT64:
+        ((int64_t *)out)[i] =
+            (int64_t)((v >> 1) ^ ((int64_t)(v << 63) >> 63));
+        break;
+
+    case MNPB_PACKED_BOOL:
+        ((bool *)out)[i] = (bool)v;
+        break;
+
+    case MNPB_PACKED_ENUM:
+        ((int *)out)[i] = (int)v;
+        break;
+
+    default:
+        FAIL("mnpb_packed_store");
+    }
+}
+
+
+/*
+ * Decode a whole packed run of len bytes into out[0..cap).  The kind
+ * argument is always a constant, so each public wrapper below gets its
+ * own specialized copy of the loop.
+ */
+static inline ssize_t
+mnpb_unpack_packed_varint(mnbytestream_t *bs,
+                          void *fd,
+                          size_t len,
+                          void *out,
+                          size_t cap,
+                          int kind)
+{
+    ssize_t res;
+    const unsigned char *p, *e;
+    size_t i;
+
+    if ((res = mnpb_need_run(bs, fd, len)) != 0) {
+        goto end;
+    }
+
+    p = (const unsigned char *)SPDATA(bs);
+    e = p + len;
+    i = 0;
+
+    while (p < e) {
+        uint64_t v;
+        ssize_t n;
+
+#ifdef MNPB_LITTLE_ENDIAN
+        /*
+         * eight single-byte elements in a row: widen them all at once
+         */
+        if (p + sizeof(uint64_t) <= e && i + sizeof(uint64_t) <= cap) {
+            uint64_t w;
+
+            memcpy(&w, p, sizeof(w));
+            if ((w & 0x8080808080808080ull) == 0) {
+                unsigned j;
+
+                for (j = 0; j < sizeof(uint64_t); ++j) {
+                    mnpb_packed_store(out, i + j, p[j], kind);
+                }
+                i += sizeof(uint64_t);
+                p += sizeof(uint64_t);
+                continue;
+            }
+        }
+#endif
+        if (i >= cap) {
+            res = MNPB_ESIZE;
+            goto end;
+        }
+
+        if (SDATA(bs, SEOD(bs)) - (const char *)p >= MNPB_VARINT_MAXSZ) {
+            if ((n = mnpb_devarint_fast(p, &v)) == 0) {
+                res = MNPB_ESIZE;
+                goto end;
+            }
+        } else {
+            /* the tail of the buffer */
+            v = 0;
+            for (n = 0; p + n < e; ++n) {
+                v |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+                if (!(p[n] & 0x80)) {
+                    break;
+                }
+            }
+            ++n;
+        }
+
+        if (p + n > e) {
+            /* varint straddles the end of the run */
+            res = MNPB_ESIZE;
+            goto end;
+        }
+
+        mnpb_packed_store(out, i, v, kind);
+        ++i;
+        p += n;
+    }
+
+    SADVANCEPOS(bs, len);
+    res = (ssize_t)i;
+
+end:
+    return res;
+}
+
+
+ssize_t
+mnpb_unpack_packed_int32(mnbytestream_t *bs,
+                         void *fd,
+                         size_t len,
+                         int32_t *out,
+                         size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_INT32);
+}
+
+
+ssize_t
+mnpb_unpack_packed_int64(mnbytestream_t *bs,
+                         void *fd,
+                         size_t len,
+                         int64_t *out,
+                         size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_INT64);
+}
+
+
+ssize_t
+mnpb_unpack_packed_uint32(mnbytestream_t *bs,
+                          void *fd,
+                          size_t len,
+                          uint32_t *out,
+                          size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_UINT32);
+}
+
+
+ssize_t
+mnpb_unpack_packed_uint64(mnbytestream_t *bs,
+                          void *fd,
+                          size_t len,
+                          uint64_t *out,
+                          size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_UINT64);
+}
+
+
+ssize_t
+mnpb_unpack_packed_sint32(mnbytestream_t *bs,
+                          void *fd,
+                          size_t len,
+                          int32_t *out,
+                          size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_SINT32);
+}
+
+
+ssize_t
+mnpb_unpack_packed_sint64(mnbytestream_t *bs,
+                          void *fd,
+                          size_t len,
+                          int64_t *out,
+                          size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_SINT64);
+}
+
+
+ssize_t
+mnpb_unpack_packed_bool(mnbytestream_t *bs,
+                        void *fd,
+                        size_t len,
+                        bool *out,
+                        size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_BOOL);
+}
+
+
+ssize_t
+mnpb_unpack_packed_enum(mnbytestream_t *bs,
+                        void *fd,
+                        size_t len,
+                        int *out,
+                        size_t cap)
+{
+    return mnpb_unpack_packed_varint(bs, fd, len, out, cap,
+                                     MNPB_PACKED_ENUM);
+}
+
+
+/*
+ * Fixed-width runs.  Fixed-width values are kept in host byte order on
+ * the wire (see mnpb_enfi32() and friends), so a whole run is a single
+ * copy in either direction.
+ */
+static inline ssize_t
+mnpb_unpack_packed_fixed(mnbytestream_t *bs,
+                         void *fd,
+                         size_t len,
+                         void *out,
+                         size_t cap,
+                         size_t width)
+{
+    ssize_t res;
+
+    if (len > SSIZE_MAX || len % width != 0 || len / width > cap) {
+        res = MNPB_ESIZE;
+        goto end;
+    }
+
+    if ((res = mnpb_need_run(bs, fd, len)) != 0) {
+        goto end;
+    }
+
+    if (len > 0) {
+        memcpy(out, SPDATA(bs), len);
+        SADVANCEPOS(bs, len);
+    }
+    res = (ssize_t)(len / width);
+
+end:
+    return res;
+}
+
+
+ssize_t
+mnpb_unpack_packed_fixed32(mnbytestream_t *bs,
+                           void *fd,
+                           size_t len,
+                           uint32_t *out,
+                           size_t cap)
+{
+    return mnpb_unpack_packed_fixed(bs, fd, len, out, cap, sizeof(*out));
+}
+
+
+ssize_t
+mnpb_unpack_packed_fixed64(mnbytestream_t *bs,
+                           void *fd,
+                           size_t len,
+                           uint64_t *out,
+                           size_t cap)
+{
+    return mnpb_unpack_packed_fixed(bs, fd, len, out, cap, sizeof(*out));
+}
+
+
+ssize_t
+mnpb_unpack_packed_sfixed32(mnbytestream_t *bs,
+                            void *fd,
+                            size_t len,
+                            int32_t *out,
+                            size_t cap)
+{
+    return mnpb_unpack_packed_fixed(bs, fd, len, out, cap, sizeof(*out));
+}
+
+
+ssize_t
+mnpb_unpack_packed_sfixed64(mnbytestream_t *bs,
+                            void *fd,
+                            size_t len,
+                            int64_t *out,
+                            size_t cap)
+{
+    return mnpb_unpack_packed_fixed(bs, fd, len, out, cap, sizeof(*out));
+}
+
+
+ssize_t
+mnpb_unpack_packed_float(mnbytestream_t *bs,
+                         void *fd,
+                         size_t len,
+                         float *out,
+                         size_t cap)
+{
+    return mnpb_unpack_packed_fixed(bs, fd, len, out, cap, sizeof(*out));
+}
+
+
+ssize_t
+mnpb_unpack_packed_double(mnbytestream_t *bs,
+                          void *fd,
+                          size_t len,
+                          double *out,
+                          size_t cap)
+{
+    return mnpb_unpack_packed_fixed(bs, fd, len, out, cap, sizeof(*out));
+}
+
+
+ssize_t
+mnpb_enpacked_fixed(mnbytestream_t *bs, const void *data, size_t len)
+{
+    if (len > 0) {
+        (void)bytestream_cat(bs, len, data);
+    }
+    return (ssize_t)len;
+}
+
+
+/*
+ * Resumable frame decoder.  Input is accumulated in the bytestream
+ * itself, and nothing is consumed until a whole frame is buffered, so
+ * the generated _unpack never has to wait on the source.  The length
+ * prefix is re-scanned from the buffer until it completes, which is
+ * cheaper than carrying a partial varint around.
+ */
+void
+mnpb_decoder_init(mnpb_decoder_t *dec)
+{
+    dec->hdrsz = 0;
+    dec->sz = 0;
+    dec->maxsz = MNPB_MAX_BYTES;
+}
+
+
+/*
+ * Return the size of the next message, with SPOS at its first byte, once
+ * the whole frame is buffered.  Return MNPB_EAGAIN if the source would
+ * block, or if more than budget bytes (0 for no limit) have been read in
+ * this call; call again when there is more input.
+ */
+ssize_t
+mnpb_decoder_next(mnpb_decoder_t *dec,
+                  mnbytestream_t *bs,
+                  void *fd,
+                  size_t budget)
+{
+    ssize_t res;
+    size_t nread;
+
+    nread = 0;
+
+    while (true) {
+        if (dec->hdrsz == 0) {
+            const unsigned char *p;
+            ssize_t i, navail;
+            uint64_t v;
+
+            p = (const unsigned char *)SPDATA(bs);
+            navail = SAVAIL(bs);
+            v = 0;
+            for (i = 0; i < navail && i < MNPB_VARINT_MAXSZ; ++i) {
+                v |= ((uint64_t)(p[i] & 0x7f)) << (i * 7);
+                if (!(p[i] & 0x80)) {
+                    if (v > (uint64_t)dec->maxsz) {
+                        res = MNPB_ESIZE;
+                        goto end;
+                    }
+                    dec->hdrsz = i + 1;
+                    dec->sz = (ssize_t)v;
+                    break;
+                }
+            }
+            if (dec->hdrsz == 0 && i == MNPB_VARINT_MAXSZ) {
+                res = MNPB_ESIZE;
+                goto end;
+            }
+        }
+
+        if (dec->hdrsz > 0 && dec->sz <= SAVAIL(bs) - dec->hdrsz) {
+            SADVANCEPOS(bs, dec->hdrsz);
+            res = dec->sz;
+            dec->hdrsz = 0;
+            dec->sz = 0;
+            goto end;
+        }
+
+        if (budget > 0 && nread >= budget) {
+            res = MNPB_EAGAIN;
+            goto end;
+        }
+
+        res = SEOD(bs);
+        errno = 0;
+        if (mnpb_consume(bs, fd) != 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                res = MNPB_EAGAIN;
+            } else {
+                res = MNPB_EIO;
+            }
+            goto end;
+        }
+        nread += (size_t)(SEOD(bs) - res);
+    }
+
+end:
+    return res;
+}
+
+
+/*
+ * Delimited message streams.  The read side keeps at most one partial
+ * frame in the buffer: it is rewound once drained and compacted once the
+ * consumed head outgrows the free tail, so that the buffer stays about
+ * the size of the largest frame however long the stream is.  Anything
+ * decoded out of the buffer, views included, is only valid until the
+ * next read.  The write side batches frames up to flushsz.
+ */
+void
+mnpb_stream_init(mnpb_stream_t *st, void *fd, size_t flushsz)
+{
+    if (flushsz == 0) {
+        flushsz = 4096;
+    }
+    bytestream_init(&st->bs, flushsz);
+    st->fd = fd;
+    mnpb_decoder_init(&st->dec);
+    st->arena = NULL;
+    st->flushsz = flushsz;
+    st->writing = false;
+}
+
+
+int
+mnpb_stream_fini(mnpb_stream_t *st)
+{
+    int res;
+
+    res = st->writing ? mnpb_stream_flush(st) : 0;
+    bytestream_fini(&st->bs);
+    st->fd = NULL;
+    st->arena = NULL;
+    st->writing = false;
+    return res;
+}
+
+
+ssize_t
+mnpb_stream_next(mnpb_stream_t *st)
+{
+    ssize_t res;
+
+    if (SAVAIL(&st->bs) == 0) {
+        bytestream_rewind(&st->bs);
+
+    } else if (SPOS(&st->bs) > st->bs.buf.sz - SEOD(&st->bs)) {
+        ssize_t navail;
+
+        navail = SAVAIL(&st->bs);
+        memmove(SDATA(&st->bs, 0), SPDATA(&st->bs), navail);
+        SPOS(&st->bs) = 0;
+        SEOD(&st->bs) = navail;
+    }
+
+    if ((res = mnpb_decoder_next(&st->dec, &st->bs, st->fd, 0)) ==
+            MNPB_EIO) {
+        /*
+         * end of input on a frame boundary
+         */
+        if (errno == 0 &&
+                st->dec.hdrsz == 0 &&
+                SAVAIL(&st->bs) == 0) {
+            res = MNPB_EOF;
+        }
+    }
+    return res;
+}
+
+
+int
+mnpb_stream_flush(mnpb_stream_t *st)
+{
+    while (SAVAIL(&st->bs) > 0) {
+        if (bytestream_produce_data(&st->bs, st->fd) != 0) {
+            return MNPB_EIO;
+        }
+    }
+    bytestream_rewind(&st->bs);
+    return 0;
+}
+
+
+/*
+ * Reverse encoding.  A message is written from its last field to its
+ * first into a buffer that grows downward, so that every length prefix
+ * is written after its payload, when its value is already known.  This
+ * needs no _sz pass over the message tree.
+ */
+void
+mnpb_rbuf_init(mnpb_rbuf_t *rb, size_t sz)
+{
+    if ((rb->buf = malloc(sz)) == NULL) {
+        sz = 0;
+    }
+    rb->sz = sz;
+    rb->pos = sz;
+}
+
+
+void
+mnpb_rbuf_fini(mnpb_rbuf_t *rb)
+{
+    free(rb->buf);
+    rb->buf = NULL;
+    rb->sz = 0;
+    rb->pos = 0;
+}
+
+
+void
+mnpb_rbuf_reset(mnpb_rbuf_t *rb)
+{
+    rb->pos = rb->sz;
+}
+
+
+/*
+ * make room for n more bytes below pos, moving the data written so far
+ * to the end of a buffer twice as large
+ */
+static int
+mnpb_rbuf_grow(mnpb_rbuf_t *rb, size_t n)
+{
+    char *buf;
+    size_t sz, len;
+
+    len = rb->sz - rb->pos;
+    sz = rb->sz > 0 ? rb->sz : 64;
+    while (sz - len < n) {
+        sz *= 2;
+    }
+    if ((buf = malloc(sz)) == NULL) {
+        return MNPB_EMEMORY;
+    }
+    if (len > 0) {
+        memcpy(buf + sz - len, rb->buf + rb->pos, len);
+    }
+    free(rb->buf);
+    rb->buf = buf;
+    rb->sz = sz;
+    rb->pos = sz - len;
+    return 0;
+}
+
+
+ssize_t
+mnpb_rendata(mnpb_rbuf_t *rb, const void *data, size_t len)
+{
+    if (MNUNLIKELY(rb->pos < len)) {
+        if (mnpb_rbuf_grow(rb, len) != 0) {
+            return MNPB_EMEMORY;
+        }
+    }
+    rb->pos -= len;
+    if (len > 0) {
+        memcpy(rb->buf + rb->pos, data, len);
+    }
+    return (ssize_t)len;
+}
+
+
+ssize_t
+mnpb_renvarint(mnpb_rbuf_t *rb, uint64_t v)
+{
+    unsigned char *p;
+    ssize_t res;
+
+    if (MNUNLIKELY(rb->pos < MNPB_VARINT_MAXSZ)) {
+        if (mnpb_rbuf_grow(rb, MNPB_VARINT_MAXSZ) != 0) {
+            return MNPB_EMEMORY;
+        }
+    }
+
+    res = mnpb_szvarint(v);
+
+#ifdef MNPB_LITTLE_ENDIAN
+    if (MNLIKELY(v < (1ull << 56))) {
+        uint64_t w;
+
+        /* as in mnpb_envarint(), in the top bytes of the word */
+        w = mnpb_varint_spread(v) |
+            (0x0080808080808080ull >> ((8 - res) * 8));
+        w <<= (8 - res) * 8;
+        memcpy(rb->buf + rb->pos - sizeof(w), &w, sizeof(w));
+        rb->pos -= res;
+        return res;
+    }
+#endif
+
+    rb->pos -= res;
+    p = (unsigned char *)rb->buf + rb->pos;
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p = (unsigned char)v;
+
+    return res;
+}
+
+
+/*
+ * A tag in the same form as for mnpb_entag().  The store covers the
+ * eight bytes below pos, the ones below the tag are free room.
+ */
+ssize_t
+mnpb_rentag(mnpb_rbuf_t *rb, uint64_t tag, size_t sz)
+{
+    if (MNUNLIKELY(rb->pos < sizeof(tag))) {
+        if (mnpb_rbuf_grow(rb, sizeof(tag)) != 0) {
+            return MNPB_EMEMORY;
+        }
+    }
+
+#ifdef MNPB_LITTLE_ENDIAN
+    tag <<= (sizeof(tag) - sz) * 8;
+    memcpy(rb->buf + rb->pos - sizeof(tag), &tag, sizeof(tag));
+#else
+    {
+        unsigned char *p;
+        size_t i;
+
+        p = (unsigned char *)rb->buf + rb->pos - sz;
+        for (i = 0; i < sz; ++i) {
+            p[i] = (unsigned char)(tag >> (i * 8));
+        }
+    }
+#endif
+    rb->pos -= sz;
+
+    return (ssize_t)sz;
+}
+
+
+ssize_t
+mnpb_renzz64(mnpb_rbuf_t *rb, int64_t v)
+{
+    return mnpb_renvarint(rb, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+
+ssize_t
+mnpb_renzz32(mnpb_rbuf_t *rb, int32_t v)
+{
+    return mnpb_renvarint(
+        rb, (uint64_t)((((uint32_t)v) << 1) ^ (uint32_t)(v >> 31)));
+}
+
+
+ssize_t
+mnpb_rpack_int32(mnpb_rbuf_t *rb, int32_t v)
+{
+    return mnpb_renvarint(rb, (uint32_t)v);
+}
+
+
+ssize_t
+mnpb_renfi64(mnpb_rbuf_t *rb, uint64_t v)
+{
+    return mnpb_rendata(rb, &v, sizeof(v));
+}
+
+
+ssize_t
+mnpb_renfi32(mnpb_rbuf_t *rb, uint32_t v)
+{
+    return mnpb_rendata(rb, &v, sizeof(v));
+}
+
+
+ssize_t
+mnpb_rendouble(mnpb_rbuf_t *rb, double v)
+{
+    return mnpb_rendata(rb, &v, sizeof(v));
+}
+
+
+ssize_t
+mnpb_renfloat(mnpb_rbuf_t *rb, float v)
+{
+    return mnpb_rendata(rb, &v, sizeof(v));
+}
+
+
+static ssize_t
+mnpb_renldelim(mnpb_rbuf_t *rb, const void *data, size_t sz)
+{
+    ssize_t res0, res1;
+
+    if ((res0 = mnpb_rendata(rb, data, sz)) < 0) {
+        return res0;
+    }
+    if ((res1 = mnpb_renvarint(rb, sz)) < 0) {
+        return res1;
+    }
+    return res0 + res1;
+}
+
+
+ssize_t
+mnpb_renbytes(mnpb_rbuf_t *rb, mnbytes_t *v)
+{
+    if (v == NULL) {
+        return 0;
+    }
+    return mnpb_renldelim(rb, BCDATA(v), BSZ(v));
+}
+
+
+ssize_t
+mnpb_renstr(mnpb_rbuf_t *rb, mnbytes_t *v)
+{
+    if (v == NULL) {
+        return 0;
+    }
+    assert(BSZ(v) > 0);
+    return mnpb_renldelim(rb, BCDATA(v), BSZ(v) - 1);
+}
+
+
+ssize_t
+mnpb_renview(mnpb_rbuf_t *rb, mnpb_view_t v)
+{
+    if (v.data == NULL) {
+        return 0;
+    }
+    return mnpb_renldelim(rb, v.data, v.sz);
+}
+
+
+/*
+ * Scatter-gather encoding.  Everything is encoded into the scratch
+ * buffer, except string and bytes payloads of at least threshold bytes:
+ * these are held and referenced from their own segment.  Scratch
+ * segments are kept as offsets, since the scratch buffer may move as it
+ * grows, and are resolved by mnpb_iov_vec().
+ */
+struct _mnpb_iov_seg {
+    /* NULL for scratch */
+    mnbytes_t *ref;
+    const char *data;
+    size_t off;
+    size_t sz;
+};
+
+
+int
+mnpb_iov_init(mnpb_iov_t *iov, size_t threshold)
+{
+    int res;
+
+    res = bytestream_init(&iov->scratch, 1024) != 0 ? MNPB_EMEMORY : 0;
+    iov->segs = NULL;
+    iov->nsegs = 0;
+    iov->cap = 0;
+    iov->mark = 0;
+    iov->threshold = threshold;
+    iov->vec = NULL;
+    iov->veccap = 0;
+    return res;
+}
+
+
+static void
+mnpb_iov_release(mnpb_iov_t *iov)
+{
+    size_t i;
+
+    for (i = 0; i < iov->nsegs; ++i) {
+        BYTES_DECREF(&iov->segs[i].ref);
+    }
+    iov->nsegs = 0;
+}
+
+
+void
+mnpb_iov_fini(mnpb_iov_t *iov)
+{
+    mnpb_iov_release(iov);
+    free(iov->segs);
+    iov->segs = NULL;
+    iov->cap = 0;
+    free(iov->vec);
+    iov->vec = NULL;
+    iov->veccap = 0;
+    bytestream_fini(&iov->scratch);
+}
+
+
+void
+mnpb_iov_reset(mnpb_iov_t *iov)
+{
+    mnpb_iov_release(iov);
+    bytestream_rewind(&iov->scratch);
+    iov->mark = 0;
+}
+
+
+static struct _mnpb_iov_seg *
+mnpb_iov_newseg(mnpb_iov_t *iov)
+{
+    if (iov->nsegs == iov->cap) {
+        struct _mnpb_iov_seg *segs;
+        size_t cap;
+
+        cap = iov->cap > 0 ? iov->cap * 2 : 8;
+        if ((segs = realloc(iov->segs, cap * sizeof(*segs))) == NULL) {
+            return NULL;
+        }
+        iov->segs = segs;
+        iov->cap = cap;
+    }
+    return &iov->segs[iov->nsegs++];
+}
+
+
+/*
+ * close the scratch segment written since the last reference
+ */
+static int
+mnpb_iov_flush(mnpb_iov_t *iov)
+{
+    struct _mnpb_iov_seg *seg;
+
+    if (SEOD(&iov->scratch) > iov->mark) {
+        if ((seg = mnpb_iov_newseg(iov)) == NULL) {
+            return MNPB_EMEMORY;
+        }
+        seg->ref = NULL;
+        seg->data = NULL;
+        seg->off = iov->mark;
+        seg->sz = SEOD(&iov->scratch) - iov->mark;
+        iov->mark = SEOD(&iov->scratch);
+    }
+    return 0;
+}
+
+
+/*
+ * length prefix into the scratch buffer, payload by reference; ref is
+ * held until the iov is reset, NULL for no hold
+ */
+static ssize_t
+mnpb_iov_enref(mnpb_iov_t *iov,
+               mnbytes_t *ref,
+               const char *data,
+               size_t sz)
+{
+    struct _mnpb_iov_seg *seg;
+    ssize_t res;
+
+    if ((res = mnpb_envarint(&iov->scratch, sz)) < 0) {
+        return res;
+    }
+    if (mnpb_iov_flush(iov) != 0 ||
+        (seg = mnpb_iov_newseg(iov)) == NULL) {
+        return MNPB_EMEMORY;
+    }
+    seg->ref = ref;
+    BYTES_INCREF(seg->ref);
+    seg->data = data;
+    seg->off = 0;
+    seg->sz = sz;
+
+    return res + (ssize_t)sz;
+}
+
+
+ssize_t
+mnpb_iov_enbytes(mnpb_iov_t *iov, mnbytes_t *v)
+{
+    if (v == NULL || BSZ(v) < iov->threshold) {
+        return mnpb_enbytes(&iov->scratch, v);
+    }
+    return mnpb_iov_enref(iov, v, BCDATA(v), BSZ(v));
+}
+
+
+ssize_t
+mnpb_iov_enstr(mnpb_iov_t *iov, mnbytes_t *v)
+{
+    if (v == NULL || BSZ(v) - 1 < iov->threshold) {
+        return mnpb_enstr(&iov->scratch, v);
+    }
+    return mnpb_iov_enref(iov, v, BCDATA(v), BSZ(v) - 1);
+}
+
+
+/*
+ * views are not held: their input buffer has to be kept anyway
+ */
+ssize_t
+mnpb_iov_enview(mnpb_iov_t *iov, mnpb_view_t v)
+{
+    if (v.data == NULL || v.sz < iov->threshold) {
+        return mnpb_enview(&iov->scratch, v);
+    }
+    return mnpb_iov_enref(iov, NULL, v.data, v.sz);
+}
+
+
+/*
+ * the encoded data so far, as a vector for writev(2) or sendmsg(2),
+ * valid until the next encoding into the iov
+ */
+int
+mnpb_iov_vec(mnpb_iov_t *iov, struct iovec **vec, int *niov)
+{
+    size_t i;
+
+    *vec = NULL;
+    *niov = 0;
+
+    if (mnpb_iov_flush(iov) != 0) {
+        return MNPB_EMEMORY;
+    }
+
+    if (iov->nsegs > iov->veccap) {
+        struct iovec *tmp;
+
+        if ((tmp = realloc(iov->vec, iov->cap * sizeof(*tmp))) == NULL) {
+            return MNPB_EMEMORY;
+        }
+        iov->vec = tmp;
+        iov->veccap = iov->cap;
+    }
+
+    for (i = 0; i < iov->nsegs; ++i) {
+        struct _mnpb_iov_seg *seg;
+
+        seg = &iov->segs[i];
+        if (seg->data == NULL) {
+            iov->vec[i].iov_base = SDATA(&iov->scratch, seg->off);
+        } else {
+            iov->vec[i].iov_base = (void *)seg->data;
+        }
+        iov->vec[i].iov_len = seg->sz;
+    }
+    *vec = iov->vec;
+    *niov = (int)iov->nsegs;
+
+    return 0;
+}
+
+
+/*
+ * Indexed record files.
+ *
+ *  header      "mnpbrec\0", uint32 version, uint32 flags
+ *  records     varint size, message
+ *  padding     to 8 bytes
+ *  index       uint64 offset [, int64 key] per record
+ *  trailer     uint64 index offset, uint64 nrecs, "mnpbidx\0"
+ *
+ * Integers are in host byte order, as are fixed64 fields.  A keyed index
+ * is sorted by key (ties in file order) when the writer finishes, so
+ * that record n is the n-th in key order.  The index is aligned so that
+ * it can be used right out of the mapping.
+ */
+#define MNPB_RECFILE_VERSION (1)
+#define MNPB_RECFILE_HDRSZ (16)
+#define MNPB_RECFILE_TRAILERSZ (24)
+
+struct _mnpb_recent {
+    uint64_t off;
+    int64_t key;
+};
+
+static const char _mnpb_recfile_magic[8] = "mnpbrec";
+static const char _mnpb_recfile_idxmagic[8] = "mnpbidx";
+
+
+void
+mnpb_recwriter_init(mnpb_recwriter_t *w, void *fd, unsigned flags)
+{
+    mnpb_stream_init(&w->st, fd, 0);
+    w->st.writing = true;
+    (void)bytestream_cat(&w->st.bs,
+                         sizeof(_mnpb_recfile_magic),
+                         _mnpb_recfile_magic);
+    SCATI32(&w->st.bs, MNPB_RECFILE_VERSION);
+    SCATI32(&w->st.bs, flags);
+    w->off = MNPB_RECFILE_HDRSZ;
+    w->idx = NULL;
+    w->nidx = 0;
+    w->cap = 0;
+    w->flags = flags;
+}
+
+
+int
+mnpb_recwriter_add(mnpb_recwriter_t *w, int64_t key)
+{
+    if (w->nidx == w->cap) {
+        struct _mnpb_recent *idx;
+        size_t cap;
+
+        cap = w->cap > 0 ? w->cap * 2 : 256;
+        if ((idx = realloc(w->idx, cap * sizeof(*idx))) == NULL) {
+            return MNPB_EMEMORY;
+        }
+        w->idx = idx;
+        w->cap = cap;
+    }
+    w->idx[w->nidx].off = w->off;
+    w->idx[w->nidx].key = key;
+    ++w->nidx;
+    return 0;
+}
+
+
+static int
+mnpb_recent_cmp(const void *a, const void *b)
+{
+    const struct _mnpb_recent *ea, *eb;
+
+    ea = a;
+    eb = b;
+    if (ea->key != eb->key) {
+        return ea->key < eb->key ? -1 : 1;
+    }
+    return ea->off < eb->off ? -1 : ea->off > eb->off;
+}
+
+
+int
+mnpb_recwriter_fini(mnpb_recwriter_t *w)
+{
+    int res;
+    uint64_t idxoff;
+    size_t i;
+
+    res = 0;
+
+    idxoff = (w->off + 7) & ~(uint64_t)7;
+    for (; w->off < idxoff; ++w->off) {
+        SCATC(&w->st.bs, '\0');
+    }
+
+    if (w->flags & MNPB_RECFILE_KEYED) {
+        qsort(w->idx, w->nidx, sizeof(*w->idx), mnpb_recent_cmp);
+    }
+    for (i = 0; i < w->nidx; ++i) {
+        SCATI64(&w->st.bs, w->idx[i].off);
+        if (w->flags & MNPB_RECFILE_KEYED) {
+            SCATI64(&w->st.bs, w->idx[i].key);
+        }
+        if ((size_t)SEOD(&w->st.bs) >= w->st.flushsz &&
+                (res = mnpb_stream_flush(&w->st)) != 0) {
+            goto end;
+        }
+    }
+
+    SCATI64(&w->st.bs, idxoff);
+    SCATI64(&w->st.bs, (uint64_t)w->nidx);
+    (void)bytestream_cat(&w->st.bs,
+                         sizeof(_mnpb_recfile_idxmagic),
+                         _mnpb_recfile_idxmagic);
+    res = mnpb_stream_flush(&w->st);
+
+end:
+    free(w->idx);
+    w->idx = NULL;
+    w->nidx = 0;
+    w->cap = 0;
+    /* flushed above, or failed already */
+    w->st.writing = false;
+    (void)mnpb_stream_fini(&w->st);
+    return res;
+}
+
+
+int
+mnpb_recfile_open(mnpb_recfile_t *rf, const char *path)
+{
+    int res;
+    int fd;
+    struct stat sb;
+    const char *p;
+    uint32_t version, flags;
+    uint64_t idxoff, nrecs, entsz;
+
+    res = 0;
+    memset(rf, 0, sizeof(*rf));
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return MNPB_EIO;
+    }
+    if (fstat(fd, &sb) != 0) {
+        res = MNPB_EIO;
+        goto end;
+    }
+    if (sb.st_size < MNPB_RECFILE_HDRSZ + MNPB_RECFILE_TRAILERSZ) {
+        res = MNPB_ESIZE;
+        goto end;
+    }
+    rf->mapsz = (size_t)sb.st_size;
+    if ((rf->map = mmap(NULL,
+                        rf->mapsz,
+                        PROT_READ,
+                        MAP_PRIVATE,
+                        fd,
+                        0)) == MAP_FAILED) {
+        rf->map = NULL;
+        res = MNPB_EIO;
+        goto end;
+    }
+
+    p = rf->map;
+    memcpy(&version, p + 8, sizeof(version));
+    memcpy(&flags, p + 12, sizeof(flags));
+    if (memcmp(p,
+               _mnpb_recfile_magic,
+               sizeof(_mnpb_recfile_magic)) != 0 ||
+            version != MNPB_RECFILE_VERSION) {
+        res = MNPB_ETYPE;
+        goto end;
+    }
+
+    p = (const char *)rf->map + rf->mapsz - MNPB_RECFILE_TRAILERSZ;
+    memcpy(&idxoff, p, sizeof(idxoff));
+    memcpy(&nrecs, p + 8, sizeof(nrecs));
+    if (memcmp(p + 16,
+               _mnpb_recfile_idxmagic,
+               sizeof(_mnpb_recfile_idxmagic)) != 0) {
+        res = MNPB_ETYPE;
+        goto end;
+    }
+    entsz = (flags & MNPB_RECFILE_KEYED) ? 16 : 8;
+    if (idxoff < MNPB_RECFILE_HDRSZ ||
+            idxoff % 8 != 0 ||
+            idxoff > rf->mapsz - MNPB_RECFILE_TRAILERSZ ||
+            nrecs != (rf->mapsz - MNPB_RECFILE_TRAILERSZ - idxoff) / entsz ||
+            idxoff + nrecs * entsz + MNPB_RECFILE_TRAILERSZ != rf->mapsz) {
+        res = MNPB_ESIZE;
+        goto end;
+    }
+
+    rf->idx = (const uint64_t *)((const char *)rf->map + idxoff);
+    rf->nrecs = (size_t)nrecs;
+    rf->flags = flags;
+
+    rf->bs.buf.data = rf->map;
+    rf->bs.buf.sz = (ssize_t)idxoff;
+    SEOD(&rf->bs) = (off_t)idxoff;
+    SPOS(&rf->bs) = MNPB_RECFILE_HDRSZ;
+
+end:
+    (void)close(fd);
+    if (res != 0) {
+        mnpb_recfile_close(rf);
+    }
+    return res;
+}
+
+
+void
+mnpb_recfile_close(mnpb_recfile_t *rf)
+{
+    if (rf->map != NULL) {
+        (void)munmap(rf->map, rf->mapsz);
+    }
+    memset(rf, 0, sizeof(*rf));
+}
+
+
+/*
+ * position bs, rf->bs or a copy of it, at record n
+ */
+static ssize_t
+mnpb_recfile_seek_bs(mnpb_recfile_t *rf, mnbytestream_t *bs, size_t n)
+{
+    uint64_t off, sz;
+    size_t stride;
+
+    if (n >= rf->nrecs) {
+        return MNPB_ESIZE;
+    }
+    stride = (rf->flags & MNPB_RECFILE_KEYED) ? 2 : 1;
+    off = rf->idx[n * stride];
+    if (off < MNPB_RECFILE_HDRSZ || off >= (uint64_t)SEOD(bs)) {
+        return MNPB_ESIZE;
+    }
+    SPOS(bs) = (off_t)off;
+    if (mnpb_devarint(bs, NULL, &sz) < 0 || sz > (uint64_t)SAVAIL(bs)) {
+        return MNPB_ESIZE;
+    }
+    return (ssize_t)sz;
+}
+
+
+ssize_t
+mnpb_recfile_seek(mnpb_recfile_t *rf, size_t n)
+{
+    return mnpb_recfile_seek_bs(rf, &rf->bs, n);
+}
+
+
+int64_t
+mnpb_recfile_key(mnpb_recfile_t *rf, size_t n)
+{
+    assert(n < rf->nrecs);
+    if (rf->flags & MNPB_RECFILE_KEYED) {
+        return (int64_t)rf->idx[n * 2 + 1];
+    }
+    return (int64_t)n;
+}
+
+
+ssize_t
+mnpb_recfile_find(mnpb_recfile_t *rf, int64_t key)
+{
+    size_t lo, hi;
+
+    if (!(rf->flags & MNPB_RECFILE_KEYED)) {
+        return MNPB_ETYPE;
+    }
+    lo = 0;
+    hi = rf->nrecs;
+    while (lo < hi) {
+        size_t mid;
+
+        mid = lo + (hi - lo) / 2;
+        if ((int64_t)rf->idx[mid * 2 + 1] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (ssize_t)lo;
+}
+
+
+/*
+ * Parallel scan of a record file.  The index already gives every record
+ * boundary, so there is nothing to resynchronize: records are handed out
+ * in chunks from one shared cursor, which balances uneven records and
+ * callbacks as well as per-worker queues would, at the cost of one
+ * atomic add per chunk.  Each worker decodes through its own copy of the
+ * bytestream over the mapping.
+ */
+typedef struct _mnpb_scan {
+    mnpb_recfile_t *rf;
+    mnpb_scan_cb_t cb;
+    void *udata;
+    size_t chunksz;
+    size_t next;
+    int res;
+} mnpb_scan_t;
+
+
+static void *
+mnpb_scan_worker(void *arg)
+{
+    mnpb_scan_t *scan;
+    mnbytestream_t bs;
+
+    scan = arg;
+    bs = scan->rf->bs;
+
+    while (__atomic_load_n(&scan->res, __ATOMIC_RELAXED) == 0) {
+        size_t i, lo, hi;
+
+        lo = __atomic_fetch_add(&scan->next, scan->chunksz, __ATOMIC_RELAXED);
+        if (lo >= scan->rf->nrecs) {
+            break;
+        }
+        hi = lo + scan->chunksz;
+        if (hi > scan->rf->nrecs) {
+            hi = scan->rf->nrecs;
+        }
+        for (i = lo; i < hi; ++i) {
+            ssize_t sz;
+            int res;
+
+            if ((sz = mnpb_recfile_seek_bs(scan->rf, &bs, i)) < 0) {
+                res = (int)sz;
+            } else {
+                res = scan->cb(&bs, sz, i, scan->udata);
+            }
+            if (res != 0) {
+                int expected;
+
+                expected = 0;
+                (void)__atomic_compare_exchange_n(&scan->res,
+                                                  &expected,
+                                                  res,
+                                                  false,
+                                                  __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+int
+mnpb_parallel_scan(mnpb_recfile_t *rf,
+                   int nthreads,
+                   mnpb_scan_cb_t cb,
+                   void *udata)
+{
+    mnpb_scan_t scan;
+    pthread_t *threads;
+    int i, nstarted;
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    scan.rf = rf;
+    scan.cb = cb;
+    scan.udata = udata;
+    /*
+     * about 16 chunks per worker
+     */
+    scan.chunksz = rf->nrecs / ((size_t)nthreads * 16);
+    if (scan.chunksz == 0) {
+        scan.chunksz = 1;
+    } else if (scan.chunksz > 4096) {
+        scan.chunksz = 4096;
+    }
+    scan.next = 0;
+    scan.res = 0;
+
+    /*
+     * the calling thread is one of the workers, and does it all alone
+     * if no other can be started
+     */
+    nstarted = 0;
+    threads = NULL;
+    if (nthreads > 1 &&
+            (threads = malloc((nthreads - 1) * sizeof(*threads))) != NULL) {
+        for (i = 0; i < nthreads - 1; ++i) {
+            if (pthread_create(&threads[i],
+                               NULL,
+                               mnpb_scan_worker,
+                               &scan) != 0) {
+                break;
+            }
+            ++nstarted;
+        }
+    }
+    (void)mnpb_scan_worker(&scan);
+    for (i = 0; i < nstarted; ++i) {
+        (void)pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    return scan.res;
+}
+
+
+/*
+ * Table-driven backend.  The interpreter walks the field descriptors
+ * that mnpbc -T emits for each message, and produces the same encoding
+ * as the unrolled code: scalars equal to zero are skipped, repeated
+ * fields are always packed, and repeated messages go as a single run of
+ * length-prefixed elements.
+ */
+typedef struct _mnpb_tbl_rep {
+    size_t sz;
+    size_t cap;
+    void *data;
+} mnpb_tbl_rep_t;
+
+typedef struct _mnpb_tbl_hdr {
+    ssize_t rawsz;
+    size_t cachedsz;
+} mnpb_tbl_hdr_t;
+
+#define MNPB_TBL_AT(msg, off) ((void *)((char *)(msg) + (off)))
+#define MNPB_TBL_HDR(msg) ((mnpb_tbl_hdr_t *)(msg))
+
+#define MNPB_TBL_FIXED(kind)           \
+    ((kind) == MNPB_TK_DOUBLE ||       \
+     (kind) == MNPB_TK_FLOAT ||        \
+     (kind) == MNPB_TK_FIXED32 ||      \
+     (kind) == MNPB_TK_FIXED64 ||      \
+     (kind) == MNPB_TK_SFIXED32 ||     \
+     (kind) == MNPB_TK_SFIXED64)       \
+
+#define MNPB_TBL_BYTES(kind)           \
+    ((kind) == MNPB_TK_STRING ||       \
+     (kind) == MNPB_TK_BYTES)          \
+
+#define MNPB_TBL_VIEW(kind)            \
+    ((kind) == MNPB_TK_STRVIEW ||      \
+     (kind) == MNPB_TK_BYTESVIEW)      \
+
+
+static bool
+mnpb_tbl_iszero(unsigned kind, const void *p)
+{
+    switch (kind) {
+    case MNPB_TK_DOUBLE:
+        return *(const double *)p == 0;
+    case MNPB_TK_FLOAT:
+        return *(const float *)p == 0;
+    case MNPB_TK_INT32:
+    case MNPB_TK_UINT32:
+    case MNPB_TK_SINT32:
+    case MNPB_TK_FIXED32:
+    case MNPB_TK_SFIXED32:
+        return *(const uint32_t *)p == 0;
+    case MNPB_TK_INT64:
+    case MNPB_TK_UINT64:
+    case MNPB_TK_SINT64:
+    case MNPB_TK_FIXED64:
+    case MNPB_TK_SFIXED64:
+        return *(const uint64_t *)p == 0;
+    case MNPB_TK_BOOL:
+        return !*(const bool *)p;
+    case MNPB_TK_ENUM:
+        return *(const int *)p == 0;
+    case MNPB_TK_STRING:
+    case MNPB_TK_BYTES:
+        return *(mnbytes_t *const *)p == NULL;
+    case MNPB_TK_STRVIEW:
+    case MNPB_TK_BYTESVIEW:
+        return ((const mnpb_view_t *)p)->data == NULL;
+    default:
+        FAIL("mnpb_tbl_iszero");
+    }
+    return true;
+}
+
+
+static ssize_t
+mnpb_tbl_szscalar(unsigned kind, const void *p)
+{
+    switch (kind) {
+    case MNPB_TK_DOUBLE:
+    case MNPB_TK_FIXED64:
+    case MNPB_TK_SFIXED64:
+        return 8;
+    case MNPB_TK_FLOAT:
+    case MNPB_TK_FIXED32:
+    case MNPB_TK_SFIXED32:
+        return 4;
+    case MNPB_TK_INT32:
+        return mnpb_sz_int32(*(const int32_t *)p);
+    case MNPB_TK_INT64:
+        return mnpb_szvarint(*(const int64_t *)p);
+    case MNPB_TK_UINT32:
+        return mnpb_szvarint(*(const uint32_t *)p);
+    case MNPB_TK_UINT64:
+        return mnpb_szvarint(*(const uint64_t *)p);
+    case MNPB_TK_SINT32:
+        return mnpb_szzz32(*(const int32_t *)p);
+    case MNPB_TK_SINT64:
+        return mnpb_szzz64(*(const int64_t *)p);
+    case MNPB_TK_BOOL:
+        return mnpb_szvarint(*(const bool *)p);
+    case MNPB_TK_ENUM:
+        return mnpb_szvarint(*(const int *)p);
+    case MNPB_TK_STRING:
+        return mnpb_szstr(*(mnbytes_t *const *)p);
+    case MNPB_TK_BYTES:
+        return mnpb_szbytes(*(mnbytes_t *const *)p);
+    case MNPB_TK_STRVIEW:
+    case MNPB_TK_BYTESVIEW:
+        return mnpb_szview(*(const mnpb_view_t *)p);
+    default:
+        FAIL("mnpb_tbl_szscalar");
+    }
+    return 0;
+}
+
+
+static ssize_t
+mnpb_tbl_enscalar(mnbytestream_t *bs, unsigned kind, const void *p)
+{
+    switch (kind) {
+    case MNPB_TK_DOUBLE:
+        return mnpb_endouble(bs, *(const double *)p);
+    case MNPB_TK_FLOAT:
+        return mnpb_enfloat(bs, *(const float *)p);
+    case MNPB_TK_INT32:
+        return mnpb_pack_int32(bs, *(const int32_t *)p);
+    case MNPB_TK_INT64:
+        return mnpb_envarint(bs, *(const int64_t *)p);
+    case MNPB_TK_UINT32:
+        return mnpb_envarint(bs, *(const uint32_t *)p);
+    case MNPB_TK_UINT64:
+        return mnpb_envarint(bs, *(const uint64_t *)p);
+    case MNPB_TK_SINT32:
+        return mnpb_enzz32(bs, *(const int32_t *)p);
+    case MNPB_TK_SINT64:
+        return mnpb_enzz64(bs, *(const int64_t *)p);
+    case MNPB_TK_FIXED32:
+    case MNPB_TK_SFIXED32:
+        return mnpb_enfi32(bs, *(const uint32_t *)p);
+    case MNPB_TK_FIXED64:
+    case MNPB_TK_SFIXED64:
+        return mnpb_enfi64(bs, *(const uint64_t *)p);
+    case MNPB_TK_BOOL:
+        return mnpb_envarint(bs, *(const bool *)p);
+    case MNPB_TK_ENUM:
+        return mnpb_envarint(bs, *(const int *)p);
+    case MNPB_TK_STRING:
+        return mnpb_enstr(bs, *(mnbytes_t *const *)p);
+    case MNPB_TK_BYTES:
+        return mnpb_enbytes(bs, *(mnbytes_t *const *)p);
+    case MNPB_TK_STRVIEW:
+    case MNPB_TK_BYTESVIEW:
+        return mnpb_enview(bs, *(const mnpb_view_t *)p);
+    default:
+        FAIL("mnpb_tbl_enscalar");
+    }
+    return 0;
+}
+
+
+static ssize_t
+mnpb_tbl_descalar(mnbytestream_t *bs,
+                  void *fd,
+                  int wtype,
+                  unsigned kind,
+                  void *p)
+{
+    ssize_t res;
+    int64_t v;
+
+    switch (kind) {
+    case MNPB_TK_DOUBLE:
+        return mnpb_unpack_double(bs, fd, wtype, p);
+    case MNPB_TK_FLOAT:
+        return mnpb_unpack_float(bs, fd, wtype, p);
+    case MNPB_TK_INT32:
+        return mnpb_unpack_int32(bs, fd, wtype, p);
+    case MNPB_TK_INT64:
+        return mnpb_unpack_int64(bs, fd, wtype, p);
+    case MNPB_TK_UINT32:
+        return mnpb_unpack_uint32(bs, fd, wtype, p);
+    case MNPB_TK_UINT64:
+        return mnpb_unpack_uint64(bs, fd, wtype, p);
+    case MNPB_TK_SINT32:
+        return mnpb_unpack_sint32(bs, fd, wtype, p);
+    case MNPB_TK_SINT64:
+        return mnpb_unpack_sint64(bs, fd, wtype, p);
+    case MNPB_TK_FIXED32:
+        return mnpb_unpack_fixed32(bs, fd, wtype, p);
+    case MNPB_TK_FIXED64:
+        return mnpb_unpack_fixed64(bs, fd, wtype, p);
+    case MNPB_TK_SFIXED32:
+        return mnpb_unpack_sfixed32(bs, fd, wtype, p);
+    case MNPB_TK_SFIXED64:
+        return mnpb_unpack_sfixed64(bs, fd, wtype, p);
+    case MNPB_TK_BOOL:
+        return mnpb_unpack_bool(bs, fd, wtype, p);
+    case MNPB_TK_ENUM:
+        if ((res = mnpb_unpack_int64(bs, fd, wtype, &v)) >= 0) {
+            *(int *)p = (int)v;
+        }
+        return res;
+    case MNPB_TK_STRING:
+        return mnpb_unpack_string(bs, fd, wtype, p);
+    case MNPB_TK_BYTES:
+        return mnpb_unpack_bytes(bs, fd, wtype, p);
+    case MNPB_TK_STRVIEW:
+    case MNPB_TK_BYTESVIEW:
+        return mnpb_unpack_view(bs, fd, wtype, p);
+    default:
+        FAIL("mnpb_tbl_descalar");
+    }
+    return 0;
+}
+
+
+static ssize_t
+mnpb_tbl_depacked(mnbytestream_t *bs,
+                  void *fd,
+                  size_t len,
+                  unsigned kind,
+                  void *out,
+                  size_t n)
+{
+    switch (kind) {
+    case MNPB_TK_DOUBLE:
+        return mnpb_unpack_packed_double(bs, fd, len, out, n);
+    case MNPB_TK_FLOAT:
+        return mnpb_unpack_packed_float(bs, fd, len, out, n);
+    case MNPB_TK_INT32:
+        return mnpb_unpack_packed_int32(bs, fd, len, out, n);
+    case MNPB_TK_INT64:
+        return mnpb_unpack_packed_int64(bs, fd, len, out, n);
+    case MNPB_TK_UINT32:
+        return mnpb_unpack_packed_uint32(bs, fd, len, out, n);
+    case MNPB_TK_UINT64:
+        return mnpb_unpack_packed_uint64(bs, fd, len, out, n);
+    case MNPB_TK_SINT32:
+        return mnpb_unpack_packed_sint32(bs, fd, len, out, n);
+    case MNPB_TK_SINT64:
+        return mnpb_unpack_packed_sint64(bs, fd, len, out, n);
+    case MNPB_TK_FIXED32:
+        return mnpb_unpack_packed_fixed32(bs, fd, len, out, n);
+    case MNPB_TK_FIXED64:
+        return mnpb_unpack_packed_fixed64(bs, fd, len, out, n);
+    case MNPB_TK_SFIXED32:
+        return mnpb_unpack_packed_sfixed32(bs, fd, len, out, n);
+    case MNPB_TK_SFIXED64:
+        return mnpb_unpack_packed_sfixed64(bs, fd, len, out, n);
+    case MNPB_TK_BOOL:
+        return mnpb_unpack_packed_bool(bs, fd, len, out, n);
+    case MNPB_TK_ENUM:
+        return mnpb_unpack_packed_enum(bs, fd, len, out, n);
+    default:
+        FAIL("mnpb_tbl_depacked");
+    }
+    return 0;
+}
+
+
+static ssize_t
+mnpb_tbl_dumpscalar(mnbytestream_t *bs, unsigned kind, const void *p)
+{
+    switch (kind) {
+    case MNPB_TK_DOUBLE:
+        return mnpb_dumpdouble(bs, *(const double *)p);
+    case MNPB_TK_FLOAT:
+        return mnpb_dumpfloat(bs, *(const float *)p);
+    case MNPB_TK_INT32:
+        return mnpb_dumpvarint(bs, *(const int32_t *)p);
+    case MNPB_TK_INT64:
+        return mnpb_dumpvarint(bs, *(const int64_t *)p);
+    case MNPB_TK_UINT32:
+        return mnpb_dumpvarint(bs, *(const uint32_t *)p);
+    case MNPB_TK_UINT64:
+        return mnpb_dumpvarint(bs, *(const uint64_t *)p);
+    case MNPB_TK_SINT32:
+        return mnpb_dumpzz32(bs, *(const int32_t *)p);
+    case MNPB_TK_SINT64:
+        return mnpb_dumpzz64(bs, *(const int64_t *)p);
+    case MNPB_TK_FIXED32:
+    case MNPB_TK_SFIXED32:
+        return mnpb_dumpfi32(bs, *(const uint32_t *)p);
+    case MNPB_TK_FIXED64:
+    case MNPB_TK_SFIXED64:
+        return mnpb_dumpfi64(bs, *(const uint64_t *)p);
+    case MNPB_TK_BOOL:
+        return mnpb_dumpvarint(bs, *(const bool *)p);
+    case MNPB_TK_ENUM:
+        return mnpb_dumpvarint(bs, *(const int *)p);
+    case MNPB_TK_STRING:
+        return mnpb_dumpstr(bs, *(mnbytes_t *const *)p);
+    case MNPB_TK_BYTES:
+        return mnpb_dumpbytes(bs, *(mnbytes_t *const *)p);
+    case MNPB_TK_STRVIEW:
+        return mnpb_dumpstrview(bs, *(const mnpb_view_t *)p);
+    case MNPB_TK_BYTESVIEW:
+        return mnpb_dumpbytesview(bs, *(const mnpb_view_t *)p);
+    default:
+        FAIL("mnpb_tbl_dumpscalar");
+    }
+    return 0;
+}
+
+
+/*
+ * as <msg>_<field>_alloc(): the new tail is zeroed, string and bytes
+ * elements past sz are kept for reuse unless zero is set
+ */
+static void *
+mnpb_tbl_alloc(mnpb_tbl_rep_t *rep, size_t elsz, size_t n, bool zero)
+{
+    void *res;
+
+    if (n > SIZE_MAX / elsz - rep->sz) {
+        return NULL;
+    }
+    if (rep->sz + n > rep->cap) {
+        size_t cap;
+        void *tmp;
+
+        cap = rep->cap * 2;
+        if (cap < rep->sz + n || cap > SIZE_MAX / elsz) {
+            cap = rep->sz + n;
+        }
+        if ((tmp = mnpb_realloc(rep->data,
+                                elsz * rep->cap,
+                                elsz * cap)) == NULL) {
+            return NULL;
+        }
+        memset((char *)tmp + elsz * rep->cap, 0, elsz * (cap - rep->cap));
+        rep->data = tmp;
+        rep->cap = cap;
+    }
+    res = (char *)rep->data + elsz * rep->sz;
+    if (zero) {
+        memset(res, 0, elsz * n);
+    }
+    rep->sz += n;
+    return res;
+}
+
+
+static const mnpb_field_desc_t *
+mnpb_tbl_lookup(const mnpb_msg_desc_t *desc, uint64_t fnum)
+{
+    size_t lo, hi;
+
+    for (lo = 0, hi = desc->nbyfnum; lo < hi;) {
+        size_t mid;
+        const mnpb_field_desc_t *f;
+
+        mid = lo + (hi - lo) / 2;
+        f = desc->byfnum[mid];
+        if ((uint64_t)f->fnum == fnum) {
+            return f;
+        } else if ((uint64_t)f->fnum < fnum) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+
+static const mnpb_field_desc_t *
+mnpb_tbl_member(const mnpb_field_desc_t *oneof, void *msg)
+{
+    uint64_t fnum;
+    size_t i;
+
+    fnum = *(uint64_t *)MNPB_TBL_AT(msg, oneof->offset);
+    for (i = 0; i < oneof->nmembers; ++i) {
+        if ((uint64_t)oneof->oneof[i].fnum == fnum) {
+            return &oneof->oneof[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void
+mnpb_tbl_release(const mnpb_field_desc_t *f, void *p)
+{
+    if (MNPB_TBL_BYTES(f->kind)) {
+        mnpb_bytes_decref((mnbytes_t **)p);
+    } else if (f->kind == MNPB_TK_MESSAGE) {
+        (void)mnpb_tbl_fini(f->msg, p);
+    }
+}
+
+
+static ssize_t
+mnpb_tbl_unpack_repeated(mnbytestream_t *bs,
+                         void *fd,
+                         int wtype,
+                         const mnpb_field_desc_t *f,
+                         mnpb_tbl_rep_t *rep)
+{
+    ssize_t res, nread, nitems;
+    uint64_t sz;
+    void *item;
+
+    if (wtype != MNPB_WT_LDELIM) {
+        return MNPB_ETYPE;
+    }
+    if ((res = mnpb_devarint(bs, fd, &sz)) < 0) {
+        return res;
+    }
+
+    if (f->kind == MNPB_TK_MESSAGE) {
+        for (nread = 0; nread < (ssize_t)sz;) {
+            ssize_t n;
+            uint64_t esz;
+
+            if ((item = mnpb_tbl_alloc(rep, f->elsz, 1, false)) == NULL) {
+                return MNPB_EMEMORY;
+            }
+            if ((n = mnpb_devarint(bs, fd, &esz)) < 0) {
+                return n;
+            }
+            MNPB_TBL_HDR(item)->rawsz = (ssize_t)esz;
+            nread += n;
+            if ((n = mnpb_tbl_unpack(bs, fd, f->msg, item)) < 0) {
+                return n;
+            }
+            nread += n;
+        }
+        return res + nread;
+
+    } else if (MNPB_TBL_BYTES(f->kind) || MNPB_TBL_VIEW(f->kind)) {
+        for (nread = 0; nread < (ssize_t)sz;) {
+            ssize_t n;
+
+            if ((item = mnpb_tbl_alloc(rep,
+                                       f->elsz,
+                                       1,
+                                       MNPB_TBL_VIEW(f->kind))) == NULL) {
+                return MNPB_EMEMORY;
+            }
+            if ((n = mnpb_tbl_descalar(bs, fd, -1, f->kind, item)) < 0) {
+                return n;
+            }
+            nread += n;
+        }
+        return res + nread;
+    }
+
+    if (MNPB_TBL_FIXED(f->kind)) {
+        if (sz > SSIZE_MAX || sz % f->elsz != 0) {
+            return MNPB_ESIZE;
+        }
+        nitems = (ssize_t)(sz / f->elsz);
+    } else if ((nitems = mnpb_count_packed_varint(bs, fd, sz)) < 0) {
+        return nitems;
+    }
+    item = NULL;
+    if (nitems > 0 &&
+            (item = mnpb_tbl_alloc(rep, f->elsz, nitems, false)) == NULL) {
+        return MNPB_EMEMORY;
+    }
+    if ((nread = mnpb_tbl_depacked(bs,
+                                   fd,
+                                   sz,
+                                   f->kind,
+                                   item,
+                                   (size_t)nitems)) < 0) {
+        return nread;
+    }
+    return res + (ssize_t)sz;
+}
+
+
+static ssize_t
+mnpb_tbl_unpack_field(mnbytestream_t *bs,
+                      void *fd,
+                      int wtype,
+                      const mnpb_field_desc_t *f,
+                      void *msg)
+{
+    ssize_t res, nread;
+    void *p;
+
+    p = MNPB_TBL_AT(msg, f->offset);
+
+    if (f->repeated) {
+        return mnpb_tbl_unpack_repeated(bs, fd, wtype, f, p);
+    }
+
+    /*
+     * a oneof member replaces whichever was there, the union is zeroed
+     * so that no member sees the remains of another
+     */
+    if (f->oneof != NULL) {
+        const mnpb_field_desc_t *cur;
+
+        if ((cur = mnpb_tbl_member(f->oneof, msg)) != NULL) {
+            mnpb_tbl_release(cur, p);
+        }
+        memset(p, 0, f->oneof->elsz);
+        *(uint64_t *)MNPB_TBL_AT(msg, f->oneof->offset) = 0;
+    }
+
+    if (f->kind == MNPB_TK_MESSAGE) {
+        uint64_t sz;
+
+        if (wtype != MNPB_WT_LDELIM) {
+            return MNPB_ETYPE;
+        }
+        if ((res = mnpb_devarint(bs, fd, &sz)) < 0) {
+            return res;
+        }
+        MNPB_TBL_HDR(p)->rawsz = (ssize_t)sz;
+        if ((nread = mnpb_tbl_unpack(bs, fd, f->msg, p)) < 0) {
+            return nread;
+        }
+        res += nread;
+    } else if ((res = mnpb_tbl_descalar(bs, fd, wtype, f->kind, p)) < 0) {
+        return res;
+    }
+
+    if (f->oneof != NULL) {
+        *(uint64_t *)MNPB_TBL_AT(msg, f->oneof->offset) = (uint64_t)f->fnum;
+    }
+    return res;
+}
+
+
+ssize_t
+mnpb_tbl_unpack(mnbytestream_t *bs,
+                void *fd,
+                const mnpb_msg_desc_t *desc,
+                void *msg)
+{
+    ssize_t res = 0;
+    ssize_t nread;
+    MNPB_STATS_ENTER(desc->stats);
+
+    while (res < MNPB_TBL_HDR(msg)->rawsz) {
+        const mnpb_field_desc_t *f;
+        uint64_t tag;
+        int wtype;
+
+        if ((nread = mnpb_unpack_key(bs, fd, &tag, &wtype)) < 0) {
+            res = nread;
+            goto end;
+        }
+        res += nread;
+        if ((f = mnpb_tbl_lookup(desc, tag)) == NULL) {
+            nread = mnpb_devoid(bs, fd, tag, wtype);
+        } else {
+            nread = mnpb_tbl_unpack_field(bs, fd, wtype, f, msg);
+        }
+        if (nread < 0) {
+            res = nread;
+            goto end;
+        }
+        res += nread;
+    }
+
+end:
+    MNPB_STATS_LEAVE(res, 0);
+    return res;
+}
+
+
+/*
+ * encoded size of the elements of a repeated field, without the tag and
+ * the length, from the cached sizes of messages unless update is set
+ */
+static size_t
+mnpb_tbl_szrepeated(const mnpb_field_desc_t *f,
+                    mnpb_tbl_rep_t *rep,
+                    bool update)
+{
+    size_t res, i;
+
+    if (MNPB_TBL_FIXED(f->kind)) {
+        return rep->sz * f->elsz;
+    }
+    for (res = 0, i = 0; i < rep->sz; ++i) {
+        void *item;
+
+        item = (char *)rep->data + f->elsz * i;
+        if (f->kind == MNPB_TK_MESSAGE) {
+            size_t esz;
+
+            esz = update ?
+                mnpb_tbl_sz(f->msg, item) :
+                MNPB_TBL_HDR(item)->cachedsz;
+            res += mnpb_szvarint(esz) + esz;
+        } else {
+            res += mnpb_tbl_szscalar(f->kind, item);
+        }
+    }
+    return res;
+}
+
+
+static ssize_t
+mnpb_tbl_pack_value(mnbytestream_t *bs,
+                    const mnpb_field_desc_t *f,
+                    void *p,
+                    bool always)
+{
+    ssize_t res, nwritten;
+    size_t sz;
+
+    if (f->kind == MNPB_TK_MESSAGE) {
+        sz = MNPB_TBL_HDR(p)->cachedsz;
+        if (sz == 0 && !always) {
+            return 0;
+        }
+        if ((res = mnpb_entag(bs, f->tagword, f->tagsz)) < 0) {
+            return res;
+        }
+        if ((nwritten = mnpb_envarint(bs, sz)) < 0) {
+            return nwritten;
+        }
+        res += nwritten;
+        if ((nwritten = mnpb_tbl_pack_cached(bs, f->msg, p)) < 0) {
+            return nwritten;
+        }
+        return res + nwritten;
+    }
+
+    if (mnpb_tbl_iszero(f->kind, p)) {
+        return 0;
+    }
+    if ((res = mnpb_entag(bs, f->tagword, f->tagsz)) < 0) {
+        return res;
+    }
+    if ((nwritten = mnpb_tbl_enscalar(bs, f->kind, p)) < 0) {
+        return nwritten;
+    }
+    return res + nwritten;
+}
+
+
+static ssize_t
+mnpb_tbl_pack_repeated(mnbytestream_t *bs,
+                       const mnpb_field_desc_t *f,
+                       mnpb_tbl_rep_t *rep)
+{
+    ssize_t res, nwritten;
+    size_t sz, i;
+
+    if ((sz = mnpb_tbl_szrepeated(f, rep, false)) == 0) {
+        return 0;
+    }
+    if ((res = mnpb_entag(bs, f->tagword, f->tagsz)) < 0) {
+        return res;
+    }
+    if ((nwritten = mnpb_envarint(bs, sz)) < 0) {
+        return nwritten;
+    }
+    res += nwritten;
+
+    if (MNPB_TBL_FIXED(f->kind)) {
+        if ((nwritten = mnpb_enpacked_fixed(bs, rep->data, sz)) < 0) {
+            return nwritten;
+        }
+        return res + nwritten;
+    }
+
+    for (i = 0; i < rep->sz; ++i) {
+        void *item;
+
+        item = (char *)rep->data + f->elsz * i;
+        if (f->kind == MNPB_TK_MESSAGE) {
+            if ((nwritten = mnpb_envarint(
+                            bs, MNPB_TBL_HDR(item)->cachedsz)) < 0) {
+                return nwritten;
+            }
+            res += nwritten;
+            nwritten = mnpb_tbl_pack_cached(bs, f->msg, item);
+        } else {
+            nwritten = mnpb_tbl_enscalar(bs, f->kind, item);
+        }
+        if (nwritten < 0) {
+            return nwritten;
+        }
+        res += nwritten;
+    }
+    return res;
+}
+
+
+ssize_t
+mnpb_tbl_pack_cached(mnbytestream_t *bs,
+                     const mnpb_msg_desc_t *desc,
+                     void *msg)
+{
+    ssize_t res = 0;
+    ssize_t nwritten;
+    size_t i;
+    MNPB_STATS_ENTER(desc->stats);
+
+    for (i = 0; i < desc->nfields; ++i) {
+        const mnpb_field_desc_t *f;
+        void *p;
+
+        f = &desc->fields[i];
+        p = MNPB_TBL_AT(msg, f->offset);
+        if (f->kind == MNPB_TK_ONEOF) {
+            if ((f = mnpb_tbl_member(f, msg)) == NULL) {
+                continue;
+            }
+            nwritten = mnpb_tbl_pack_value(bs,
+                                           f,
+                                           MNPB_TBL_AT(msg, f->offset),
+                                           true);
+        } else if (f->repeated) {
+            nwritten = mnpb_tbl_pack_repeated(bs, f, p);
+        } else {
+            nwritten = mnpb_tbl_pack_value(bs, f, p, false);
+        }
+        if (nwritten < 0) {
+            res = nwritten;
+            goto end;
+        }
+        res += nwritten;
+    }
+
+end:
+    MNPB_STATS_LEAVE(res, 1);
+    return res;
+}
+
+
+static size_t
+mnpb_tbl_szvalue(const mnpb_field_desc_t *f, void *p, bool always)
+{
+    size_t n;
+
+    if (f->kind == MNPB_TK_MESSAGE) {
+        if ((n = mnpb_tbl_sz(f->msg, p)) == 0 && !always) {
+            return 0;
+        }
+        return f->tagsz + mnpb_szvarint(n) + n;
+    }
+    if (mnpb_tbl_iszero(f->kind, p)) {
+        return 0;
+    }
+    return f->tagsz + mnpb_tbl_szscalar(f->kind, p);
+}
+
+
+size_t
+mnpb_tbl_sz(const mnpb_msg_desc_t *desc, void *msg)
+{
+    size_t res, i;
+
+    for (res = 0, i = 0; i < desc->nfields; ++i) {
+        const mnpb_field_desc_t *f;
+        void *p;
+
+        f = &desc->fields[i];
+        p = MNPB_TBL_AT(msg, f->offset);
+        if (f->kind == MNPB_TK_ONEOF) {
+            if ((f = mnpb_tbl_member(f, msg)) != NULL) {
+                res += mnpb_tbl_szvalue(f,
+                                        MNPB_TBL_AT(msg, f->offset),
+                                        true);
+            }
+        } else if (f->repeated) {
+            size_t n;
+
+            if ((n = mnpb_tbl_szrepeated(f, p, true)) > 0) {
+                res += f->tagsz + mnpb_szvarint(n) + n;
+            }
+        } else {
+            res += mnpb_tbl_szvalue(f, p, false);
+        }
+    }
+    MNPB_TBL_HDR(msg)->cachedsz = res;
+    return res;
+}
+
+
+int
+mnpb_tbl_fini(const mnpb_msg_desc_t *desc, void *msg)
+{
+    size_t i;
+
+    for (i = 0; i < desc->nfields; ++i) {
+        const mnpb_field_desc_t *f;
+        void *p;
+
+        f = &desc->fields[i];
+        p = MNPB_TBL_AT(msg, f->offset);
+        if (f->kind == MNPB_TK_ONEOF) {
+            if ((f = mnpb_tbl_member(f, msg)) != NULL) {
+                mnpb_tbl_release(f, MNPB_TBL_AT(msg, f->offset));
+            }
+        } else if (f->repeated) {
+            mnpb_tbl_rep_t *rep;
+
+            rep = p;
+            if (rep->data != NULL) {
+                size_t j;
+
+                /* up to cap, kept elements included */
+                for (j = 0; j < rep->cap; ++j) {
+                    mnpb_tbl_release(f, (char *)rep->data + f->elsz * j);
+                }
+                mnpb_free(rep->data);
+                rep->data = NULL;
+                rep->sz = 0;
+                rep->cap = 0;
+            }
+        } else {
+            mnpb_tbl_release(f, p);
+        }
+    }
+    return 0;
+}
+
+
+static ssize_t
+mnpb_tbl_dump_value(mnbytestream_t *bs, const mnpb_field_desc_t *f, void *p)
+{
+    if (f->kind == MNPB_TK_MESSAGE) {
+        return mnpb_tbl_dump(bs, f->msg, p);
+    }
+    return mnpb_tbl_dumpscalar(bs, f->kind, p);
+}
+
+
+ssize_t
+mnpb_tbl_dump(mnbytestream_t *bs, const mnpb_msg_desc_t *desc, void *msg)
+{
+    ssize_t res = 0;
+    size_t i;
+
+    res += bytestream_cat(bs, 2, "{ ");
+    for (i = 0; i < desc->nfields; ++i) {
+        const mnpb_field_desc_t *f;
+        void *p;
+
+        f = &desc->fields[i];
+        p = MNPB_TBL_AT(msg, f->offset);
+        res += bytestream_nprintf(bs,
+                                  1024,
+                                  "%"PRId64":%s:%s=",
+                                  f->fnum,
+                                  MNPB_WT_CHAR(f->wtype),
+                                  f->name);
+        if (f->kind == MNPB_TK_ONEOF) {
+            if ((f = mnpb_tbl_member(f, msg)) != NULL) {
+                res += bytestream_nprintf(bs,
+                                          1024,
+                                          "%"PRId64":%s:%s=",
+                                          f->fnum,
+                                          MNPB_WT_CHAR(f->wtype),
+                                          f->name);
+                res += mnpb_tbl_dump_value(bs,
+                                           f,
+                                           MNPB_TBL_AT(msg, f->offset));
+            }
+        } else if (f->repeated) {
+            mnpb_tbl_rep_t *rep;
+            size_t j;
+
+            rep = p;
+            res += bytestream_cat(bs, 2, "[ ");
+            for (j = 0; j < rep->sz; ++j) {
+                res += mnpb_tbl_dump_value(bs,
+                                           f,
+                                           (char *)rep->data + f->elsz * j);
+                res += bytestream_cat(bs, 1, " ");
+            }
+            res += bytestream_cat(bs, 2, "] ");
+        } else {
+            res += mnpb_tbl_dump_value(bs, f, p);
+        }
+        res += bytestream_cat(bs, 1, " ");
+    }
+    res += bytestream_cat(bs, 3, "} ");
+    SADVANCEEOD(bs, -1);
+    return res;
+}
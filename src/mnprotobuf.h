@@ -2,6 +2,7 @@
 #define MNPROTOBUF_H_DEFINED
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <mncommon/array.h>
 #include <mncommon/hash.h>
@@ -20,39 +21,110 @@ extern "C" {
 #define MNPB_ESIZE     (-3)
 #define MNPB_ETYPE     (-4)
 #define MNPB_EMEMORY   (-5)
+#define MNPB_EAGAIN    (-6)
+#define MNPB_EOF       (-7)
+
+/* longest varint encoding of a 64-bit value */
+#define MNPB_VARINT_MAXSZ (10)
+
+/*
+ * encoded sizes, inline so that _sz of scalar fields folds into a few
+ * adds and compares
+ */
+static inline ssize_t
+mnpb_szvarint(uint64_t v)
+{
+#if defined(__GNUC__)
+    /* one byte per started seven significant bits, at least one */
+    return ((64 - __builtin_clzll(v | 1)) * 9 + 64) >> 6;
+#else
+    ssize_t res;
+
+    for (res = 1; v >= 0x80; v >>= 7) {
+        ++res;
+    }
+    return res;
+#endif
+}
+
+
+static inline ssize_t
+mnpb_szzz64(int64_t v)
+{
+    return mnpb_szvarint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+
+static inline ssize_t
+mnpb_szzz32(int32_t v)
+{
+    return mnpb_szvarint((((uint32_t)v) << 1) ^ (uint32_t)(v >> 31));
+}
+
+
+static inline ssize_t
+mnpb_sz_int32(int32_t v)
+{
+    return mnpb_szvarint((uint32_t)v);
+}
+
+
+static inline ssize_t
+mnpb_szfi64(uint64_t v)
+{
+    return sizeof(v);
+}
+
+
+static inline ssize_t
+mnpb_szfi32(uint32_t v)
+{
+    return sizeof(v);
+}
+
+
+static inline ssize_t
+mnpb_szdouble(double v)
+{
+    return sizeof(v);
+}
+
+
+static inline ssize_t
+mnpb_szfloat(float v)
+{
+    return sizeof(v);
+}
+
+
 ssize_t mnpb_devarint(mnbytestream_t *, void *, uint64_t *);
 ssize_t mnpb_envarint(mnbytestream_t *, uint64_t);
-ssize_t mnpb_szvarint(uint64_t);
+/* key precomputed by mnpbc as its varint bytes, first byte lowest */
+ssize_t mnpb_entag(mnbytestream_t *, uint64_t, size_t);
 ssize_t mnpb_dumpvarint(mnbytestream_t *, uint64_t);
 
 ssize_t mnpb_dezz64(mnbytestream_t *, void *, int64_t *);
 ssize_t mnpb_enzz64(mnbytestream_t *, int64_t);
-ssize_t mnpb_szzz64(int64_t);
 ssize_t mnpb_dumpzz64(mnbytestream_t *, int64_t);
 
 ssize_t mnpb_dezz32(mnbytestream_t *, void *, int32_t *);
 ssize_t mnpb_enzz32(mnbytestream_t *, int32_t);
-ssize_t mnpb_szzz32(int32_t);
 ssize_t mnpb_dumpzz32(mnbytestream_t *, int32_t);
 
 ssize_t mnpb_defi64(mnbytestream_t *, void *, uint64_t *);
 ssize_t mnpb_enfi64(mnbytestream_t *, uint64_t);
-ssize_t mnpb_szfi64(uint64_t);
 ssize_t mnpb_dumpfi64(mnbytestream_t *, uint64_t);
 
 ssize_t mnpb_defi32(mnbytestream_t *, void *, uint32_t *);
 ssize_t mnpb_enfi32(mnbytestream_t *, uint32_t);
-ssize_t mnpb_szfi32(uint32_t);
 ssize_t mnpb_dumpfi32(mnbytestream_t *, uint32_t);
 
 ssize_t mnpb_dedouble(mnbytestream_t *, void *, double *);
 ssize_t mnpb_endouble(mnbytestream_t *, double);
-ssize_t mnpb_szdouble(double);
 ssize_t mnpb_dumpdouble(mnbytestream_t *, double);
 
 ssize_t mnpb_defloat(mnbytestream_t *, void *, float *);
 ssize_t mnpb_enfloat(mnbytestream_t *, float);
-ssize_t mnpb_szfloat(float);
 ssize_t mnpb_dumpfloat(mnbytestream_t *, float);
 
 ssize_t mnpb_debytes(mnbytestream_t *, void *, mnbytes_t **);
@@ -66,6 +138,24 @@ ssize_t mnpb_szbytes(mnbytes_t *);
 ssize_t mnpb_szstr(mnbytes_t *);
 ssize_t mnpb_dumpbytes(mnbytestream_t *, mnbytes_t *);
 ssize_t mnpb_dumpstr(mnbytestream_t *, mnbytes_t *);
+/* skip over, no allocation, no size limit */
+ssize_t mnpb_deskip(mnbytestream_t *, void *);
+/* exactly that many bytes, no length prefix, no size limit */
+ssize_t mnpb_deslice(mnbytestream_t *, void *, size_t, mnbytes_t **);
+
+/*
+ * string or bytes in place, within the input buffer, no terminating zero
+ */
+typedef struct _mnpb_view {
+    const char *data;
+    size_t sz;
+} mnpb_view_t;
+
+ssize_t mnpb_deview(mnbytestream_t *, void *, mnpb_view_t *);
+ssize_t mnpb_enview(mnbytestream_t *, mnpb_view_t);
+ssize_t mnpb_szview(mnpb_view_t);
+ssize_t mnpb_dumpbytesview(mnbytestream_t *, mnpb_view_t);
+ssize_t mnpb_dumpstrview(mnbytestream_t *, mnpb_view_t);
 
 ssize_t mnpb_deldelim(mnbytestream_t *,
                        void *,
@@ -78,7 +168,6 @@ ssize_t mnpb_enldelim(mnbytestream_t *,
 
 
 ssize_t mnpb_pack_int32(mnbytestream_t *, int32_t);
-ssize_t mnpb_sz_int32(int32_t);
 
 ssize_t mnpb_unpack_double(mnbytestream_t *, void *, int, double *);
 ssize_t mnpb_unpack_float(mnbytestream_t *, void *, int, float *);
@@ -95,9 +184,481 @@ ssize_t mnpb_unpack_sfixed64(mnbytestream_t *, void *, int, int64_t *);
 ssize_t mnpb_unpack_bool(mnbytestream_t *, void *, int, bool *);
 ssize_t mnpb_unpack_string(mnbytestream_t *, void *, int, mnbytes_t **);
 ssize_t mnpb_unpack_bytes(mnbytestream_t *, void *, int, mnbytes_t **);
+ssize_t mnpb_unpack_view(mnbytestream_t *, void *, int, mnpb_view_t *);
 ssize_t mnpb_unpack_key(mnbytestream_t *, void *f, uint64_t *, int *);
 ssize_t mnpb_devoid(mnbytestream_t *, void *, uint64_t, int);
 
+/*
+ * the next key in the buffer is the given one, precomputed as for
+ * mnpb_entag(), consumed if so; false if it is not buffered yet, the
+ * caller then falls back to mnpb_unpack_key()
+ */
+static inline bool
+mnpb_match_tag(mnbytestream_t *bs, uint64_t key, size_t sz)
+{
+    const unsigned char *p;
+    size_t i;
+
+    if (SAVAIL(bs) < (ssize_t)sz) {
+        return false;
+    }
+    p = (const unsigned char *)SPDATA(bs);
+    for (i = 0; i < sz; ++i) {
+        if (p[i] != ((key >> (i * 8)) & 0xff)) {
+            return false;
+        }
+    }
+    SADVANCEPOS(bs, sz);
+    return true;
+}
+
+/*
+ * packed repeated fields: decode a whole run of len bytes into an array
+ * of cap elements, return the number of elements decoded
+ */
+ssize_t mnpb_count_packed_varint(mnbytestream_t *, void *, size_t);
+ssize_t mnpb_unpack_packed_int32(mnbytestream_t *,
+                                 void *,
+                                 size_t,
+                                 int32_t *,
+                                 size_t);
+ssize_t mnpb_unpack_packed_int64(mnbytestream_t *,
+                                 void *,
+                                 size_t,
+                                 int64_t *,
+                                 size_t);
+ssize_t mnpb_unpack_packed_uint32(mnbytestream_t *,
+                                  void *,
+                                  size_t,
+                                  uint32_t *,
+                                  size_t);
+ssize_t mnpb_unpack_packed_uint64(mnbytestream_t *,
+                                  void *,
+                                  size_t,
+                                  uint64_t *,
+                                  size_t);
+ssize_t mnpb_unpack_packed_sint32(mnbytestream_t *,
+                                  void *,
+                                  size_t,
+                                  int32_t *,
+                                  size_t);
+ssize_t mnpb_unpack_packed_sint64(mnbytestream_t *,
+                                  void *,
+                                  size_t,
+                                  int64_t *,
+                                  size_t);
+ssize_t mnpb_unpack_packed_bool(mnbytestream_t *,
+                                void *,
+                                size_t,
+                                bool *,
+                                size_t);
+/* enums are int-sized */
+ssize_t mnpb_unpack_packed_enum(mnbytestream_t *,
+                                void *,
+                                size_t,
+                                int *,
+                                size_t);
+
+/*
+ * packed fixed-width fields: len must be a multiple of the element size
+ */
+ssize_t mnpb_unpack_packed_fixed32(mnbytestream_t *,
+                                   void *,
+                                   size_t,
+                                   uint32_t *,
+                                   size_t);
+ssize_t mnpb_unpack_packed_fixed64(mnbytestream_t *,
+                                   void *,
+                                   size_t,
+                                   uint64_t *,
+                                   size_t);
+ssize_t mnpb_unpack_packed_sfixed32(mnbytestream_t *,
+                                    void *,
+                                    size_t,
+                                    int32_t *,
+                                    size_t);
+ssize_t mnpb_unpack_packed_sfixed64(mnbytestream_t *,
+                                    void *,
+                                    size_t,
+                                    int64_t *,
+                                    size_t);
+ssize_t mnpb_unpack_packed_float(mnbytestream_t *,
+                                 void *,
+                                 size_t,
+                                 float *,
+                                 size_t);
+ssize_t mnpb_unpack_packed_double(mnbytestream_t *,
+                                  void *,
+                                  size_t,
+                                  double *,
+                                  size_t);
+ssize_t mnpb_enpacked_fixed(mnbytestream_t *, const void *, size_t);
+
+/*
+ * arena allocation of decoded message trees: messages decoded with
+ * <msg>_unpack_arena() are released with mnpb_arena_reset() or
+ * mnpb_arena_fini(), never with <msg>_fini() or <msg>_destroy(); what
+ * the decoder replaces, a oneof member met twice, stays in the arena
+ * until then
+ */
+struct _mnpb_arena_chunk;
+
+typedef struct _mnpb_arena {
+    struct _mnpb_arena_chunk *chunks;
+    char *pos;
+    char *end;
+    size_t chunksz;
+} mnpb_arena_t;
+
+void mnpb_arena_init(mnpb_arena_t *, size_t);
+void mnpb_arena_fini(mnpb_arena_t *);
+void mnpb_arena_reset(mnpb_arena_t *);
+void *mnpb_arena_alloc(mnpb_arena_t *, size_t);
+void *mnpb_arena_realloc(mnpb_arena_t *, void *, size_t, size_t);
+/* make the arena current for this thread, return the previous one */
+mnpb_arena_t *mnpb_arena_enter(mnpb_arena_t *);
+/*
+ * allocator under the runtime and generated code: message structs from
+ * <msg>_new(), repeated arrays, and decoded strings and bytes.  Memory
+ * is released under the allocator it came from, so a message is
+ * finalized with the one it was decoded or built with entered.  realloc
+ * gets the old size, free may be NULL for allocators that release in
+ * bulk.
+ */
+typedef struct _mnpb_allocator {
+    void *(*alloc)(void *, size_t);
+    void *(*realloc)(void *, void *, size_t, size_t);
+    void (*free)(void *, void *);
+    void *ctx;
+} mnpb_allocator_t;
+
+/* make the allocator current for this thread, return the previous one */
+const mnpb_allocator_t *mnpb_allocator_enter(const mnpb_allocator_t *);
+/* from the current allocator if any, else the heap */
+void *mnpb_malloc(size_t);
+/* a no-op under the current arena, see mnpb_realloc() */
+void mnpb_free(void *);
+/* from the current arena if any, else as mnpb_malloc() */
+void *mnpb_realloc(void *, size_t, size_t);
+/* a copy of sz bytes of data, NUL-terminated if zt, as decoded */
+mnbytes_t *mnpb_bytes_new(const char *, size_t, bool);
+/* BYTES_DECREF() releasing through the current allocator */
+void mnpb_bytes_decref(mnbytes_t **);
+
+/*
+ * projected decoding with <msg>_unpack_projected(): fields are selected
+ * in a struct <msg>_mask by their <MSG>_MASK_<field> bit
+ */
+#define MNPB_MASK_SET(mask, bit) \
+    ((mask)->bits[(bit) / 64] |= (uint64_t)1 << ((bit) % 64))
+#define MNPB_MASK_ISSET(mask, bit) \
+    (((mask)->bits[(bit) / 64] >> ((bit) % 64)) & 1)
+
+/*
+ * resumable decoding of length-delimited frames (varint size + message)
+ * from a non-blocking source
+ */
+typedef struct _mnpb_decoder {
+    /* size of the length prefix, or 0 while it has not arrived yet */
+    ssize_t hdrsz;
+    /* message size */
+    ssize_t sz;
+    /*
+     * largest message size accepted, larger ones fail with MNPB_ESIZE;
+     * MNPB_MAX_BYTES after mnpb_decoder_init(), may be changed then
+     */
+    ssize_t maxsz;
+} mnpb_decoder_t;
+
+void mnpb_decoder_init(mnpb_decoder_t *);
+ssize_t mnpb_decoder_next(mnpb_decoder_t *, mnbytestream_t *, void *, size_t);
+
+/*
+ * streams of length-delimited messages over a blocking source or sink,
+ * one buffer serves the whole stream; a stream is used either for
+ * reading with <msg>_stream_read() or for writing with
+ * <msg>_stream_write(), not both
+ */
+typedef struct _mnpb_stream {
+    mnbytestream_t bs;
+    void *fd;
+    mnpb_decoder_t dec;
+    /*
+     * when not NULL, <msg>_stream_read() resets it and decodes into it,
+     * see mnpb_arena_t
+     */
+    mnpb_arena_t *arena;
+    /* buffered output is written out once it reaches flushsz */
+    size_t flushsz;
+    /* set by <msg>_stream_write() */
+    bool writing;
+} mnpb_stream_t;
+
+void mnpb_stream_init(mnpb_stream_t *, void *, size_t);
+/*
+ * a writing stream flushes what is still buffered first, and returns
+ * MNPB_EIO if that fails; the stream is released either way
+ */
+int mnpb_stream_fini(mnpb_stream_t *);
+/* frame size, MNPB_EOF at the end of the stream */
+ssize_t mnpb_stream_next(mnpb_stream_t *);
+int mnpb_stream_flush(mnpb_stream_t *);
+
+/*
+ * reverse encoding: the buffer is filled from its end downward, the
+ * encoded data is MNPB_RBUF_LEN() bytes at MNPB_RBUF_DATA()
+ */
+typedef struct _mnpb_rbuf {
+    char *buf;
+    size_t sz;
+    size_t pos;
+} mnpb_rbuf_t;
+
+#define MNPB_RBUF_DATA(rb) ((rb)->buf + (rb)->pos)
+#define MNPB_RBUF_LEN(rb) ((rb)->sz - (rb)->pos)
+
+void mnpb_rbuf_init(mnpb_rbuf_t *, size_t);
+void mnpb_rbuf_fini(mnpb_rbuf_t *);
+void mnpb_rbuf_reset(mnpb_rbuf_t *);
+/* as is, no length prefix */
+ssize_t mnpb_rendata(mnpb_rbuf_t *, const void *, size_t);
+ssize_t mnpb_renvarint(mnpb_rbuf_t *, uint64_t);
+ssize_t mnpb_rentag(mnpb_rbuf_t *, uint64_t, size_t);
+ssize_t mnpb_renzz64(mnpb_rbuf_t *, int64_t);
+ssize_t mnpb_renzz32(mnpb_rbuf_t *, int32_t);
+ssize_t mnpb_rpack_int32(mnpb_rbuf_t *, int32_t);
+ssize_t mnpb_renfi64(mnpb_rbuf_t *, uint64_t);
+ssize_t mnpb_renfi32(mnpb_rbuf_t *, uint32_t);
+ssize_t mnpb_rendouble(mnpb_rbuf_t *, double);
+ssize_t mnpb_renfloat(mnpb_rbuf_t *, float);
+ssize_t mnpb_renbytes(mnpb_rbuf_t *, mnbytes_t *);
+/* removing terminating zero */
+ssize_t mnpb_renstr(mnpb_rbuf_t *, mnbytes_t *);
+ssize_t mnpb_renview(mnpb_rbuf_t *, mnpb_view_t);
+
+/*
+ * scatter-gather encoding for writev(2): string and bytes payloads of
+ * at least threshold bytes are referenced, and held until
+ * mnpb_iov_reset() or mnpb_iov_fini(), everything else is encoded into
+ * the scratch buffer
+ */
+struct _mnpb_iov_seg;
+
+typedef struct _mnpb_iov {
+    mnbytestream_t scratch;
+    struct _mnpb_iov_seg *segs;
+    size_t nsegs;
+    size_t cap;
+    /* end of the last closed scratch segment */
+    off_t mark;
+    size_t threshold;
+    struct iovec *vec;
+    size_t veccap;
+} mnpb_iov_t;
+
+int mnpb_iov_init(mnpb_iov_t *, size_t);
+void mnpb_iov_fini(mnpb_iov_t *);
+void mnpb_iov_reset(mnpb_iov_t *);
+/* MNPB_EMEMORY on failure, an empty iov gives no entries */
+int mnpb_iov_vec(mnpb_iov_t *, struct iovec **, int *);
+ssize_t mnpb_iov_enbytes(mnpb_iov_t *, mnbytes_t *);
+/* removing terminating zero */
+ssize_t mnpb_iov_enstr(mnpb_iov_t *, mnbytes_t *);
+ssize_t mnpb_iov_enview(mnpb_iov_t *, mnpb_view_t);
+
+/*
+ * indexed record files: a header, delimited records as written by
+ * <msg>_stream_write(), and an index of record offsets, optionally
+ * keyed by an integer (typically a scalar field of the record);
+ * <msg>_rec_write() appends through mnpb_recwriter_t,
+ * <msg>_rec_read() decodes record n out of the mmap(2)ed file
+ */
+#define MNPB_RECFILE_KEYED (0x01)
+
+struct _mnpb_recent;
+
+typedef struct _mnpb_recwriter {
+    mnpb_stream_t st;
+    /* file offset of the end of the last record */
+    uint64_t off;
+    struct _mnpb_recent *idx;
+    size_t nidx;
+    size_t cap;
+    unsigned flags;
+} mnpb_recwriter_t;
+
+void mnpb_recwriter_init(mnpb_recwriter_t *, void *, unsigned);
+/* index the record just written at w->off, before advancing it */
+int mnpb_recwriter_add(mnpb_recwriter_t *, int64_t);
+/* write out the index and release, the file is complete */
+int mnpb_recwriter_fini(mnpb_recwriter_t *);
+
+typedef struct _mnpb_recfile {
+    /*
+     * over the records, never grown or freed, without read_more:
+     * decoding past the records fails with MNPB_EIO
+     */
+    mnbytestream_t bs;
+    void *map;
+    size_t mapsz;
+    /* records, in key order if keyed */
+    const uint64_t *idx;
+    size_t nrecs;
+    unsigned flags;
+} mnpb_recfile_t;
+
+#define MNPB_RECFILE_NRECS(rf) ((rf)->nrecs)
+
+int mnpb_recfile_open(mnpb_recfile_t *, const char *);
+void mnpb_recfile_close(mnpb_recfile_t *);
+/* size of record n, with SPOS at its first byte */
+ssize_t mnpb_recfile_seek(mnpb_recfile_t *, size_t);
+int64_t mnpb_recfile_key(mnpb_recfile_t *, size_t);
+/* first record with a key not less than the given one, or nrecs */
+ssize_t mnpb_recfile_find(mnpb_recfile_t *, int64_t);
+
+/*
+ * decode records on nthreads threads, the callback gets each record's
+ * size, with SPOS of its own bytestream at the record, and its number;
+ * the scan stops at the first non-zero return of the callback, which is
+ * returned
+ */
+typedef int (*mnpb_scan_cb_t)(mnbytestream_t *, ssize_t, size_t, void *);
+int mnpb_parallel_scan(mnpb_recfile_t *, int, mnpb_scan_cb_t, void *);
+
+/*
+ * decode/encode statistics, compiled in with -DMNPB_STATS (configure
+ * --enable-stats) in both the library and the generated code, else
+ * the hooks expand to nothing; counters are kept per thread and per
+ * message type, bytes and messages of a type include its nested
+ * messages, the rest goes to the innermost type being decoded or
+ * encoded, or to type 0 outside of generated code
+ */
+#define MNPB_STATS_NERROR (8)
+
+typedef struct _mnpb_stats {
+    uint64_t ndecoded;
+    uint64_t bdecoded;
+    uint64_t nencoded;
+    uint64_t bencoded;
+    /* mnpb_malloc(), mnpb_realloc() calls, new string and bytes values */
+    uint64_t nalloc;
+    /* unknown or unselected fields skipped by mnpb_devoid() */
+    uint64_t nvoid;
+    /* bytestream_consume_data() calls */
+    uint64_t nrefill;
+    /* by -code, counted once where the error is first seen */
+    uint64_t nerror[MNPB_STATS_NERROR];
+} mnpb_stats_t;
+
+/* one per message type, the id is assigned on first use */
+typedef struct _mnpb_stats_type {
+    const char *name;
+    size_t id;
+} mnpb_stats_type_t;
+
+#ifdef MNPB_STATS
+size_t mnpb_stats_enter(mnpb_stats_type_t *);
+void mnpb_stats_leave(size_t, ssize_t, int);
+#   define MNPB_STATS_ENTER(ty) \
+    size_t _mnpb_stats_prev = mnpb_stats_enter(ty)
+#   define MNPB_STATS_LEAVE(res, enc) \
+    mnpb_stats_leave(_mnpb_stats_prev, (res), (enc))
+
+/* types registered so far, including type 0 */
+size_t mnpb_stats_ntypes(void);
+const char *mnpb_stats_name(size_t);
+/*
+ * fill up to n counters indexed by type id, of the calling thread or
+ * summed over all threads, those that have exited included; return the
+ * number of types
+ */
+size_t mnpb_stats_thread(mnpb_stats_t *, size_t);
+size_t mnpb_stats_aggregate(mnpb_stats_t *, size_t);
+/*
+ * restart all counters from zero, safe while other threads count; the
+ * counters of a thread are freed at its exit, and kept in the aggregate
+ */
+void mnpb_stats_reset(void);
+#else
+#   define MNPB_STATS_ENTER(ty)
+#   define MNPB_STATS_LEAVE(res, enc)
+#endif
+
+/*
+ * table-driven backend: with mnpbc -T, <msg>_unpack(), _pack_cached(),
+ * _sz(), _fini() and _dump() run the interpreter below over static
+ * descriptors of the message fields instead of unrolled code
+ */
+#define MNPB_TK_DOUBLE      (0)
+#define MNPB_TK_FLOAT       (1)
+#define MNPB_TK_INT32       (2)
+#define MNPB_TK_INT64       (3)
+#define MNPB_TK_UINT32      (4)
+#define MNPB_TK_UINT64      (5)
+#define MNPB_TK_SINT32      (6)
+#define MNPB_TK_SINT64      (7)
+#define MNPB_TK_FIXED32     (8)
+#define MNPB_TK_FIXED64     (9)
+#define MNPB_TK_SFIXED32    (10)
+#define MNPB_TK_SFIXED64    (11)
+#define MNPB_TK_BOOL        (12)
+#define MNPB_TK_ENUM        (13)
+#define MNPB_TK_STRING      (14)
+#define MNPB_TK_BYTES       (15)
+#define MNPB_TK_STRVIEW     (16)
+#define MNPB_TK_BYTESVIEW   (17)
+#define MNPB_TK_MESSAGE     (18)
+#define MNPB_TK_ONEOF       (19)
+
+struct _mnpb_msg_desc;
+
+typedef struct _mnpb_field_desc {
+    const char *name;
+    /* -1 for a oneof */
+    int64_t fnum;
+    /* as for mnpb_entag() */
+    uint64_t tagword;
+    uint8_t tagsz;
+    int8_t wtype;
+    uint8_t kind;
+    uint8_t repeated;
+    /*
+     * of the value, of the sz, cap, data triple of a repeated field, of
+     * the union of a oneof member, or of the fnum of a oneof
+     */
+    size_t offset;
+    /* of a value or an element */
+    size_t elsz;
+    const struct _mnpb_msg_desc *msg;
+    /* oneof: the first of its nmembers, oneof member: the oneof */
+    const struct _mnpb_field_desc *oneof;
+    size_t nmembers;
+} mnpb_field_desc_t;
+
+typedef struct _mnpb_msg_desc {
+    const char *name;
+    size_t sz;
+    /* in declaration order */
+    const mnpb_field_desc_t *fields;
+    size_t nfields;
+    /* fields and oneof members, by field number */
+    const mnpb_field_desc_t *const *byfnum;
+    size_t nbyfnum;
+    mnpb_stats_type_t *stats;
+} mnpb_msg_desc_t;
+
+ssize_t mnpb_tbl_unpack(mnbytestream_t *,
+                        void *,
+                        const mnpb_msg_desc_t *,
+                        void *);
+ssize_t mnpb_tbl_pack_cached(mnbytestream_t *,
+                             const mnpb_msg_desc_t *,
+                             void *);
+size_t mnpb_tbl_sz(const mnpb_msg_desc_t *, void *);
+int mnpb_tbl_fini(const mnpb_msg_desc_t *, void *);
+ssize_t mnpb_tbl_dump(mnbytestream_t *, const mnpb_msg_desc_t *, void *);
+
 #ifdef __cplusplus
 }
 #endif
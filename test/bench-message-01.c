@@ -0,0 +1,260 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/bench-01.h"
+
+#include "bench.h"
+
+/*
+ * generated code end to end, MB/s and messages/s over corpora of batches
+ * of log events: many small batches, and a few large ones
+ */
+#define NROUNDS 16
+
+volatile uint64_t bench_sink;
+
+typedef struct _corpus {
+    const char *name;
+    size_t nmsgs;
+    size_t nevents;
+    struct bench_01_batch **msgs;
+    /* encoded, one after another */
+    mnbytestream_t bs;
+    size_t *sizes;
+} corpus_t;
+
+static const char *hosts[] = {
+    "web-01.example.org",
+    "web-02.example.org",
+    "api.example.org",
+    "db-primary.internal",
+};
+
+static const char *paths[] = {
+    "/",
+    "/index.html",
+    "/api/v1/users/12345/sessions",
+    "/static/js/app.min.js",
+    "/search?q=protocol+buffers&page=2",
+};
+
+
+static uint64_t
+rnd(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+
+static void
+event_fill(struct bench_01_event *ev, uint64_t *x)
+{
+    mnbytes_t **tags;
+    int64_t *samples;
+    int i, n;
+
+    ev->ts = 1600000000000ll + (int64_t)(rnd(x) % 100000000);
+    ev->host = bytes_new_from_str(hosts[rnd(x) % countof(hosts)]);
+    BYTES_INCREF(ev->host);
+    ev->path = bytes_new_from_str(paths[rnd(x) % countof(paths)]);
+    BYTES_INCREF(ev->path);
+    ev->status = rnd(x) % 8 == 0 ? 404 : 200;
+    ev->latency = (double)(rnd(x) % 100000) / 1000.0;
+    n = (int)(rnd(x) % 4);
+    if (n > 0) {
+        tags = bench_01_event_tags_alloc(ev, n);
+        assert(tags != NULL);
+        for (i = 0; i < n; ++i) {
+            tags[i] = bytes_printf("tag-%d", (int)(rnd(x) % 100));
+            BYTES_INCREF(tags[i]);
+        }
+    }
+    n = (int)(rnd(x) % 16);
+    if (n > 0) {
+        samples = bench_01_event_samples_alloc(ev, n);
+        assert(samples != NULL);
+        for (i = 0; i < n; ++i) {
+            samples[i] = (int64_t)(rnd(x) % 2000) - 1000;
+        }
+    }
+    ev->peer.addr = (uint32_t)rnd(x);
+    ev->peer.port = (uint32_t)(rnd(x) % 65536);
+    ev->peer.agent = bytes_new_from_str("Mozilla/5.0 (X11; Linux x86_64)");
+    BYTES_INCREF(ev->peer.agent);
+}
+
+
+static void
+corpus_init(corpus_t *c, const char *name, size_t nmsgs, size_t nevents)
+{
+    uint64_t x = 0x2545f4914f6cdd1dull;
+    size_t i, j;
+
+    c->name = name;
+    c->nmsgs = nmsgs;
+    c->nevents = nevents;
+    c->msgs = malloc(nmsgs * sizeof(*c->msgs));
+    c->sizes = malloc(nmsgs * sizeof(*c->sizes));
+    assert(c->msgs != NULL && c->sizes != NULL);
+    (void)bytestream_init(&c->bs, 4096);
+    for (i = 0; i < nmsgs; ++i) {
+        struct bench_01_event *events;
+
+        c->msgs[i] = bench_01_batch_new();
+        assert(c->msgs[i] != NULL);
+        c->msgs[i]->id = i;
+        events = bench_01_batch_events_alloc(c->msgs[i], (int)nevents);
+        assert(events != NULL);
+        for (j = 0; j < nevents; ++j) {
+            event_fill(&events[j], &x);
+        }
+        c->sizes[i] = bench_01_batch_sz(c->msgs[i]);
+        assert(bench_01_batch_pack(&c->bs, c->msgs[i]) ==
+               (ssize_t)c->sizes[i]);
+    }
+}
+
+
+static void
+corpus_fini(corpus_t *c)
+{
+    size_t i;
+
+    for (i = 0; i < c->nmsgs; ++i) {
+        bench_01_batch_destroy(&c->msgs[i]);
+    }
+    free(c->msgs);
+    free(c->sizes);
+    bytestream_fini(&c->bs);
+}
+
+
+static void
+bench_sz(corpus_t *c, const char *name, uint64_t nrounds)
+{
+    bench_t b;
+    uint64_t sum = 0;
+    uint64_t r;
+    size_t i;
+
+    bench_start(&b, c->name, name);
+    for (r = 0; r < nrounds; ++r) {
+        for (i = 0; i < c->nmsgs; ++i) {
+            sum += bench_01_batch_sz(c->msgs[i]);
+        }
+    }
+    bench_stop(&b, nrounds * c->nmsgs, nrounds * SEOD(&c->bs));
+    bench_report(&b);
+    bench_sink += sum;
+}
+
+
+static void
+bench_pack(corpus_t *c, const char *name, uint64_t nrounds)
+{
+    mnbytestream_t bs;
+    bench_t b;
+    uint64_t r;
+    size_t i;
+
+    (void)bytestream_init(&bs, SEOD(&c->bs));
+    bench_start(&b, c->name, name);
+    for (r = 0; r < nrounds; ++r) {
+        SEOD(&bs) = 0;
+        for (i = 0; i < c->nmsgs; ++i) {
+            (void)bench_01_batch_pack(&bs, c->msgs[i]);
+        }
+    }
+    bench_stop(&b, nrounds * c->nmsgs, nrounds * SEOD(&bs));
+    bench_report(&b);
+    assert(SEOD(&bs) == SEOD(&c->bs));
+    bytestream_fini(&bs);
+}
+
+
+static void
+bench_unpack(corpus_t *c, const char *name, uint64_t nrounds)
+{
+    struct bench_01_batch *msg;
+    bench_t b;
+    uint64_t sum = 0;
+    uint64_t r;
+    size_t i;
+
+    msg = bench_01_batch_new();
+    assert(msg != NULL);
+    bench_start(&b, c->name, name);
+    for (r = 0; r < nrounds; ++r) {
+        SPOS(&c->bs) = 0;
+        for (i = 0; i < c->nmsgs; ++i) {
+            (void)bench_01_batch_clear(msg);
+            (void)bench_01_batch_rawsz(msg, c->sizes[i]);
+            (void)bench_01_batch_unpack(&c->bs, NULL, msg);
+            sum += msg->id;
+        }
+    }
+    bench_stop(&b, nrounds * c->nmsgs, nrounds * SEOD(&c->bs));
+    bench_report(&b);
+    assert(SPOS(&c->bs) == SEOD(&c->bs));
+    bench_01_batch_destroy(&msg);
+    bench_sink += sum;
+}
+
+
+/*
+ * bytes are those of the encoded corpus, as for the others
+ */
+static void
+bench_dump(corpus_t *c, const char *name, uint64_t nrounds)
+{
+    mnbytestream_t bs;
+    bench_t b;
+    uint64_t r;
+    size_t i;
+
+    (void)bytestream_init(&bs, 4096);
+    bench_start(&b, c->name, name);
+    for (r = 0; r < nrounds; ++r) {
+        SEOD(&bs) = 0;
+        for (i = 0; i < c->nmsgs; ++i) {
+            (void)bench_01_batch_dump(&bs, c->msgs[i]);
+        }
+    }
+    bench_stop(&b, nrounds * c->nmsgs, nrounds * SEOD(&c->bs));
+    bench_report(&b);
+    bytestream_fini(&bs);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    corpus_t corpora[2];
+    uint64_t scale;
+    size_t i;
+
+    scale = bench_scale(argc, argv);
+    corpus_init(&corpora[0], "message-small", 4096, 1);
+    corpus_init(&corpora[1], "message-large", 16, 256);
+
+    for (i = 0; i < countof(corpora); ++i) {
+        bench_sz(&corpora[i], "sz", NROUNDS * scale);
+        bench_pack(&corpora[i], "pack", NROUNDS * scale);
+        bench_unpack(&corpora[i], "unpack", NROUNDS * scale);
+        bench_dump(&corpora[i], "dump", scale);
+    }
+
+    for (i = 0; i < countof(corpora); ++i) {
+        corpus_fini(&corpora[i]);
+    }
+    return 0;
+}
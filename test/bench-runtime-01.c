@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "bench.h"
+
+/*
+ * runtime primitives, ns/op and cycles/byte
+ */
+#define NVALUES (1 << 16)
+#define NROUNDS 64
+#define NSTRINGS 1024
+#define NSROUNDS 256
+
+volatile uint64_t bench_sink;
+static uint64_t values[NVALUES];
+static mnbytes_t *strings[NSTRINGS];
+
+
+/*
+ * values of every varint length
+ */
+static void
+values_init(void)
+{
+    uint64_t x = 0x2545f4914f6cdd1dull;
+    size_t i;
+
+    for (i = 0; i < NVALUES; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        values[i] = x >> (x % 64);
+    }
+    for (i = 0; i < NSTRINGS; ++i) {
+        size_t sz = values[i] % 256;
+        char buf[256];
+
+        memset(buf, 'a' + (int)(i % 26), sz);
+        strings[i] = bytes_new_from_str_len(buf, sz);
+        BYTES_INCREF(strings[i]);
+    }
+}
+
+
+/*
+ * encode all values, then decode them, nrounds times each
+ */
+#define BENCH_SCALAR(en, de, ty)                                       \
+static void                                                            \
+bench_##en(mnbytestream_t *bs, uint64_t nrounds)                       \
+{                                                                      \
+    bench_t b;                                                         \
+    uint64_t sum = 0;                                                  \
+    uint64_t r;                                                        \
+    size_t i;                                                          \
+    ty v;                                                              \
+    SEOD(bs) = 0;                                                      \
+    for (i = 0; i < NVALUES; ++i) {                                    \
+        (void)en(bs, (ty)values[i]);                                   \
+    }                                                                  \
+    bench_start(&b, "runtime", #en);                                   \
+    for (r = 0; r < nrounds; ++r) {                                    \
+        SEOD(bs) = 0;                                                  \
+        for (i = 0; i < NVALUES; ++i) {                                \
+            (void)en(bs, (ty)values[i]);                               \
+        }                                                              \
+    }                                                                  \
+    bench_stop(&b, nrounds * NVALUES, nrounds * SEOD(bs));             \
+    bench_report(&b);                                                  \
+    bench_start(&b, "runtime", #de);                                   \
+    for (r = 0; r < nrounds; ++r) {                                    \
+        SPOS(bs) = 0;                                                  \
+        for (i = 0; i < NVALUES; ++i) {                                \
+            (void)de(bs, NULL, &v);                                    \
+            sum += (uint64_t)v;                                        \
+        }                                                              \
+    }                                                                  \
+    bench_stop(&b, nrounds * NVALUES, nrounds * SEOD(bs));             \
+    bench_report(&b);                                                  \
+    bench_sink += sum;                                                 \
+}
+
+BENCH_SCALAR(mnpb_envarint, mnpb_devarint, uint64_t)
+BENCH_SCALAR(mnpb_enzz64, mnpb_dezz64, int64_t)
+BENCH_SCALAR(mnpb_enzz32, mnpb_dezz32, int32_t)
+BENCH_SCALAR(mnpb_enfi64, mnpb_defi64, uint64_t)
+BENCH_SCALAR(mnpb_enfi32, mnpb_defi32, uint32_t)
+BENCH_SCALAR(mnpb_endouble, mnpb_dedouble, double)
+
+
+#define BENCH_BYTES(en, de)                                            \
+static void                                                            \
+bench_##en(mnbytestream_t *bs, uint64_t nrounds)                       \
+{                                                                      \
+    bench_t b;                                                         \
+    uint64_t sum = 0;                                                  \
+    uint64_t r;                                                        \
+    size_t i;                                                          \
+    mnbytes_t *v;                                                      \
+    SEOD(bs) = 0;                                                      \
+    for (i = 0; i < NSTRINGS; ++i) {                                   \
+        (void)en(bs, strings[i]);                                      \
+    }                                                                  \
+    bench_start(&b, "runtime", #en);                                   \
+    for (r = 0; r < nrounds; ++r) {                                    \
+        SEOD(bs) = 0;                                                  \
+        for (i = 0; i < NSTRINGS; ++i) {                               \
+            (void)en(bs, strings[i]);                                  \
+        }                                                              \
+    }                                                                  \
+    bench_stop(&b, nrounds * NSTRINGS, nrounds * SEOD(bs));            \
+    bench_report(&b);                                                  \
+    bench_start(&b, "runtime", #de);                                   \
+    for (r = 0; r < nrounds; ++r) {                                    \
+        SPOS(bs) = 0;                                                  \
+        for (i = 0; i < NSTRINGS; ++i) {                               \
+            v = NULL;                                                  \
+            (void)de(bs, NULL, &v);                                    \
+            sum += v != NULL ? BSZ(v) : 0;                             \
+            BYTES_DECREF(&v);                                          \
+        }                                                              \
+    }                                                                  \
+    bench_stop(&b, nrounds * NSTRINGS, nrounds * SEOD(bs));            \
+    bench_report(&b);                                                  \
+    bench_sink += sum;                                                 \
+}
+
+BENCH_BYTES(mnpb_enbytes, mnpb_debytes)
+BENCH_BYTES(mnpb_enstr, mnpb_destr)
+
+
+int
+main(int argc, char **argv)
+{
+    mnbytestream_t bs;
+    uint64_t scale;
+    size_t i;
+
+    scale = bench_scale(argc, argv);
+    values_init();
+    (void)bytestream_init(&bs, 4096);
+
+    bench_mnpb_envarint(&bs, NROUNDS * scale);
+    bench_mnpb_enzz64(&bs, NROUNDS * scale);
+    bench_mnpb_enzz32(&bs, NROUNDS * scale);
+    bench_mnpb_enfi64(&bs, NROUNDS * scale);
+    bench_mnpb_enfi32(&bs, NROUNDS * scale);
+    bench_mnpb_endouble(&bs, NROUNDS * scale);
+    bench_mnpb_enbytes(&bs, NSROUNDS * scale);
+    bench_mnpb_enstr(&bs, NSROUNDS * scale);
+
+    bytestream_fini(&bs);
+    for (i = 0; i < NSTRINGS; ++i) {
+        BYTES_DECREF(&strings[i]);
+    }
+    return 0;
+}
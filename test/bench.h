@@ -0,0 +1,126 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define BENCH_HAVE_TSC
+#endif
+
+#ifndef countof
+#   define countof(a) (sizeof(a)/sizeof(a[0]))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One measurement, printed as a line of JSON by bench_report(), so that
+ * the output of all the bench-* programs concatenates into a JSON Lines
+ * file to compare between library versions.
+ */
+typedef struct _bench {
+    const char *suite;
+    const char *name;
+    uint64_t nops;
+    uint64_t nbytes;
+    uint64_t ns;
+    uint64_t cycles;
+    struct timespec ts0;
+    uint64_t tsc0;
+} bench_t;
+
+/* keeps the measured work from being optimized away */
+extern volatile uint64_t bench_sink;
+
+
+static inline uint64_t
+bench_tsc(void)
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static inline void
+bench_start(bench_t *b, const char *suite, const char *name)
+{
+    b->suite = suite;
+    b->name = name;
+    b->nops = 0;
+    b->nbytes = 0;
+    (void)clock_gettime(CLOCK_MONOTONIC, &b->ts0);
+    b->tsc0 = bench_tsc();
+}
+
+
+static inline void
+bench_stop(bench_t *b, uint64_t nops, uint64_t nbytes)
+{
+    struct timespec ts1;
+
+    b->cycles = bench_tsc() - b->tsc0;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts1);
+    b->ns = (uint64_t)(ts1.tv_sec - b->ts0.tv_sec) * 1000000000ull +
+            (uint64_t)ts1.tv_nsec - (uint64_t)b->ts0.tv_nsec;
+    if (b->ns == 0) {
+        b->ns = 1;
+    }
+    b->nops = nops;
+    b->nbytes = nbytes;
+}
+
+
+static inline void
+bench_report(bench_t *b)
+{
+    printf("{\"suite\": \"%s\", \"name\": \"%s\", "
+           "\"ops\": %" PRIu64 ", \"bytes\": %" PRIu64 ", "
+           "\"ns\": %" PRIu64 ", "
+           "\"ns_per_op\": %.3f, \"ops_per_s\": %.0f, \"mb_per_s\": %.3f",
+           b->suite,
+           b->name,
+           b->nops,
+           b->nbytes,
+           b->ns,
+           (double)b->ns / (double)b->nops,
+           (double)b->nops * 1e9 / (double)b->ns,
+           (double)b->nbytes * 1e3 / (double)b->ns);
+#ifdef BENCH_HAVE_TSC
+    printf(", \"cycles_per_byte\": %.3f",
+           (double)b->cycles / (double)b->nbytes);
+#else
+    printf(", \"cycles_per_byte\": null");
+#endif
+    printf("}\n");
+}
+
+
+/*
+ * the work is scaled by the first argument, default 1
+ */
+static inline uint64_t
+bench_scale(int argc, char **argv)
+{
+    long res;
+
+    if (argc < 2 || (res = strtol(argv[1], NULL, 10)) <= 0) {
+        res = 1;
+    }
+    return (uint64_t)res;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_H */
@@ -0,0 +1,315 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/allocator-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+/*
+ * heap allocator tagging its blocks, so that a block released to the
+ * wrong allocator does not go unnoticed
+ */
+#define TAG_MAGIC 0x616c6c6f63ull
+
+typedef struct _counter {
+    size_t nalloc;
+    size_t nfree;
+} counter_t;
+
+typedef union _tag {
+    uint64_t magic;
+    /* keep the block aligned as malloc() would */
+    long double align;
+} tag_t;
+
+
+static void *
+counter_alloc(void *ctx, size_t sz)
+{
+    counter_t *c;
+    tag_t *t;
+
+    c = ctx;
+    if ((t = malloc(sizeof(*t) + sz)) == NULL) {
+        return NULL;
+    }
+    t->magic = TAG_MAGIC;
+    ++c->nalloc;
+    return t + 1;
+}
+
+
+static void *
+counter_realloc(void *ctx, void *ptr, UNUSED size_t oldsz, size_t sz)
+{
+    tag_t *t;
+
+    if (ptr == NULL) {
+        return counter_alloc(ctx, sz);
+    }
+    t = (tag_t *)ptr - 1;
+    assert(t->magic == TAG_MAGIC);
+    if ((t = realloc(t, sizeof(*t) + sz)) == NULL) {
+        return NULL;
+    }
+    return t + 1;
+}
+
+
+static void
+counter_free(void *ctx, void *ptr)
+{
+    counter_t *c;
+    tag_t *t;
+
+    c = ctx;
+    if (ptr == NULL) {
+        return;
+    }
+    t = (tag_t *)ptr - 1;
+    assert(t->magic == TAG_MAGIC);
+    t->magic = 0;
+    ++c->nfree;
+    free(t);
+}
+
+
+static void *
+failing_alloc(UNUSED void *ctx, UNUSED size_t sz)
+{
+    return NULL;
+}
+
+
+static void *
+failing_realloc(UNUSED void *ctx,
+                UNUSED void *ptr,
+                UNUSED size_t oldsz,
+                UNUSED size_t sz)
+{
+    return NULL;
+}
+
+
+static void
+fill(struct allocator_01 *msg)
+{
+    mnbytes_t **tags;
+    struct allocator_01_item *items;
+    int32_t *ri;
+
+    msg->name = mnpb_bytes_new("name", 4, true);
+    BYTES_INCREF(msg->name);
+    tags = allocator_01_tags_alloc(msg, 2);
+    assert(tags != NULL);
+    tags[0] = mnpb_bytes_new("a", 1, true);
+    BYTES_INCREF(tags[0]);
+    tags[1] = mnpb_bytes_new("bc", 2, true);
+    BYTES_INCREF(tags[1]);
+    items = allocator_01_items_alloc(msg, 1);
+    assert(items != NULL);
+    memset(items, 0, sizeof(*items));
+    items[0].label = mnpb_bytes_new("x", 1, true);
+    BYTES_INCREF(items[0].label);
+    items[0].blob = mnpb_bytes_new("\0\1", 2, false);
+    BYTES_INCREF(items[0].blob);
+    ri = allocator_01_ri_alloc(msg, 3);
+    assert(ri != NULL);
+    ri[0] = 1;
+    ri[1] = 2;
+    ri[2] = 3;
+    msg->item.label = mnpb_bytes_new("y", 1, true);
+    BYTES_INCREF(msg->item.label);
+    ALLOCATOR_01_PROTO_SET(msg, body, text,
+                           mnpb_bytes_new("text", 4, true));
+    BYTES_INCREF(msg->body.data.text);
+}
+
+
+static void
+test_allocator(void)
+{
+    counter_t c;
+    mnpb_allocator_t allocator = {
+        counter_alloc,
+        counter_realloc,
+        counter_free,
+        &c,
+    };
+    const mnpb_allocator_t *prev;
+    struct allocator_01 *msg0, msg1;
+    mnbytestream_t bs;
+    ssize_t sz;
+
+    memset(&c, 0, sizeof(c));
+
+    /*
+     * built under the allocator
+     */
+    prev = mnpb_allocator_enter(&allocator);
+    assert(prev == NULL);
+    msg0 = allocator_01_new();
+    assert(msg0 != NULL);
+    fill(msg0);
+    assert(mnpb_allocator_enter(prev) == &allocator);
+    assert(c.nalloc > 0);
+
+    (void)bytestream_init(&bs, 64);
+    sz = allocator_01_pack(&bs, msg0);
+    assert(sz > 0);
+
+    /*
+     * decoded under the allocator, twice into the same message
+     */
+    memset(&msg1, 0, sizeof(msg1));
+    (void)allocator_01_rawsz(&msg1, sz);
+    assert(allocator_01_unpack_allocator(&bs, NULL, &allocator, &msg1) ==
+           sz);
+    assert(strcmp(BCDATA(msg1.name), "name") == 0);
+    assert(msg1.tags.sz == 2);
+    assert(strcmp(BCDATA(msg1.tags.data[1]), "bc") == 0);
+    assert(msg1.items.sz == 1);
+    assert(BSZ(msg1.items.data[0].blob) == 2);
+    assert(msg1.ri.sz == 3);
+    assert(strcmp(BCDATA(msg1.item.label), "y") == 0);
+    assert(strcmp(BCDATA(msg1.body.data.text), "text") == 0);
+
+    SPOS(&bs) = 0;
+    (void)allocator_01_rawsz(&msg1, sz);
+    assert(allocator_01_unpack_allocator(&bs, NULL, &allocator, &msg1) ==
+           sz);
+    assert(msg1.tags.sz == 4);
+
+    assert(allocator_01_fini_allocator(&allocator, &msg1) == 0);
+
+    prev = mnpb_allocator_enter(&allocator);
+    allocator_01_destroy(&msg0);
+    (void)mnpb_allocator_enter(prev);
+
+    /* everything came from, and went back to, the allocator */
+    TRACE("nalloc %zd nfree %zd", c.nalloc, c.nfree);
+    assert(c.nalloc == c.nfree);
+
+    bytestream_fini(&bs);
+}
+
+
+/*
+ * without an allocator the heap is used as before
+ */
+static void
+test_heap(void)
+{
+    struct allocator_01 *msg;
+
+    assert(mnpb_allocator_enter(NULL) == NULL);
+    msg = allocator_01_new();
+    assert(msg != NULL);
+    fill(msg);
+    msg->item.blob = bytes_new_from_str("z");
+    BYTES_INCREF(msg->item.blob);
+    allocator_01_destroy(&msg);
+}
+
+
+/*
+ * a decoder running out of memory fails instead of leaving the field
+ * empty
+ */
+static void
+test_failing(void)
+{
+    mnpb_allocator_t allocator = {
+        failing_alloc,
+        failing_realloc,
+        NULL,
+        NULL,
+    };
+    struct allocator_01 msg0, msg1;
+    mnbytestream_t bs;
+    ssize_t sz;
+
+    (void)bytestream_init(&bs, 64);
+
+    /* string */
+    memset(&msg0, 0, sizeof(msg0));
+    msg0.name = bytes_new_from_str("name");
+    BYTES_INCREF(msg0.name);
+    sz = allocator_01_pack(&bs, &msg0);
+    assert(sz > 0);
+    memset(&msg1, 0, sizeof(msg1));
+    (void)allocator_01_rawsz(&msg1, sz);
+    assert(allocator_01_unpack_allocator(&bs, NULL, &allocator, &msg1) ==
+           MNPB_EMEMORY);
+    assert(allocator_01_fini_allocator(&allocator, &msg1) == 0);
+    (void)allocator_01_fini(&msg0);
+
+    /* bytes */
+    bytestream_rewind(&bs);
+    memset(&msg0, 0, sizeof(msg0));
+    msg0.item.blob = bytes_new_from_mem_len("\0\1", 2);
+    BYTES_INCREF(msg0.item.blob);
+    sz = allocator_01_pack(&bs, &msg0);
+    assert(sz > 0);
+    memset(&msg1, 0, sizeof(msg1));
+    (void)allocator_01_rawsz(&msg1, sz);
+    assert(allocator_01_unpack_allocator(&bs, NULL, &allocator, &msg1) ==
+           MNPB_EMEMORY);
+    assert(allocator_01_fini_allocator(&allocator, &msg1) == 0);
+    (void)allocator_01_fini(&msg0);
+
+    bytestream_fini(&bs);
+}
+
+
+/*
+ * an entered arena takes precedence for releasing as well
+ */
+static void
+test_arena(void)
+{
+    counter_t c;
+    mnpb_allocator_t allocator = {
+        counter_alloc,
+        counter_realloc,
+        counter_free,
+        &c,
+    };
+    mnpb_arena_t arena;
+    void *p;
+
+    memset(&c, 0, sizeof(c));
+    mnpb_arena_init(&arena, 256);
+    (void)mnpb_allocator_enter(&allocator);
+    (void)mnpb_arena_enter(&arena);
+    p = mnpb_realloc(NULL, 0, 16);
+    assert(p != NULL);
+    mnpb_free(p);
+    assert(mnpb_arena_enter(NULL) == &arena);
+    assert(mnpb_allocator_enter(NULL) == &allocator);
+    assert(c.nalloc == 0 && c.nfree == 0);
+    mnpb_arena_fini(&arena);
+}
+
+
+int
+main(void)
+{
+    test_allocator();
+    test_heap();
+    test_failing();
+    test_arena();
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/arena-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 50
+#define NROUNDS 10
+
+
+static void
+arena_01_cmp(struct arena_01 *a, struct arena_01 *b)
+{
+    size_t i;
+
+    assert(a->id == b->id);
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(BSZ(a->blob) == BSZ(b->blob));
+    assert(memcmp(BDATA(a->blob), BDATA(b->blob), BSZ(a->blob)) == 0);
+    assert(a->tags.sz == b->tags.sz);
+    for (i = 0; i < a->tags.sz; ++i) {
+        assert(bytes_cmp(a->tags.data[i], b->tags.data[i]) == 0);
+    }
+    assert(a->items.sz == b->items.sz);
+    for (i = 0; i < a->items.sz; ++i) {
+        assert(bytes_cmp(a->items.data[i].key, b->items.data[i].key) == 0);
+        assert(a->items.data[i].weight == b->items.data[i].weight);
+    }
+    assert(a->values.sz == b->values.sz);
+    for (i = 0; i < a->values.sz; ++i) {
+        assert(a->values.data[i] == b->values.data[i]);
+    }
+}
+
+
+int
+main(void)
+{
+    struct arena_01 *ar0, *ar1;
+    mnbytes_t **tags;
+    struct arena_01_Item *items;
+    int32_t *values;
+    mnpb_arena_t arena;
+    mnbytestream_t bs0, bs1;
+    mnbytes_t *s;
+    ssize_t sz;
+    int i;
+
+    ar0 = arena_01_new();
+    assert(ar0 != NULL);
+
+    ar0->id = 123;
+    ar0->name = bytes_new_from_str("FOO");
+    ar0->blob = bytes_new_from_mem_len("\x00\x01\x02", 3);
+    tags = arena_01_tags_alloc(ar0, NITEMS);
+    items = arena_01_items_alloc(ar0, NITEMS);
+    values = arena_01_values_alloc(ar0, NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        tags[i] = bytes_printf("tag-%d", i);
+        items[i].key = bytes_printf("key-%d", i);
+        items[i].weight = (double)i / 3.0;
+        values[i] = -i;
+    }
+
+    (void)bytestream_init(&bs0, 32);
+    sz = arena_01_pack(&bs0, ar0);
+    assert(sz == (ssize_t)arena_01_sz(ar0));
+    s = bytes_new_from_mem_len(SPDATA(&bs0), SEOD(&bs0));
+
+    /*
+     * small chunks, so that chaining is exercised
+     */
+    mnpb_arena_init(&arena, 256);
+
+    for (i = 0; i < NROUNDS; ++i) {
+        bytestream_from_bytes(&bs1, s);
+        SEOD(&bs1) = BSZ(s);
+
+        ar1 = arena_01_new_arena(&arena);
+        assert(ar1 != NULL);
+        (void)arena_01_rawsz(ar1, SEOD(&bs1));
+        sz = arena_01_unpack_arena(&bs1, NULL, &arena, ar1);
+        assert(sz == SEOD(&bs1));
+
+        /*
+         * everything came from the arena
+         */
+        assert(arena.chunks != NULL);
+        arena_01_cmp(ar0, ar1);
+
+        mnpb_arena_reset(&arena);
+    }
+
+    /*
+     * outside of the arena, the heap is used again
+     */
+    ar1 = arena_01_new();
+    assert(ar1 != NULL);
+    bytestream_from_bytes(&bs1, s);
+    SEOD(&bs1) = BSZ(s);
+    (void)arena_01_rawsz(ar1, SEOD(&bs1));
+    sz = arena_01_unpack(&bs1, NULL, ar1);
+    assert(sz == SEOD(&bs1));
+    arena_01_cmp(ar0, ar1);
+    arena_01_destroy(&ar1);
+
+    /*
+     * a oneof member met twice is replaced within the arena, not
+     * released to the heap
+     */
+    ar1 = arena_01_new();
+    assert(ar1 != NULL);
+    ARENA_01_PROTO_SETFNUM(ar1, body, part);
+    ar1->body.data.part.key = bytes_new_from_str("BAR");
+    values = arena_01_part_marks_alloc(&ar1->body.data.part, NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        values[i] = i;
+    }
+    bytestream_rewind(&bs0);
+    assert(arena_01_pack(&bs0, ar1) > 0);
+    assert(arena_01_pack(&bs0, ar1) > 0);
+    arena_01_destroy(&ar1);
+
+    ar1 = arena_01_new_arena(&arena);
+    assert(ar1 != NULL);
+    (void)arena_01_rawsz(ar1, SEOD(&bs0));
+    sz = arena_01_unpack_arena(&bs0, NULL, &arena, ar1);
+    assert(sz == SEOD(&bs0));
+    assert(ARENA_01_PROTO_GETFNUM(ar1, body) ==
+           ARENA_01_PROTO_FNUM(body, part));
+    assert(strcmp(BCDATA(ar1->body.data.part.key), "BAR") == 0);
+    assert(ar1->body.data.part.marks.sz == NITEMS);
+    assert(ar1->body.data.part.marks.data[NITEMS - 1] == NITEMS - 1);
+
+    mnpb_arena_fini(&arena);
+    arena_01_destroy(&ar0);
+    bytestream_fini(&bs0);
+    BYTES_DECREF(&s);
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/clear-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 20
+#define NROUNDS 5
+
+
+static void
+clear_01_item_fill(struct clear_01_item *item, int i)
+{
+    int64_t *values;
+    int j;
+
+    item->code = (uint32_t)i;
+    item->label = bytes_printf("label-%d", i);
+    BYTES_INCREF(item->label);
+    if (i > 0) {
+        values = clear_01_item_values_alloc(item, i);
+        assert(values != NULL);
+        for (j = 0; j < i; ++j) {
+            values[j] = -j;
+        }
+    }
+}
+
+
+static void
+clear_01_fill(struct clear_01 *msg, int nitems)
+{
+    mnbytes_t **tags;
+    struct clear_01_item *items;
+    int i;
+
+    msg->id = 123;
+    msg->name = bytes_new_from_str("FOO");
+    BYTES_INCREF(msg->name);
+    tags = clear_01_tags_alloc(msg, nitems);
+    items = clear_01_items_alloc(msg, nitems);
+    for (i = 0; i < nitems; ++i) {
+        tags[i] = bytes_printf("tag-%d", i);
+        BYTES_INCREF(tags[i]);
+        clear_01_item_fill(&items[i], i);
+    }
+    clear_01_item_fill(&msg->head, 3);
+    CLEAR_01_PROTO_SETFNUM(msg, body, one);
+    clear_01_item_fill(&CLEAR_01_PROTO_MEMBER(msg, body, one), 2);
+}
+
+
+static void
+clear_01_item_cmp(struct clear_01_item *a, struct clear_01_item *b)
+{
+    size_t i;
+
+    assert(a->code == b->code);
+    assert(bytes_cmp(a->label, b->label) == 0);
+    assert(a->values.sz == b->values.sz);
+    for (i = 0; i < a->values.sz; ++i) {
+        assert(a->values.data[i] == b->values.data[i]);
+    }
+}
+
+
+static void
+clear_01_cmp(struct clear_01 *a, struct clear_01 *b)
+{
+    size_t i;
+
+    assert(a->id == b->id);
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(a->tags.sz == b->tags.sz);
+    for (i = 0; i < a->tags.sz; ++i) {
+        assert(bytes_cmp(a->tags.data[i], b->tags.data[i]) == 0);
+    }
+    assert(a->items.sz == b->items.sz);
+    for (i = 0; i < a->items.sz; ++i) {
+        clear_01_item_cmp(&a->items.data[i], &b->items.data[i]);
+    }
+    clear_01_item_cmp(&a->head, &b->head);
+    assert(a->body.fnum == b->body.fnum);
+    if (a->body.fnum == CLEAR_01_PROTO_FNUM_body_one) {
+        clear_01_item_cmp(&a->body.data.one, &b->body.data.one);
+    }
+}
+
+
+static void
+decode(mnbytestream_t *bs, struct clear_01 *msg)
+{
+    SPOS(bs) = 0;
+    (void)clear_01_clear(msg);
+    (void)clear_01_rawsz(msg, SEOD(bs));
+    assert(clear_01_unpack(bs, NULL, msg) == SEOD(bs));
+}
+
+
+int
+main(void)
+{
+    struct clear_01 *msg0, *msg1;
+    mnbytestream_t bs0, bs1;
+    mnbytes_t **tags, *tag0;
+    struct clear_01_item *items;
+    int64_t *values0;
+    int i;
+
+    msg0 = clear_01_new();
+    assert(msg0 != NULL);
+    clear_01_fill(msg0, NITEMS);
+    (void)bytestream_init(&bs0, 32);
+    assert(clear_01_pack(&bs0, msg0) == (ssize_t)clear_01_sz(msg0));
+
+    /*
+     * the first decode allocates, the next ones reuse
+     */
+    msg1 = clear_01_new();
+    assert(msg1 != NULL);
+    decode(&bs0, msg1);
+    clear_01_cmp(msg0, msg1);
+    tags = msg1->tags.data;
+    tag0 = msg1->tags.data[0];
+    items = msg1->items.data;
+    values0 = msg1->items.data[NITEMS - 1].values.data;
+    for (i = 0; i < NROUNDS; ++i) {
+        decode(&bs0, msg1);
+        clear_01_cmp(msg0, msg1);
+        assert(msg1->tags.data == tags);
+        assert(msg1->tags.data[0] == tag0);
+        assert(msg1->items.data == items);
+        assert(msg1->items.data[NITEMS - 1].values.data == values0);
+    }
+
+    /*
+     * cleared
+     */
+    (void)clear_01_clear(msg1);
+    assert(msg1->id == 0);
+    assert(msg1->name == NULL);
+    assert(msg1->tags.sz == 0 && msg1->tags.cap >= NITEMS);
+    assert(msg1->items.sz == 0 && msg1->items.cap >= NITEMS);
+    assert(msg1->head.label == NULL && msg1->head.values.sz == 0);
+    assert(msg1->body.fnum == 0);
+
+    /*
+     * alloc hands out released strings and cleared messages
+     */
+    tags = clear_01_tags_alloc(msg1, 2);
+    assert(tags != NULL && tags[0] == NULL && tags[1] == NULL);
+    items = clear_01_items_alloc(msg1, 2);
+    assert(items != NULL);
+    assert(items[1].code == 0);
+    assert(items[1].label == NULL);
+    assert(items[1].values.sz == 0 && items[1].values.cap > 0);
+
+    /*
+     * fewer and larger elements: the rest is kept until _fini
+     */
+    (void)clear_01_fini(msg0);
+    memset(msg0, 0, sizeof(*msg0));
+    clear_01_fill(msg0, 3);
+    BYTES_DECREF(&msg0->tags.data[0]);
+    msg0->tags.data[0] = bytes_new_from_str("a considerably longer tag");
+    BYTES_INCREF(msg0->tags.data[0]);
+    (void)bytestream_init(&bs1, 32);
+    assert(clear_01_pack(&bs1, msg0) == (ssize_t)clear_01_sz(msg0));
+    decode(&bs1, msg1);
+    clear_01_cmp(msg0, msg1);
+
+    clear_01_destroy(&msg0);
+    clear_01_destroy(&msg1);
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs1);
+
+    return 0;
+}
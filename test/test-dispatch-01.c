@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/dispatch-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+
+static ssize_t
+decode(const char *data, size_t sz, struct dispatch_01 *msg)
+{
+    mnbytestream_t bs;
+    ssize_t res;
+
+    (void)bytestream_init(&bs, sz);
+    (void)bytestream_cat(&bs, sz, data);
+    (void)dispatch_01_rawsz(msg, SEOD(&bs));
+    res = dispatch_01_unpack(&bs, NULL, msg);
+    bytestream_fini(&bs);
+    return res;
+}
+
+
+static void
+test_roundtrip(void)
+{
+    struct dispatch_01 *msg0, *msg1;
+    mnbytestream_t bs;
+    ssize_t sz;
+
+    msg0 = dispatch_01_new();
+    assert(msg0 != NULL);
+    msg0->i32 = -1;
+    msg0->d = 0.25;
+    msg0->b = true;
+    msg0->s64 = -300;
+    DISPATCH_01_PROTO_SET(msg0, body, code, 12345);
+    msg0->name = bytes_new_from_str("n");
+    BYTES_INCREF(msg0->name);
+    msg0->fx = 7;
+    msg0->u64 = 1ull << 40;
+
+    (void)bytestream_init(&bs, 32);
+    sz = dispatch_01_pack(&bs, msg0);
+    assert(sz > 0);
+
+    msg1 = dispatch_01_new();
+    assert(msg1 != NULL);
+    assert(decode(SDATA(&bs, 0), sz, msg1) == sz);
+    assert(msg1->i32 == -1);
+    assert(msg1->d == 0.25);
+    assert(msg1->b);
+    assert(msg1->s64 == -300);
+    assert(DISPATCH_01_PROTO_GETFNUM(msg1, body) ==
+           DISPATCH_01_PROTO_FNUM(body, code));
+    assert(msg1->body.data.code == 12345);
+    assert(bytes_cmp(msg1->name, msg0->name) == 0);
+    assert(msg1->fx == 7);
+    assert(msg1->u64 == 1ull << 40);
+
+    bytestream_fini(&bs);
+    dispatch_01_destroy(&msg0);
+    dispatch_01_destroy(&msg1);
+}
+
+
+/*
+ * the fixed widths the runtime converts from go through the table as
+ * well as the field's own wire type
+ */
+static void
+test_widen(void)
+{
+    struct dispatch_01 *msg;
+    static const char widen[] =
+        /* i32 as fixed32 */
+        "\x0d\x07\x00\x00\x00"
+        /* d as float */
+        "\x15\x00\x00\xc0\x3f"
+        /* b as fixed64 */
+        "\x19\x01\x00\x00\x00\x00\x00\x00\x00"
+        /* u64 as fixed64 */
+        "\xe1\x12\x02\x00\x00\x00\x00\x00\x00\x00"
+        /* code as fixed64 */
+        "\xc1\x3e\x03\x00\x00\x00\x00\x00\x00\x00";
+
+    msg = dispatch_01_new();
+    assert(msg != NULL);
+    assert(decode(widen, sizeof(widen) - 1, msg) ==
+           (ssize_t)sizeof(widen) - 1);
+    assert(msg->i32 == 7);
+    assert(msg->d == 1.5);
+    assert(msg->b);
+    assert(msg->u64 == 2);
+    assert(msg->body.data.code == 3);
+    dispatch_01_destroy(&msg);
+}
+
+
+static void
+test_etype(void)
+{
+    struct dispatch_01 *msg;
+    unsigned i;
+    static struct {
+        const char *data;
+        size_t sz;
+    } etype[] = {
+        /* s64 as fixed32 */
+        {"\x25\x01\x00\x00\x00", 5},
+        /* name as a varint */
+        {"\x78\x01", 2},
+        /* fx as a varint, the first two byte key */
+        {"\x80\x01\x05", 3},
+        /* u64 as bytes */
+        {"\xe2\x12\x01\x00", 4},
+        /* code as bytes */
+        {"\xc2\x3e\x01\x00", 4},
+        /* text as a varint */
+        {"\x70\x01", 2},
+    };
+
+    msg = dispatch_01_new();
+    assert(msg != NULL);
+    for (i = 0; i < countof(etype); ++i) {
+        assert(decode(etype[i].data, etype[i].sz, msg) == MNPB_ETYPE);
+        (void)dispatch_01_fini(msg);
+        memset(msg, 0, sizeof(*msg));
+    }
+    dispatch_01_destroy(&msg);
+}
+
+
+static void
+test_unknown(void)
+{
+    struct dispatch_01 *msg;
+    /* 5 as a varint, 17 as bytes, 999 as fixed32, then text */
+    static const char unknown[] =
+        "\x28\x01"
+        "\x8a\x01\x01\x00"
+        "\xbd\x3e\x01\x00\x00\x00"
+        "\x72\x02\x68\x69";
+
+    msg = dispatch_01_new();
+    assert(msg != NULL);
+    assert(decode(unknown, sizeof(unknown) - 1, msg) ==
+           (ssize_t)sizeof(unknown) - 1);
+    assert(DISPATCH_01_PROTO_GETFNUM(msg, body) ==
+           DISPATCH_01_PROTO_FNUM(body, text));
+    assert(strcmp(BCDATA(msg->body.data.text), "hi") == 0);
+    dispatch_01_destroy(&msg);
+}
+
+
+int
+main(void)
+{
+    test_roundtrip();
+    test_widen();
+    test_etype();
+    test_unknown();
+    return 0;
+}
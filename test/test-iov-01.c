@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/iov-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define THRESHOLD 256
+#define NCHUNKS 10
+#define NPARTS 10
+
+
+static mnbytes_t *
+blob_new(size_t sz, int c)
+{
+    mnbytes_t *res;
+
+    res = bytes_new(sz);
+    memset(BDATA(res), c, sz);
+    /* owned by the message */
+    BYTES_INCREF(res);
+    return res;
+}
+
+
+int
+main(void)
+{
+    struct iov_01 *msg;
+    struct iov_01_Part *parts;
+    mnbytes_t **chunks;
+    mnbytestream_t bs0, bs1;
+    mnpb_iov_t iov;
+    struct iovec *vec;
+    ssize_t sz;
+    int niov, i, nref, found;
+
+    msg = iov_01_new();
+    assert(msg != NULL);
+    msg->id = 123;
+    msg->name = bytes_new_from_str("FOO");
+    msg->blob = blob_new(100000, 'b');
+    chunks = iov_01_chunks_alloc(msg, NCHUNKS);
+    for (i = 0; i < NCHUNKS; ++i) {
+        /* around the threshold */
+        chunks[i] = blob_new(THRESHOLD - NCHUNKS / 2 + i, 'a' + i);
+    }
+    parts = iov_01_parts_alloc(msg, NPARTS);
+    for (i = 0; i < NPARTS; ++i) {
+        int32_t *values;
+
+        parts[i].label = bytes_printf("part-%d", i);
+        parts[i].data = blob_new(i * 100, 'A' + i);
+        values = iov_01_Part_values_alloc(&parts[i], 3);
+        values[0] = -i;
+        values[1] = i * 1000;
+        values[2] = 0;
+    }
+
+    (void)bytestream_init(&bs0, 32);
+    sz = iov_01_pack(&bs0, msg);
+    assert(sz == SEOD(&bs0));
+
+    /*
+     * the vector adds up to what _pack writes
+     */
+    nref = msg->blob->nref;
+    assert(mnpb_iov_init(&iov, THRESHOLD) == 0);
+
+    /* nothing yet */
+    assert(mnpb_iov_vec(&iov, &vec, &niov) == 0);
+    assert(niov == 0);
+
+    assert(iov_01_pack_iov(&iov, msg) == sz);
+    assert(mnpb_iov_vec(&iov, &vec, &niov) == 0);
+    assert(vec != NULL);
+    assert(niov > 1);
+
+    (void)bytestream_init(&bs1, 32);
+    found = 0;
+    for (i = 0; i < niov; ++i) {
+        (void)bytestream_cat(&bs1, vec[i].iov_len, vec[i].iov_base);
+        if (vec[i].iov_base == BDATA(msg->blob)) {
+            assert(vec[i].iov_len == BSZ(msg->blob));
+            ++found;
+        }
+        /* small ones are copied */
+        assert(vec[i].iov_base != BDATA(msg->name));
+        assert(vec[i].iov_base != BDATA(chunks[0]));
+    }
+    assert(SEOD(&bs1) == sz);
+    assert(memcmp(SDATA(&bs1, 0), SDATA(&bs0, 0), sz) == 0);
+
+    /*
+     * large ones are referenced, and held
+     */
+    assert(found == 1);
+    assert(msg->blob->nref == nref + 1);
+
+    /*
+     * reuse, the holds are dropped
+     */
+    mnpb_iov_reset(&iov);
+    assert(msg->blob->nref == nref);
+    assert(iov_01_pack_iov(&iov, msg) == sz);
+    assert(mnpb_iov_vec(&iov, &vec, &niov) == 0);
+    bytestream_rewind(&bs1);
+    for (i = 0; i < niov; ++i) {
+        (void)bytestream_cat(&bs1, vec[i].iov_len, vec[i].iov_base);
+    }
+    assert(SEOD(&bs1) == sz);
+    assert(memcmp(SDATA(&bs1, 0), SDATA(&bs0, 0), sz) == 0);
+
+    /*
+     * the holds outlive the message
+     */
+    iov_01_destroy(&msg);
+    bytestream_rewind(&bs1);
+    for (i = 0; i < niov; ++i) {
+        (void)bytestream_cat(&bs1, vec[i].iov_len, vec[i].iov_base);
+    }
+    assert(memcmp(SDATA(&bs1, 0), SDATA(&bs0, 0), sz) == 0);
+
+    mnpb_iov_fini(&iov);
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs1);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/lazy-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 100
+
+static mnbytes_t _foo = BYTES_INITIALIZER("FOO");
+static mnbytes_t _bar = BYTES_INITIALIZER("BAR");
+
+
+int
+main(void)
+{
+    struct lazy_01 *lz0, *lz1, *lz2;
+    struct lazy_01_Body *body;
+    int64_t *values;
+    mnbytestream_t bs0, bs1, bs2;
+    mnpb_iov_t iov;
+    mnbytes_t *s, *raw;
+    ssize_t sz;
+    int i;
+
+    lz0 = lazy_01_new();
+    assert(lz0 != NULL);
+    lz1 = lazy_01_new();
+    assert(lz1 != NULL);
+
+    /*
+     * never decoded: built directly
+     */
+    lz0->route = 42;
+    lz0->tag = &_foo;
+    BYTES_INCREF(lz0->tag);
+    lz0->body.name = &_bar;
+    BYTES_INCREF(lz0->body.name);
+    values = lazy_01_Body_values_alloc(&lz0->body, NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        values[i] = (int64_t)i << 20;
+    }
+    lz0->body.trailer.checksum = 0xdeadbeef;
+
+    (void)bytestream_init(&bs0, 32);
+    sz = lazy_01_pack(&bs0, lz0);
+    assert(sz == (ssize_t)lazy_01_sz(lz0));
+
+    s = bytes_new_from_mem_len(SPDATA(&bs0), SEOD(&bs0));
+    bytestream_from_bytes(&bs1, s);
+    SEOD(&bs1) = BSZ(s);
+    (void)lazy_01_rawsz(lz1, SEOD(&bs1));
+    sz = lazy_01_unpack(&bs1, NULL, lz1);
+    assert(sz == SEOD(&bs1));
+
+    /*
+     * the body is kept raw, and packed back untouched
+     */
+    assert(lz1->route == 42);
+    assert(bytes_cmp(lz1->tag, &_foo) == 0);
+    assert(lz1->body.name == NULL);
+    assert(lz1->body.values.sz == 0);
+
+    (void)bytestream_init(&bs2, 32);
+    sz = lazy_01_pack(&bs2, lz1);
+    assert(sz == (ssize_t)lazy_01_sz(lz1));
+    assert(SEOD(&bs2) == SEOD(&bs0));
+    assert(memcmp(SPDATA(&bs2), SPDATA(&bs0), SEOD(&bs0)) == 0);
+
+    /*
+     * same for the reverse encoder
+     */
+    bytestream_rewind(&bs2);
+    sz = lazy_01_pack_reverse(&bs2, lz1);
+    assert(SEOD(&bs2) == SEOD(&bs0));
+    assert(memcmp(SPDATA(&bs2), SPDATA(&bs0), SEOD(&bs0)) == 0);
+
+    /*
+     * first access decodes it
+     */
+    body = lazy_01_get_body(lz1);
+    assert(body == &lz1->body);
+    assert(bytes_cmp(body->name, &_bar) == 0);
+    assert(body->values.sz == NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        assert(body->values.data[i] == (int64_t)i << 20);
+    }
+    assert(lazy_01_get_body(lz1) == body);
+
+    /*
+     * nested ones are lazy as well
+     */
+    assert(body->trailer.checksum == 0);
+    assert(lazy_01_Body_get_trailer(body)->checksum == 0xdeadbeef);
+
+    /*
+     * and from now on it is packed from the decoded message
+     */
+    body->trailer.checksum = 0;
+    lz0->body.trailer.checksum = 0;
+    bytestream_rewind(&bs0);
+    (void)lazy_01_pack(&bs0, lz0);
+    bytestream_rewind(&bs2);
+    sz = lazy_01_pack(&bs2, lz1);
+    assert(sz == (ssize_t)lazy_01_sz(lz1));
+    assert(SEOD(&bs2) == SEOD(&bs0));
+    assert(memcmp(SPDATA(&bs2), SPDATA(&bs0), SEOD(&bs0)) == 0);
+
+    bytestream_rewind(&bs2);
+    (void)lazy_01_dump(&bs2, lz1);
+    TRACE("dump: %s", SPDATA(&bs2));
+
+    /*
+     * the raw body referenced by an iov is held by both
+     */
+    lz2 = lazy_01_new();
+    assert(lz2 != NULL);
+    bytestream_from_bytes(&bs1, s);
+    SEOD(&bs1) = BSZ(s);
+    (void)lazy_01_rawsz(lz2, SEOD(&bs1));
+    sz = lazy_01_unpack(&bs1, NULL, lz2);
+    assert(sz == SEOD(&bs1));
+    assert(lz2->_mnpbcc_lazy_body != NULL);
+    assert(mnpb_iov_init(&iov, 16) == 0);
+    assert(lazy_01_pack_iov(&iov, lz2) == sz);
+    assert(lz2->_mnpbcc_lazy_body->nref == 2);
+    mnpb_iov_fini(&iov);
+    assert(lz2->_mnpbcc_lazy_body->nref == 1);
+    lazy_01_destroy(&lz2);
+
+    /*
+     * a raw body whose name runs past its end fails on access
+     */
+    lz2 = lazy_01_new();
+    assert(lz2 != NULL);
+    bytestream_rewind(&bs2);
+    (void)bytestream_cat(&bs2, 7, "\x12\x05\x0a\x7f" "BAR");
+    (void)lazy_01_rawsz(lz2, SEOD(&bs2));
+    assert(lazy_01_unpack(&bs2, NULL, lz2) == SEOD(&bs2));
+    assert(lazy_01_get_body(lz2) == NULL);
+    lazy_01_destroy(&lz2);
+
+    /*
+     * a raw body length that cannot be buffered
+     */
+    lz2 = lazy_01_new();
+    assert(lz2 != NULL);
+    bytestream_rewind(&bs2);
+    (void)bytestream_cat(&bs2, 1, "\x12");
+    assert(mnpb_envarint(&bs2, UINT64_MAX) > 0);
+    (void)bytestream_cat(&bs2, 3, "BAR");
+    (void)lazy_01_rawsz(lz2, SEOD(&bs2));
+    assert(lazy_01_unpack(&bs2, NULL, lz2) == MNPB_ESIZE);
+    assert(lz2->_mnpbcc_lazy_body == NULL);
+    bytestream_rewind(&bs2);
+    raw = NULL;
+    assert(mnpb_deslice(&bs2, NULL, SIZE_MAX - 8, &raw) == MNPB_ESIZE);
+    assert(raw == NULL);
+    lazy_01_destroy(&lz2);
+
+    lazy_01_destroy(&lz0);
+    assert(lz0 == NULL);
+    lazy_01_destroy(&lz1);
+    assert(lz1 == NULL);
+
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs2);
+    BYTES_DECREF(&s);
+
+    return 0;
+}
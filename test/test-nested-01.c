@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/nested-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NNODES 8
+#define NLEAVES 8
+#define NMARKS 4
+
+
+static void
+fill_leaf(struct nested_01_Node_Leaf *leaf, int i)
+{
+    uint64_t *marks;
+    int j;
+
+    leaf->value = -i;
+    leaf->tip.label = bytes_printf("tip-%d", i);
+    marks = nested_01_Node_Leaf_Tip_marks_alloc(&leaf->tip, NMARKS);
+    for (j = 0; j < NMARKS; ++j) {
+        marks[j] = (uint64_t)i << (j * 8);
+    }
+}
+
+
+static void
+fill_node(struct nested_01_Node *node, int i)
+{
+    struct nested_01_Node_Leaf *leaves;
+    int j;
+
+    node->name = bytes_printf("node-%d", i);
+    fill_leaf(&node->leaf, i);
+    leaves = nested_01_Node_leaves_alloc(node, NLEAVES);
+    for (j = 0; j < NLEAVES; ++j) {
+        fill_leaf(&leaves[j], i * NLEAVES + j);
+    }
+}
+
+
+static void
+cmp_leaf(struct nested_01_Node_Leaf *a, struct nested_01_Node_Leaf *b)
+{
+    size_t i;
+
+    assert(a->value == b->value);
+    assert(bytes_cmp(a->tip.label, b->tip.label) == 0);
+    assert(a->tip.marks.sz == b->tip.marks.sz);
+    for (i = 0; i < a->tip.marks.sz; ++i) {
+        assert(a->tip.marks.data[i] == b->tip.marks.data[i]);
+    }
+}
+
+
+static void
+cmp_node(struct nested_01_Node *a, struct nested_01_Node *b)
+{
+    size_t i;
+
+    assert(bytes_cmp(a->name, b->name) == 0);
+    cmp_leaf(&a->leaf, &b->leaf);
+    assert(a->leaves.sz == b->leaves.sz);
+    for (i = 0; i < a->leaves.sz; ++i) {
+        cmp_leaf(&a->leaves.data[i], &b->leaves.data[i]);
+    }
+}
+
+
+int
+main(void)
+{
+    struct nested_01 *n0, *n1;
+    struct nested_01_Node *nodes;
+    mnbytestream_t bs0, bs1;
+    ssize_t sz;
+    size_t i;
+
+    n0 = nested_01_new();
+    assert(n0 != NULL);
+    n0->id = 123;
+    fill_node(&n0->root, 0);
+    nodes = nested_01_nodes_alloc(n0, NNODES);
+    for (i = 0; i < NNODES; ++i) {
+        fill_node(&nodes[i], i + 1);
+    }
+
+    /*
+     * _pack refreshes the cached sizes itself
+     */
+    (void)bytestream_init(&bs0, 32);
+    sz = nested_01_pack(&bs0, n0);
+    assert(sz == SEOD(&bs0));
+    assert((size_t)sz == n0->_mnpbcc_cachedsz);
+    assert(n0->root.leaf._mnpbcc_cachedsz ==
+           nested_01_Node_Leaf_sz(&n0->root.leaf));
+
+    /*
+     * after a change, _sz followed by _pack_cached yields the same
+     * bytes as _pack
+     */
+    BYTES_DECREF(&n0->nodes.data[NNODES - 1].leaves.data[0].tip.label);
+    n0->nodes.data[NNODES - 1].leaves.data[0].tip.label =
+        bytes_new_from_str("a considerably longer label than before");
+    bytestream_rewind(&bs0);
+    sz = nested_01_pack(&bs0, n0);
+    assert(sz == SEOD(&bs0));
+
+    (void)bytestream_init(&bs1, 32);
+    assert((ssize_t)nested_01_sz(n0) == sz);
+    assert(nested_01_pack_cached(&bs1, n0) == sz);
+    assert(SEOD(&bs1) == sz);
+    assert(memcmp(SPDATA(&bs0), SPDATA(&bs1), sz) == 0);
+    bytestream_fini(&bs1);
+
+    /*
+     * round trip
+     */
+    n1 = nested_01_new();
+    assert(n1 != NULL);
+    SPOS(&bs0) = 0;
+    (void)nested_01_rawsz(n1, SEOD(&bs0));
+    assert(nested_01_unpack(&bs0, NULL, n1) == sz);
+    assert(n1->id == n0->id);
+    cmp_node(&n0->root, &n1->root);
+    assert(n1->nodes.sz == n0->nodes.sz);
+    for (i = 0; i < n0->nodes.sz; ++i) {
+        cmp_node(&n0->nodes.data[i], &n1->nodes.data[i]);
+    }
+
+    nested_01_destroy(&n1);
+    nested_01_destroy(&n0);
+    bytestream_fini(&bs0);
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/predict-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+
+static void
+predict_01_fill(struct predict_01 *msg)
+{
+    int32_t *ri;
+    struct predict_01_item *items;
+
+    msg->a = 1;
+    msg->item.code = 5;
+    msg->item.label = bytes_new_from_str("x");
+    BYTES_INCREF(msg->item.label);
+    msg->b = -3;
+    ri = predict_01_ri_alloc(msg, 2);
+    assert(ri != NULL);
+    ri[0] = 1;
+    ri[1] = 2;
+    items = predict_01_items_alloc(msg, 2);
+    assert(items != NULL);
+    memset(items, 0, sizeof(*items) * 2);
+    items[0].code = 1;
+    items[1].code = 2;
+    msg->name = bytes_new_from_str("abc");
+    BYTES_INCREF(msg->name);
+    PREDICT_01_PROTO_SET(msg, body, text, bytes_new_from_str("hi"));
+    BYTES_INCREF(msg->body.data.text);
+    msg->last = 9;
+}
+
+
+static void
+predict_01_cmp(struct predict_01 *a, struct predict_01 *b)
+{
+    size_t i;
+
+    assert(a->a == b->a);
+    assert(a->item.code == b->item.code);
+    assert(bytes_cmp(a->item.label, b->item.label) == 0);
+    assert(a->b == b->b);
+    assert(a->ri.sz == b->ri.sz);
+    for (i = 0; i < a->ri.sz; ++i) {
+        assert(a->ri.data[i] == b->ri.data[i]);
+    }
+    assert(a->items.sz == b->items.sz);
+    for (i = 0; i < a->items.sz; ++i) {
+        assert(a->items.data[i].code == b->items.data[i].code);
+    }
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(a->body.fnum == b->body.fnum);
+    assert(bytes_cmp(a->body.data.text, b->body.data.text) == 0);
+    assert(a->last == b->last);
+}
+
+
+static ssize_t
+decode(const char *data, size_t sz, struct predict_01 *msg)
+{
+    mnbytestream_t bs;
+    ssize_t res;
+
+    (void)bytestream_init(&bs, sz);
+    (void)bytestream_cat(&bs, sz, data);
+    (void)predict_01_rawsz(msg, SEOD(&bs));
+    res = predict_01_unpack(&bs, NULL, msg);
+    bytestream_fini(&bs);
+    return res;
+}
+
+
+/*
+ * in the order of _pack, every key after the first one is predicted
+ */
+static void
+test_in_order(void)
+{
+    struct predict_01 *msg0, *msg1;
+    mnbytestream_t bs;
+    ssize_t sz;
+
+    msg0 = predict_01_new();
+    assert(msg0 != NULL);
+    predict_01_fill(msg0);
+
+    (void)bytestream_init(&bs, 32);
+    sz = predict_01_pack(&bs, msg0);
+    assert(sz > 0);
+
+    msg1 = predict_01_new();
+    assert(msg1 != NULL);
+    assert(decode(SDATA(&bs, 0), sz, msg1) == sz);
+    predict_01_cmp(msg0, msg1);
+
+    bytestream_rewind(&bs);
+    assert(predict_01_pack(&bs, msg1) == sz);
+
+    bytestream_fini(&bs);
+    predict_01_destroy(&msg0);
+    predict_01_destroy(&msg1);
+}
+
+
+static void
+test_fallback(void)
+{
+    struct predict_01 *msg;
+    /* last, name, b, a: no key is the predicted one */
+    static const char reversed[] =
+        "\xc5\x0c\x09\x00\x00\x00"
+        "\x32\x01\x6e"
+        "\x18\x05"
+        "\x08\x07";
+    /* a, then b where item is expected */
+    static const char skipped[] = "\x08\x01\x18\x05";
+    /*
+     * item ends where the parent's item begins again, its key is also
+     * that of item.label
+     */
+    static const char nested[] = "\x12\x02\x08\x01\x12\x02\x08\x02";
+    /* text, then field 216, whose key shares its first byte with last */
+    static const char prefix[] = "\x3a\x02\x68\x69\xc5\x0d\x01\x00\x00\x00";
+    /* a, then item as a varint */
+    static const char etype[] = "\x08\x01\x10\x05";
+
+    msg = predict_01_new();
+    assert(msg != NULL);
+
+    assert(decode(reversed, sizeof(reversed) - 1, msg) ==
+           (ssize_t)sizeof(reversed) - 1);
+    assert(msg->last == 9);
+    assert(strcmp(BCDATA(msg->name), "n") == 0);
+    assert(msg->b == -3);
+    assert(msg->a == 7);
+    (void)predict_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(skipped, sizeof(skipped) - 1, msg) ==
+           (ssize_t)sizeof(skipped) - 1);
+    assert(msg->a == 1);
+    assert(msg->b == -3);
+    (void)predict_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(nested, sizeof(nested) - 1, msg) ==
+           (ssize_t)sizeof(nested) - 1);
+    assert(msg->item.code == 2);
+    assert(msg->item.label == NULL);
+    (void)predict_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(prefix, sizeof(prefix) - 1, msg) ==
+           (ssize_t)sizeof(prefix) - 1);
+    assert(PREDICT_01_PROTO_GETFNUM(msg, body) ==
+           PREDICT_01_PROTO_FNUM(body, text));
+    assert(msg->last == 0);
+    (void)predict_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(etype, sizeof(etype) - 1, msg) == MNPB_ETYPE);
+
+    predict_01_destroy(&msg);
+}
+
+
+int
+main(void)
+{
+    test_in_order();
+    test_fallback();
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/project-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 10
+
+
+static void
+project_01_item_fill(struct project_01_item *item, int i)
+{
+    int64_t *values;
+    int j;
+
+    item->code = (uint32_t)i + 1;
+    item->label = bytes_printf("label-%d", i);
+    BYTES_INCREF(item->label);
+    values = project_01_item_values_alloc(item, i + 1);
+    assert(values != NULL);
+    for (j = 0; j <= i; ++j) {
+        values[j] = -j;
+    }
+}
+
+
+static void
+project_01_fill(struct project_01 *msg)
+{
+    mnbytes_t **tags;
+    struct project_01_item *items;
+    int i;
+
+    msg->id = 123;
+    msg->name = bytes_new_from_str("FOO");
+    BYTES_INCREF(msg->name);
+    tags = project_01_tags_alloc(msg, NITEMS);
+    items = project_01_items_alloc(msg, NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        tags[i] = bytes_printf("tag-%d", i);
+        BYTES_INCREF(tags[i]);
+        project_01_item_fill(&items[i], i);
+    }
+    msg->payload = bytes_new_from_mem_len("\x00\x01\x02", 3);
+    BYTES_INCREF(msg->payload);
+    project_01_item_fill(&msg->head, 3);
+    msg->score = 0.5;
+    PROJECT_01_PROTO_SETFNUM(msg, body, one);
+    project_01_item_fill(&PROJECT_01_PROTO_MEMBER(msg, body, one), 2);
+}
+
+
+static struct project_01 *
+decode(mnbytestream_t *bs, const struct project_01_mask *mask)
+{
+    struct project_01 *msg;
+
+    msg = project_01_new();
+    assert(msg != NULL);
+    SPOS(bs) = 0;
+    (void)project_01_rawsz(msg, SEOD(bs));
+    /*
+     * skipped fields are consumed all the same
+     */
+    assert(project_01_unpack_projected(bs, NULL, msg, mask) == SEOD(bs));
+    return msg;
+}
+
+
+int
+main(void)
+{
+    struct project_01 *msg0, *msg1;
+    struct project_01_mask mask;
+    struct project_01_item_mask imask;
+    mnbytestream_t bs;
+    size_t i;
+
+    msg0 = project_01_new();
+    assert(msg0 != NULL);
+    project_01_fill(msg0);
+    (void)bytestream_init(&bs, 32);
+    assert(project_01_pack(&bs, msg0) == (ssize_t)project_01_sz(msg0));
+
+    /*
+     * nothing
+     */
+    memset(&mask, 0, sizeof(mask));
+    msg1 = decode(&bs, &mask);
+    assert(msg1->id == 0);
+    assert(msg1->name == NULL);
+    assert(msg1->tags.sz == 0 && msg1->tags.data == NULL);
+    assert(msg1->items.sz == 0 && msg1->items.data == NULL);
+    assert(msg1->head.label == NULL);
+    assert(msg1->body.fnum == 0);
+    project_01_destroy(&msg1);
+
+    /*
+     * scalars and a string
+     */
+    MNPB_MASK_SET(&mask, PROJECT_01_MASK_id);
+    MNPB_MASK_SET(&mask, PROJECT_01_MASK_score);
+    MNPB_MASK_SET(&mask, PROJECT_01_MASK_name);
+    msg1 = decode(&bs, &mask);
+    assert(msg1->id == msg0->id);
+    assert(msg1->score == msg0->score);
+    assert(bytes_cmp(msg1->name, msg0->name) == 0);
+    assert(msg1->payload == NULL);
+    assert(msg1->tags.sz == 0);
+    assert(msg1->items.sz == 0);
+    project_01_destroy(&msg1);
+
+    /*
+     * embedded messages: all of head, the labels of items, the codes of
+     * the oneof member
+     */
+    memset(&mask, 0, sizeof(mask));
+    memset(&imask, 0, sizeof(imask));
+    MNPB_MASK_SET(&imask, PROJECT_01_ITEM_MASK_label);
+    MNPB_MASK_SET(&mask, PROJECT_01_MASK_head);
+    MNPB_MASK_SET(&mask, PROJECT_01_MASK_items);
+    mask.items = &imask;
+    msg1 = decode(&bs, &mask);
+    assert(msg1->head.code == msg0->head.code);
+    assert(bytes_cmp(msg1->head.label, msg0->head.label) == 0);
+    assert(msg1->head.values.sz == msg0->head.values.sz);
+    assert(msg1->items.sz == NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        assert(msg1->items.data[i].code == 0);
+        assert(bytes_cmp(msg1->items.data[i].label,
+                         msg0->items.data[i].label) == 0);
+        assert(msg1->items.data[i].values.sz == 0);
+    }
+    assert(msg1->body.fnum == 0);
+    project_01_destroy(&msg1);
+
+    memset(&mask, 0, sizeof(mask));
+    memset(&imask, 0, sizeof(imask));
+    MNPB_MASK_SET(&imask, PROJECT_01_ITEM_MASK_code);
+    MNPB_MASK_SET(&mask, PROJECT_01_MASK_one);
+    mask.one = &imask;
+    msg1 = decode(&bs, &mask);
+    assert(msg1->body.fnum == PROJECT_01_PROTO_FNUM_body_one);
+    assert(msg1->body.data.one.code == msg0->body.data.one.code);
+    assert(msg1->body.data.one.label == NULL);
+    project_01_destroy(&msg1);
+
+    project_01_destroy(&msg0);
+    bytestream_fini(&bs);
+
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/recfile-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NRECS 1000
+
+static mnbytes_t _foo = BYTES_INITIALIZER("FOO");
+
+
+static void
+recfile_01_fill(struct recfile_01 *msg, int64_t id)
+{
+    uint32_t *values;
+    int i;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->id = id;
+    msg->name = &_foo;
+    BYTES_INCREF(msg->name);
+    if (id % 5 != 0) {
+        values = recfile_01_values_alloc(msg, (int)(id % 5));
+        assert(values != NULL);
+        for (i = 0; i < id % 5; ++i) {
+            values[i] = (uint32_t)(id * i);
+        }
+    }
+}
+
+
+static void
+recfile_01_cmp(struct recfile_01 *a, struct recfile_01 *b)
+{
+    size_t i;
+
+    assert(a->id == b->id);
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(a->values.sz == b->values.sz);
+    for (i = 0; i < a->values.sz; ++i) {
+        assert(a->values.data[i] == b->values.data[i]);
+    }
+}
+
+
+/*
+ * keys are 2 * id, written in descending order
+ */
+static void
+write_file(const char *path, unsigned flags)
+{
+    mnpb_recwriter_t w;
+    int fd;
+    int64_t i;
+
+    assert((fd = open(path, O_WRONLY | O_TRUNC)) >= 0);
+    mnpb_recwriter_init(&w, (void *)(intptr_t)fd, flags);
+    for (i = NRECS - 1; i >= 0; --i) {
+        struct recfile_01 msg;
+
+        recfile_01_fill(&msg, i);
+        assert(recfile_01_rec_write(&w, 2 * i, &msg) ==
+               (ssize_t)(mnpb_szvarint(recfile_01_sz(&msg)) +
+                         recfile_01_sz(&msg)));
+        (void)recfile_01_fini(&msg);
+    }
+    assert(mnpb_recwriter_fini(&w) == 0);
+    (void)close(fd);
+}
+
+
+static void
+test_keyed(const char *path)
+{
+    mnpb_recfile_t rf;
+    int64_t i;
+
+    write_file(path, MNPB_RECFILE_KEYED);
+    assert(mnpb_recfile_open(&rf, path) == 0);
+    assert(MNPB_RECFILE_NRECS(&rf) == NRECS);
+
+    /*
+     * in key order
+     */
+    for (i = 0; i < NRECS; i += 7) {
+        struct recfile_01 expected, msg;
+        ssize_t sz;
+
+        assert(mnpb_recfile_key(&rf, (size_t)i) == 2 * i);
+        recfile_01_fill(&expected, i);
+        memset(&msg, 0, sizeof(msg));
+        sz = recfile_01_rec_read(&rf, (size_t)i, &msg);
+        assert(sz == (ssize_t)recfile_01_sz(&expected));
+        recfile_01_cmp(&expected, &msg);
+        (void)recfile_01_fini(&expected);
+        (void)recfile_01_fini(&msg);
+    }
+
+    assert(mnpb_recfile_find(&rf, 0) == 0);
+    assert(mnpb_recfile_find(&rf, 2 * 500) == 500);
+    assert(mnpb_recfile_find(&rf, 2 * 500 - 1) == 500);
+    assert(mnpb_recfile_find(&rf, -1) == 0);
+    assert(mnpb_recfile_find(&rf, 2 * NRECS) == NRECS);
+    assert(mnpb_recfile_seek(&rf, NRECS) == MNPB_ESIZE);
+
+    mnpb_recfile_close(&rf);
+}
+
+
+static void
+test_unkeyed(const char *path)
+{
+    mnpb_recfile_t rf;
+    struct recfile_01 expected, msg;
+
+    write_file(path, 0);
+    assert(mnpb_recfile_open(&rf, path) == 0);
+    assert(MNPB_RECFILE_NRECS(&rf) == NRECS);
+    assert(mnpb_recfile_find(&rf, 0) == MNPB_ETYPE);
+
+    /*
+     * in file order
+     */
+    recfile_01_fill(&expected, NRECS - 1);
+    memset(&msg, 0, sizeof(msg));
+    assert(recfile_01_rec_read(&rf, 0, &msg) > 0);
+    recfile_01_cmp(&expected, &msg);
+    (void)recfile_01_fini(&expected);
+    (void)recfile_01_fini(&msg);
+
+    mnpb_recfile_close(&rf);
+}
+
+
+static int
+scan_cb(struct recfile_01 *msg, size_t n, void *udata)
+{
+    size_t *count, i;
+
+    /*
+     * not with recfile_01_fill(), _foo is shared
+     */
+    count = udata;
+    assert(msg->id == (int64_t)n);
+    assert(bytes_cmp(msg->name, &_foo) == 0);
+    assert(msg->values.sz == n % 5);
+    for (i = 0; i < msg->values.sz; ++i) {
+        assert(msg->values.data[i] == (uint32_t)(n * i));
+    }
+    (void)__atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+
+static int
+scan_stop_cb(struct recfile_01 *msg, UNUSED size_t n, UNUSED void *udata)
+{
+    return msg->id == NRECS / 2 ? 7 : 0;
+}
+
+
+static void
+test_parallel(const char *path)
+{
+    mnpb_recfile_t rf;
+    int nthreads;
+
+    write_file(path, MNPB_RECFILE_KEYED);
+    assert(mnpb_recfile_open(&rf, path) == 0);
+
+    for (nthreads = 0; nthreads <= 8; nthreads += 4) {
+        size_t count;
+
+        count = 0;
+        assert(recfile_01_parallel_scan(&rf, nthreads, scan_cb, &count) == 0);
+        assert(count == NRECS);
+    }
+    assert(recfile_01_parallel_scan(&rf, 4, scan_stop_cb, NULL) == 7);
+
+    mnpb_recfile_close(&rf);
+}
+
+
+static void
+test_truncated(const char *path)
+{
+    mnpb_recfile_t rf;
+
+    write_file(path, MNPB_RECFILE_KEYED);
+    assert(truncate(path, 1000) == 0);
+    assert(mnpb_recfile_open(&rf, path) == MNPB_ETYPE);
+    assert(truncate(path, 10) == 0);
+    assert(mnpb_recfile_open(&rf, path) == MNPB_ESIZE);
+    assert(mnpb_recfile_open(&rf, "/nonexistent") == MNPB_EIO);
+}
+
+
+/*
+ * a length past the last record fails the decoder, there is nothing to
+ * read more from
+ */
+static void
+test_corrupt(const char *path)
+{
+    mnpb_recfile_t rf;
+    struct recfile_01 msg;
+    off_t off;
+    int fd;
+
+    write_file(path, 0);
+    assert(mnpb_recfile_open(&rf, path) == 0);
+    /* id 0: the name only */
+    assert(mnpb_recfile_seek(&rf, NRECS - 1) == 5);
+    off = SPOS(&rf.bs);
+    assert(*SPDATA(&rf.bs) == 0x12);
+    mnpb_recfile_close(&rf);
+
+    assert((fd = open(path, O_WRONLY)) >= 0);
+    assert(pwrite(fd, "\x7f", 1, off + 1) == 1);
+    (void)close(fd);
+
+    assert(mnpb_recfile_open(&rf, path) == 0);
+    memset(&msg, 0, sizeof(msg));
+    assert(recfile_01_rec_read(&rf, NRECS - 1, &msg) == MNPB_EIO);
+    (void)recfile_01_fini(&msg);
+    memset(&msg, 0, sizeof(msg));
+    assert(recfile_01_rec_read(&rf, 0, &msg) > 0);
+    (void)recfile_01_fini(&msg);
+    mnpb_recfile_close(&rf);
+}
+
+
+int
+main(void)
+{
+    char path[] = "/tmp/test-recfile-01.XXXXXX";
+    int fd;
+
+    assert((fd = mkstemp(path)) >= 0);
+    (void)close(fd);
+
+    test_keyed(path);
+    test_unkeyed(path);
+    test_parallel(path);
+    test_truncated(path);
+    test_corrupt(path);
+
+    (void)unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/resume-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 100
+
+static mnbytes_t _foo = BYTES_INITIALIZER("FOO");
+
+
+static void
+resume_01_fill(struct resume_01 *msg, int64_t id)
+{
+    double *samples;
+    int i;
+
+    msg->id = id;
+    msg->name = &_foo;
+    BYTES_INCREF(msg->name);
+    samples = resume_01_samples_alloc(msg, NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        samples[i] = (double)i / 3.0;
+    }
+    msg->inner.a = 0x12345;
+    msg->inner.b = -id;
+}
+
+
+static void
+resume_01_cmp(struct resume_01 *a, struct resume_01 *b)
+{
+    size_t i;
+
+    assert(a->id == b->id);
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(a->samples.sz == b->samples.sz);
+    for (i = 0; i < a->samples.sz; ++i) {
+        assert(a->samples.data[i] == b->samples.data[i]);
+    }
+    assert(a->inner.a == b->inner.a);
+    assert(a->inner.b == b->inner.b);
+}
+
+
+/*
+ * a length prefix beyond the limit fails right away, one cut short is
+ * an error once the input ends
+ */
+static void
+test_prefix(void)
+{
+    struct resume_01 *msg;
+    mnpb_decoder_t dec;
+    mnbytestream_t bs;
+    int fds[2];
+    void *fd;
+    /* SSIZE_MAX, then three bytes of it */
+    static const char huge[] =
+        "\xff\xff\xff\xff\xff\xff\xff\xff\x7f\x01\x02\x03";
+    /* MNPB_MAX_BYTES + 1 */
+    static const char over[] = "\x81\x80\x40";
+    static const char cut[] = "\x80";
+
+    msg = resume_01_new();
+    assert(msg != NULL);
+
+    assert(pipe(fds) == 0);
+    assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    fd = (void *)(intptr_t)fds[0];
+    (void)bytestream_init(&bs, 16);
+    mnpb_decoder_init(&dec);
+    assert(write(fds[1], huge, sizeof(huge) - 1) == sizeof(huge) - 1);
+    assert(resume_01_unpack_resume(&dec, &bs, fd, 0, msg) == MNPB_ESIZE);
+    bytestream_fini(&bs);
+    (void)close(fds[1]);
+    (void)close(fds[0]);
+
+    assert(pipe(fds) == 0);
+    assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    fd = (void *)(intptr_t)fds[0];
+    (void)bytestream_init(&bs, 16);
+    mnpb_decoder_init(&dec);
+    assert(write(fds[1], over, sizeof(over) - 1) == sizeof(over) - 1);
+    assert(resume_01_unpack_resume(&dec, &bs, fd, 0, msg) == MNPB_ESIZE);
+    /* within a raised limit, the frame is waited for */
+    SPOS(&bs) = 0;
+    mnpb_decoder_init(&dec);
+    dec.maxsz = 0x200000;
+    assert(resume_01_unpack_resume(&dec, &bs, fd, 0, msg) == MNPB_EAGAIN);
+    bytestream_fini(&bs);
+    (void)close(fds[1]);
+    (void)close(fds[0]);
+
+    assert(pipe(fds) == 0);
+    assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    fd = (void *)(intptr_t)fds[0];
+    (void)bytestream_init(&bs, 16);
+    mnpb_decoder_init(&dec);
+    assert(write(fds[1], cut, sizeof(cut) - 1) == sizeof(cut) - 1);
+    assert(resume_01_unpack_resume(&dec, &bs, fd, 0, msg) == MNPB_EAGAIN);
+    (void)close(fds[1]);
+    assert(resume_01_unpack_resume(&dec, &bs, fd, 0, msg) == MNPB_EIO);
+    bytestream_fini(&bs);
+    (void)close(fds[0]);
+
+    resume_01_destroy(&msg);
+}
+
+
+int
+main(void)
+{
+    struct resume_01 *msg0, *msg1;
+    mnpb_decoder_t dec;
+    mnbytestream_t bs0, bs1;
+    int fds[2];
+    void *fd;
+    ssize_t sz, half;
+    int neagain;
+
+    msg0 = resume_01_new();
+    assert(msg0 != NULL);
+    resume_01_fill(msg0, 123);
+
+    /*
+     * two frames back to back
+     */
+    (void)bytestream_init(&bs0, 32);
+    (void)mnpb_envarint(&bs0, resume_01_sz(msg0));
+    sz = resume_01_pack(&bs0, msg0);
+    assert(sz == (ssize_t)resume_01_sz(msg0));
+    (void)mnpb_envarint(&bs0, resume_01_sz(msg0));
+    (void)resume_01_pack(&bs0, msg0);
+
+    assert(pipe(fds) == 0);
+    assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    fd = (void *)(intptr_t)fds[0];
+
+    (void)bytestream_init(&bs1, 16);
+    mnpb_decoder_init(&dec);
+
+    /*
+     * nothing yet
+     */
+    msg1 = resume_01_new();
+    assert(msg1 != NULL);
+    assert(resume_01_unpack_resume(&dec, &bs1, fd, 0, msg1) == MNPB_EAGAIN);
+
+    /*
+     * the first frame in two pieces, the split falling in the middle
+     */
+    half = (sz + 1) / 2;
+    assert(write(fds[1], SPDATA(&bs0), half) == half);
+    assert(resume_01_unpack_resume(&dec, &bs1, fd, 0, msg1) == MNPB_EAGAIN);
+
+    /*
+     * the rest, with a budget smaller than the frame
+     */
+    assert(write(fds[1], SDATA(&bs0, half), SEOD(&bs0) - half) ==
+           SEOD(&bs0) - half);
+    neagain = 0;
+    while ((sz = resume_01_unpack_resume(&dec, &bs1, fd, 16, msg1)) ==
+           MNPB_EAGAIN) {
+        ++neagain;
+    }
+    assert(neagain > 0);
+    assert(sz == (ssize_t)resume_01_sz(msg0));
+    resume_01_cmp(msg0, msg1);
+    resume_01_destroy(&msg1);
+
+    /*
+     * the second frame, some of it already buffered
+     */
+    msg1 = resume_01_new();
+    assert(msg1 != NULL);
+    while ((sz = resume_01_unpack_resume(&dec, &bs1, fd, 0, msg1)) ==
+           MNPB_EAGAIN) {
+    }
+    assert(sz == (ssize_t)resume_01_sz(msg0));
+    resume_01_cmp(msg0, msg1);
+    resume_01_destroy(&msg1);
+
+    /*
+     * drained
+     */
+    assert(SAVAIL(&bs1) == 0);
+    msg1 = resume_01_new();
+    assert(msg1 != NULL);
+    assert(resume_01_unpack_resume(&dec, &bs1, fd, 0, msg1) == MNPB_EAGAIN);
+    resume_01_destroy(&msg1);
+
+    (void)close(fds[1]);
+    (void)close(fds[0]);
+    resume_01_destroy(&msg0);
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs1);
+
+    test_prefix();
+
+    return 0;
+}
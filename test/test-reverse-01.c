@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/reverse-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 40
+
+
+static void
+fill_item(struct reverse_01_item *item, int i)
+{
+    uint32_t *marks;
+    int j;
+
+    item->key = bytes_printf("key-%d", i);
+    marks = reverse_01_item_marks_alloc(item, i % 5);
+    for (j = 0; j < i % 5; ++j) {
+        marks[j] = (uint32_t)(i * 1000 + j);
+    }
+    item->sub.id = -i;
+}
+
+
+/*
+ * _pack_reverse yields the same bytes as _pack, also after a round trip
+ */
+static void
+check(struct reverse_01 *r0)
+{
+    struct reverse_01 *r1;
+    mnbytestream_t bs0, bs1, bs2;
+    mnbytes_t *s;
+    ssize_t sz;
+
+    (void)bytestream_init(&bs0, 32);
+    (void)bytestream_init(&bs1, 32);
+    (void)bytestream_init(&bs2, 32);
+
+    sz = reverse_01_pack(&bs0, r0);
+    assert(sz == SEOD(&bs0));
+    assert(reverse_01_pack_reverse(&bs1, r0) == sz);
+    assert(SEOD(&bs1) == sz);
+    assert(memcmp(SPDATA(&bs0), SPDATA(&bs1), sz) == 0);
+
+    r1 = reverse_01_new();
+    assert(r1 != NULL);
+    s = bytes_new_from_mem_len(SPDATA(&bs1), SEOD(&bs1));
+    bytestream_fini(&bs1);
+    bytestream_from_bytes(&bs1, s);
+    SEOD(&bs1) = BSZ(s);
+    (void)reverse_01_rawsz(r1, SEOD(&bs1));
+    assert(reverse_01_unpack(&bs1, NULL, r1) == sz);
+
+    assert(reverse_01_pack_reverse(&bs2, r1) == sz);
+    assert(memcmp(SPDATA(&bs0), SPDATA(&bs2), sz) == 0);
+
+    reverse_01_destroy(&r1);
+    BYTES_DECREF(&s);
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs2);
+}
+
+
+int
+main(void)
+{
+    struct reverse_01 *r0;
+    struct reverse_01_item *items;
+    mnbytes_t **tags;
+    int64_t *values;
+    double *weights;
+    mnbytestream_t bs;
+    mnpb_rbuf_t rb;
+    int i;
+
+    r0 = reverse_01_new();
+    assert(r0 != NULL);
+
+    /*
+     * nothing to write
+     */
+    (void)bytestream_init(&bs, 32);
+    assert(reverse_01_pack_reverse(&bs, r0) == 0);
+    assert(SEOD(&bs) == 0);
+    bytestream_fini(&bs);
+
+    r0->i32 = -1;
+    r0->i64 = -1234567890123;
+    r0->u32 = 0xffffffff;
+    r0->u64 = 0xffffffffffffffff;
+    r0->s32 = -300;
+    r0->s64 = INT64_MIN;
+    r0->f32 = 0x01020304;
+    r0->f64 = 0x0102030405060708;
+    r0->fl = 1.5;
+    r0->dbl = -2.25;
+    r0->flag = true;
+    r0->kind = MANY;
+    r0->name = bytes_new_from_str("FOO");
+    r0->blob = bytes_new_from_mem_len("\x00\x01\x02", 3);
+    fill_item(&r0->item, 7);
+    values = reverse_01_values_alloc(r0, NITEMS);
+    weights = reverse_01_weights_alloc(r0, NITEMS);
+    tags = reverse_01_tags_alloc(r0, NITEMS);
+    items = reverse_01_items_alloc(r0, NITEMS);
+    for (i = 0; i < NITEMS; ++i) {
+        values[i] = (int64_t)i * -100000;
+        weights[i] = (double)i / 3.0;
+        tags[i] = bytes_printf("tag-%d", i);
+        fill_item(&items[i], i);
+    }
+
+    REVERSE_01_PROTO_SETFNUM(r0, choice, picked);
+    fill_item(&r0->choice.data.picked, 3);
+    check(r0);
+
+    (void)reverse_01_item_fini(&r0->choice.data.picked);
+    REVERSE_01_PROTO_SET(r0, choice, number, 1ul << 40);
+    check(r0);
+
+    REVERSE_01_PROTO_SET(r0, choice, label, bytes_new_from_str("BAR"));
+    check(r0);
+
+    /*
+     * a tiny buffer is grown as needed, and can be reused
+     */
+    mnpb_rbuf_init(&rb, 1);
+    assert(reverse_01_pack_rbuf(&rb, r0) == (ssize_t)reverse_01_sz(r0));
+    mnpb_rbuf_reset(&rb);
+    assert(MNPB_RBUF_LEN(&rb) == 0);
+    assert(reverse_01_pack_rbuf(&rb, r0) == (ssize_t)reverse_01_sz(r0));
+    mnpb_rbuf_fini(&rb);
+
+    reverse_01_destroy(&r0);
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/stats-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#ifdef MNPB_STATS
+#define NITEMS 10
+#define NTHREADS 4
+#define NROUNDS 100
+#define NTYPES 16
+
+
+static void
+stats_01_fill(struct stats_01 *msg)
+{
+    struct stats_01_item *items;
+    int i;
+
+    msg->id = 123;
+    msg->name = bytes_new_from_str("FOO");
+    BYTES_INCREF(msg->name);
+    items = stats_01_items_alloc(msg, NITEMS);
+    assert(items != NULL);
+    for (i = 0; i < NITEMS; ++i) {
+        items[i].code = (uint32_t)i;
+        items[i].label = bytes_printf("label-%d", i);
+        BYTES_INCREF(items[i].label);
+    }
+}
+
+
+static ssize_t
+decode(mnbytestream_t *bs, struct stats_01 *msg)
+{
+    SPOS(bs) = 0;
+    (void)stats_01_clear(msg);
+    (void)stats_01_rawsz(msg, SEOD(bs));
+    return stats_01_unpack(bs, NULL, msg);
+}
+
+
+static size_t
+type_id(const char *name)
+{
+    size_t i;
+
+    for (i = 1; i < mnpb_stats_ntypes(); ++i) {
+        if (strcmp(mnpb_stats_name(i), name) == 0) {
+            return i;
+        }
+    }
+    assert(0);
+    return 0;
+}
+
+
+static void *
+worker(void *arg)
+{
+    /* own position over the shared data */
+    mnbytestream_t bs = *(mnbytestream_t *)arg;
+    struct stats_01 msg;
+    int i;
+
+    memset(&msg, 0, sizeof(msg));
+    for (i = 0; i < NROUNDS; ++i) {
+        assert(decode(&bs, &msg) == SEOD(&bs));
+    }
+    (void)stats_01_fini(&msg);
+    return NULL;
+}
+
+
+int
+main(void)
+{
+    struct stats_01 *msg0, *msg1;
+    mnbytestream_t bs, bad;
+    mnpb_stats_t stats[NTYPES], total;
+    size_t top, item, ntypes;
+    pthread_t threads[NTHREADS];
+    mnpb_stream_t st;
+    int fds[2];
+    ssize_t sz;
+    int i;
+
+    msg0 = stats_01_new();
+    assert(msg0 != NULL);
+    stats_01_fill(msg0);
+    (void)bytestream_init(&bs, 32);
+    assert((sz = stats_01_pack(&bs, msg0)) == (ssize_t)stats_01_sz(msg0));
+
+    /*
+     * types are registered on first use, nested bytes count for both
+     */
+    top = type_id("stats_01");
+    item = type_id("stats_01_item");
+    ntypes = mnpb_stats_thread(stats, NTYPES);
+    assert(ntypes == 3 && ntypes <= NTYPES);
+    assert(stats[top].nencoded == 1);
+    assert(stats[top].bencoded == (uint64_t)sz);
+    assert(stats[item].nencoded == NITEMS);
+    assert(stats[item].bencoded > 0 && stats[item].bencoded < (uint64_t)sz);
+    assert(stats[top].ndecoded == 0);
+
+    msg1 = stats_01_new();
+    assert(msg1 != NULL);
+    assert(decode(&bs, msg1) == sz);
+    (void)mnpb_stats_thread(stats, NTYPES);
+    assert(stats[top].ndecoded == 1);
+    assert(stats[top].bdecoded == (uint64_t)sz);
+    assert(stats[item].ndecoded == NITEMS);
+    assert(stats[top].nalloc > 0);
+    assert(stats[item].nalloc == NITEMS);
+    assert(stats[top].nvoid == 0);
+
+    /*
+     * an unknown field
+     */
+    SEOD(&bs) = sz;
+    assert(mnpb_entag(&bs, 0x48ull, 1) == 1);
+    assert(mnpb_envarint(&bs, 77) == 1);
+    assert(decode(&bs, msg1) == sz + 2);
+    (void)mnpb_stats_thread(stats, NTYPES);
+    assert(stats[top].nvoid == 1);
+    assert(stats[item].nvoid == 0);
+
+    /*
+     * errors are counted once, by the innermost type
+     */
+    (void)bytestream_init(&bad, 32);
+    assert(mnpb_entag(&bad, 0x12ull, 1) == 1);
+    assert(mnpb_envarint(&bad, 3) == 1);
+    assert(mnpb_envarint(&bad, 2) == 1);
+    assert(mnpb_entag(&bad, 0x10ull, 1) == 1);
+    assert(mnpb_envarint(&bad, 1) == 1);
+    assert(decode(&bad, msg1) == MNPB_ETYPE);
+    SEOD(&bad) = 0;
+    assert(mnpb_entag(&bad, 0x10ull, 1) == 1);
+    assert(mnpb_envarint(&bad, 1) == 1);
+    assert(decode(&bad, msg1) == MNPB_ETYPE);
+    (void)mnpb_stats_thread(stats, NTYPES);
+    assert(stats[item].nerror[-MNPB_ETYPE] == 1);
+    assert(stats[top].nerror[-MNPB_ETYPE] == 1);
+    assert(stats[top].ndecoded == 2);
+
+    /*
+     * refills of a stream, outside and within the decoder
+     */
+    assert(pipe(fds) == 0);
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[1], 64);
+    for (i = 0; i < NROUNDS; ++i) {
+        assert(stats_01_stream_write(&st, msg0) > 0);
+    }
+    assert(mnpb_stream_flush(&st) == 0);
+    assert(mnpb_stream_fini(&st) == 0);
+    (void)close(fds[1]);
+    mnpb_stats_reset();
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[0], 16);
+    for (i = 0; i < NROUNDS; ++i) {
+        assert(stats_01_stream_read(&st, msg1) > 0);
+    }
+    assert(stats_01_stream_read(&st, msg1) == MNPB_EOF);
+    (void)mnpb_stream_fini(&st);
+    (void)close(fds[0]);
+    (void)mnpb_stats_thread(stats, NTYPES);
+    assert(stats[top].ndecoded == NROUNDS);
+    assert(stats[0].nrefill + stats[top].nrefill + stats[item].nrefill >=
+           (uint64_t)(sz * NROUNDS / 16));
+    assert(stats[top].nerror[-MNPB_ETYPE] == 0);
+
+    /*
+     * across threads, those that have exited included
+     */
+    mnpb_stats_reset();
+    SEOD(&bs) = sz;
+    for (i = 0; i < NTHREADS; ++i) {
+        assert(pthread_create(&threads[i], NULL, worker, &bs) == 0);
+    }
+    for (i = 0; i < NTHREADS; ++i) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    (void)mnpb_stats_thread(stats, NTYPES);
+    assert(stats[top].ndecoded == 0);
+    (void)mnpb_stats_aggregate(stats, NTYPES);
+    assert(stats[top].ndecoded == NTHREADS * NROUNDS);
+    assert(stats[top].bdecoded == (uint64_t)(NTHREADS * NROUNDS * sz));
+    assert(stats[item].ndecoded == NTHREADS * NROUNDS * NITEMS);
+    (void)mnpb_stats_aggregate(&total, 1);
+    assert(total.ndecoded == 0);
+
+    /*
+     * resets while threads count, then of exited threads
+     */
+    for (i = 0; i < NTHREADS; ++i) {
+        assert(pthread_create(&threads[i], NULL, worker, &bs) == 0);
+    }
+    for (i = 0; i < NROUNDS; ++i) {
+        mnpb_stats_reset();
+    }
+    for (i = 0; i < NTHREADS; ++i) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    (void)mnpb_stats_aggregate(stats, NTYPES);
+    assert(stats[top].ndecoded <= NTHREADS * NROUNDS);
+    mnpb_stats_reset();
+    (void)mnpb_stats_aggregate(stats, NTYPES);
+    assert(stats[top].ndecoded == 0);
+    assert(stats[item].ndecoded == 0);
+
+    stats_01_destroy(&msg0);
+    stats_01_destroy(&msg1);
+    bytestream_fini(&bs);
+    bytestream_fini(&bad);
+
+    return 0;
+}
+#else
+int
+main(void)
+{
+    return 0;
+}
+#endif
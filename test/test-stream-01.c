@@ -0,0 +1,248 @@
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/stream-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NMSGS 50
+
+static mnbytes_t _foo = BYTES_INITIALIZER("FOO");
+
+
+static void
+stream_01_fill(struct stream_01 *msg, int64_t id)
+{
+    double *samples;
+    int i;
+
+    msg->id = id;
+    msg->name = &_foo;
+    BYTES_INCREF(msg->name);
+    /*
+     * frames of varying size, some of them empty
+     */
+    if (id % 3 != 0) {
+        samples = stream_01_samples_alloc(msg, (int)(id % 7));
+        assert(samples != NULL || id % 7 == 0);
+        for (i = 0; i < id % 7; ++i) {
+            samples[i] = (double)i / 3.0;
+        }
+    }
+    msg->inner.a = 0x12345;
+    msg->inner.b = -id;
+}
+
+
+static void
+stream_01_cmp(struct stream_01 *a, struct stream_01 *b)
+{
+    size_t i;
+
+    assert(a->id == b->id);
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(a->samples.sz == b->samples.sz);
+    for (i = 0; i < a->samples.sz; ++i) {
+        assert(a->samples.data[i] == b->samples.data[i]);
+    }
+    assert(a->inner.a == b->inner.a);
+    assert(a->inner.b == b->inner.b);
+}
+
+
+static void
+write_all(int fd)
+{
+    mnpb_stream_t st;
+    int64_t i;
+
+    mnpb_stream_init(&st, (void *)(intptr_t)fd, 64);
+    for (i = 0; i < NMSGS; ++i) {
+        struct stream_01 msg;
+
+        memset(&msg, 0, sizeof(msg));
+        stream_01_fill(&msg, i);
+        assert(stream_01_stream_write(&st, &msg) > 0);
+        /*
+         * batched
+         */
+        assert((size_t)SEOD(&st.bs) < st.flushsz);
+        (void)stream_01_fini(&msg);
+    }
+    assert(mnpb_stream_flush(&st) == 0);
+    assert(SEOD(&st.bs) == 0);
+    assert(mnpb_stream_fini(&st) == 0);
+}
+
+
+static void
+read_all(int fd, mnpb_arena_t *arena)
+{
+    mnpb_stream_t st;
+    struct stream_01 msg;
+    ssize_t sz;
+    int64_t i;
+
+    /*
+     * smaller than most frames
+     */
+    mnpb_stream_init(&st, (void *)(intptr_t)fd, 16);
+    st.arena = arena;
+    memset(&msg, 0, sizeof(msg));
+    for (i = 0; (sz = stream_01_stream_read(&st, &msg)) >= 0; ++i) {
+        struct stream_01 expected;
+
+        memset(&expected, 0, sizeof(expected));
+        stream_01_fill(&expected, i);
+        assert(sz == (ssize_t)stream_01_sz(&expected));
+        stream_01_cmp(&expected, &msg);
+        (void)stream_01_fini(&expected);
+    }
+    assert(sz == MNPB_EOF);
+    assert(i == NMSGS);
+    /*
+     * one frame at most is ever buffered
+     */
+    assert(st.bs.buf.sz < 256);
+    if (arena == NULL) {
+        (void)stream_01_fini(&msg);
+    }
+    (void)mnpb_stream_fini(&st);
+}
+
+
+static void
+test_truncated(void)
+{
+    mnpb_stream_t st;
+    struct stream_01 msg;
+    int fds[2];
+
+    assert(pipe(fds) == 0);
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[1], 64);
+    memset(&msg, 0, sizeof(msg));
+    stream_01_fill(&msg, 5);
+    assert(stream_01_stream_write(&st, &msg) > 0);
+    --SEOD(&st.bs);
+    assert(mnpb_stream_flush(&st) == 0);
+    assert(mnpb_stream_fini(&st) == 0);
+    (void)close(fds[1]);
+
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[0], 16);
+    assert(stream_01_stream_read(&st, &msg) == MNPB_EIO);
+    (void)mnpb_stream_fini(&st);
+    (void)close(fds[0]);
+    (void)stream_01_fini(&msg);
+}
+
+
+/*
+ * the frame size is checked before anything is buffered
+ */
+static void
+test_prefix(void)
+{
+    mnpb_stream_t st;
+    struct stream_01 msg;
+    int fds[2];
+    /* SSIZE_MAX, then three bytes of it */
+    static const char huge[] =
+        "\xff\xff\xff\xff\xff\xff\xff\xff\x7f\x01\x02\x03";
+    static const char cut[] = "\x80";
+
+    memset(&msg, 0, sizeof(msg));
+
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], huge, sizeof(huge) - 1) == sizeof(huge) - 1);
+    (void)close(fds[1]);
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[0], 16);
+    assert(stream_01_stream_read(&st, &msg) == MNPB_ESIZE);
+    (void)mnpb_stream_fini(&st);
+    (void)close(fds[0]);
+
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], cut, sizeof(cut) - 1) == sizeof(cut) - 1);
+    (void)close(fds[1]);
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[0], 16);
+    assert(stream_01_stream_read(&st, &msg) == MNPB_EIO);
+    (void)mnpb_stream_fini(&st);
+    (void)close(fds[0]);
+
+    (void)stream_01_fini(&msg);
+}
+
+
+/*
+ * what is still buffered goes out on fini
+ */
+static void
+test_fini(void)
+{
+    mnpb_stream_t st;
+    struct stream_01 msg;
+    int fds[2];
+
+    assert(pipe(fds) == 0);
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[1], 64);
+    memset(&msg, 0, sizeof(msg));
+    stream_01_fill(&msg, 5);
+    assert(stream_01_stream_write(&st, &msg) > 0);
+    assert(SEOD(&st.bs) > 0);
+    assert(mnpb_stream_fini(&st) == 0);
+    (void)close(fds[1]);
+    (void)stream_01_fini(&msg);
+
+    mnpb_stream_init(&st, (void *)(intptr_t)fds[0], 16);
+    memset(&msg, 0, sizeof(msg));
+    assert(stream_01_stream_read(&st, &msg) > 0);
+    assert(msg.id == 5);
+    assert(stream_01_stream_read(&st, &msg) == MNPB_EOF);
+    (void)mnpb_stream_fini(&st);
+    (void)close(fds[0]);
+
+    /* and may fail */
+    mnpb_stream_init(&st, (void *)(intptr_t)-1, 64);
+    assert(stream_01_stream_write(&st, &msg) > 0);
+    assert(mnpb_stream_fini(&st) == MNPB_EIO);
+    (void)stream_01_fini(&msg);
+}
+
+
+int
+main(void)
+{
+    mnpb_arena_t arena;
+    int fds[2];
+
+    assert(pipe(fds) == 0);
+    write_all(fds[1]);
+    (void)close(fds[1]);
+    read_all(fds[0], NULL);
+    (void)close(fds[0]);
+
+    mnpb_arena_init(&arena, 256);
+    assert(pipe(fds) == 0);
+    write_all(fds[1]);
+    (void)close(fds[1]);
+    read_all(fds[0], &arena);
+    (void)close(fds[0]);
+    mnpb_arena_fini(&arena);
+
+    test_truncated();
+    test_prefix();
+    test_fini();
+
+    return 0;
+}
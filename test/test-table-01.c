@@ -0,0 +1,312 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/table-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+/*
+ * as written by the unrolled code (mnpbc without -T) for the message
+ * of table_01_fill()
+ */
+static const char encoded[] =
+    "\x09\x00\x00\x00\x00\x00\x00\xf8\x3f"
+    "\x18\xfe\xff\xff\xff\x0f"
+    "\x30\xac\x02"
+    "\x38\x05"
+    "\x4d\x07\x00\x00\x00"
+    "\x61\xf8\xff\xff\xff\xff\xff\xff\xff"
+    "\x68\x01"
+    "\x70\x02"
+    "\x7a\x03\x61\x62\x63"
+    "\x8a\x01\x05\x08\x05\x12\x01\x78"
+    "\x92\x01\x06\x01\xff\xff\xff\xff\x0f"
+    "\xaa\x01\x08\x00\x00\x00\x00\x00\x00\xe0\x3f"
+    "\xc2\x01\x02\x01\x74"
+    "\xd2\x01\x04\x02\x08\x01\x00"
+    "\xf2\x01\x02\x68\x69"
+    "\xc0\x0c\x09";
+
+static const char dumped[] =
+    "{ 1:8:d=1.5 2:4:f=0 3:V:i32=-2 4:V:i64=0 5:V:u32=0 6:V:u64=300 "
+    "7:V:s32=-3 8:V:s64=0 9:4:fx32=7 10:8:fx64=0 11:4:sfx32=0 "
+    "12:8:sfx64=18446744073709551608 13:V:b=1 14:V:color=2 "
+    "15:L:name=\"abc\" 16:L:blob= "
+    "17:L:item={ 1:V:code=5 2:L:label=\"x\" 3:V:marks=[ ]  }  "
+    "18:V:ri32=[ 1 -1 ]  19:V:rs64=[ ]  20:4:rfx32=[ ]  "
+    "21:8:rd=[ 0.5 ]  22:V:rb=[ ]  23:V:rcolor=[ ]  "
+    "24:L:tags=[ \"t\" ]  25:L:blobs=[ ]  "
+    "26:L:items=[ { 1:V:code=1 2:L:label= 3:V:marks=[ ]  }  "
+        "{ 1:V:code=0 2:L:label= 3:V:marks=[ ]  }  ]  "
+    "-1::body=30:L:text=\"hi\" 200:V:last=9 } ";
+
+
+static void
+table_01_fill(struct table_01 *msg)
+{
+    int32_t *ri32;
+    double *rd;
+    mnbytes_t **tags;
+    struct table_01_item *items;
+
+    msg->d = 1.5;
+    msg->i32 = -2;
+    msg->u64 = 300;
+    msg->s32 = -3;
+    msg->fx32 = 7;
+    msg->sfx64 = -8;
+    msg->b = true;
+    msg->color = GREEN;
+    msg->name = bytes_new_from_str("abc");
+    BYTES_INCREF(msg->name);
+    msg->item.code = 5;
+    msg->item.label = bytes_new_from_str("x");
+    BYTES_INCREF(msg->item.label);
+    ri32 = table_01_ri32_alloc(msg, 2);
+    assert(ri32 != NULL);
+    ri32[0] = 1;
+    ri32[1] = -1;
+    rd = table_01_rd_alloc(msg, 1);
+    assert(rd != NULL);
+    rd[0] = 0.5;
+    tags = table_01_tags_alloc(msg, 1);
+    assert(tags != NULL);
+    tags[0] = bytes_new_from_str("t");
+    BYTES_INCREF(tags[0]);
+    items = table_01_items_alloc(msg, 2);
+    assert(items != NULL);
+    memset(items, 0, sizeof(*items) * 2);
+    items[0].code = 1;
+    TABLE_01_PROTO_SET(msg, body, text, bytes_new_from_str("hi"));
+    BYTES_INCREF(msg->body.data.text);
+    msg->last = 9;
+}
+
+
+static void
+table_01_cmp(struct table_01 *a, struct table_01 *b)
+{
+    size_t i;
+
+    assert(a->d == b->d);
+    assert(a->i32 == b->i32);
+    assert(a->u64 == b->u64);
+    assert(a->s32 == b->s32);
+    assert(a->fx32 == b->fx32);
+    assert(a->sfx64 == b->sfx64);
+    assert(a->b == b->b);
+    assert(a->color == b->color);
+    assert(bytes_cmp(a->name, b->name) == 0);
+    assert(a->item.code == b->item.code);
+    assert(bytes_cmp(a->item.label, b->item.label) == 0);
+    assert(a->ri32.sz == b->ri32.sz);
+    for (i = 0; i < a->ri32.sz; ++i) {
+        assert(a->ri32.data[i] == b->ri32.data[i]);
+    }
+    assert(a->rd.sz == b->rd.sz);
+    for (i = 0; i < a->rd.sz; ++i) {
+        assert(a->rd.data[i] == b->rd.data[i]);
+    }
+    assert(a->tags.sz == b->tags.sz);
+    for (i = 0; i < a->tags.sz; ++i) {
+        assert(bytes_cmp(a->tags.data[i], b->tags.data[i]) == 0);
+    }
+    assert(a->items.sz == b->items.sz);
+    for (i = 0; i < a->items.sz; ++i) {
+        assert(a->items.data[i].code == b->items.data[i].code);
+    }
+    assert(a->body.fnum == b->body.fnum);
+    assert(bytes_cmp(a->body.data.text, b->body.data.text) == 0);
+    assert(a->last == b->last);
+}
+
+
+static ssize_t
+decode(const char *data, size_t sz, struct table_01 *msg)
+{
+    mnbytestream_t bs;
+    ssize_t res;
+
+    (void)bytestream_init(&bs, sz);
+    (void)bytestream_cat(&bs, sz, data);
+    (void)table_01_rawsz(msg, SEOD(&bs));
+    res = table_01_unpack(&bs, NULL, msg);
+    bytestream_fini(&bs);
+    return res;
+}
+
+
+static void
+test_encode(void)
+{
+    struct table_01 *msg0, *msg1;
+    mnbytestream_t bs;
+    ssize_t sz;
+
+    msg0 = table_01_new();
+    assert(msg0 != NULL);
+    table_01_fill(msg0);
+
+    (void)bytestream_init(&bs, 32);
+    sz = table_01_pack(&bs, msg0);
+    assert(sz == (ssize_t)sizeof(encoded) - 1);
+    assert(sz == (ssize_t)table_01_sz(msg0));
+    assert(memcmp(SDATA(&bs, 0), encoded, sz) == 0);
+
+    bytestream_rewind(&bs);
+    (void)table_01_dump(&bs, msg0);
+    TRACE("dump: %s", SDATA(&bs, 0));
+    assert(strcmp(SDATA(&bs, 0), dumped) == 0);
+
+    /*
+     * round trip, twice into the same message
+     */
+    msg1 = table_01_new();
+    assert(msg1 != NULL);
+    assert(decode(encoded, sizeof(encoded) - 1, msg1) == sz);
+    table_01_cmp(msg0, msg1);
+    (void)table_01_clear(msg1);
+    assert(decode(encoded, sizeof(encoded) - 1, msg1) == sz);
+    table_01_cmp(msg0, msg1);
+
+    bytestream_rewind(&bs);
+    assert(table_01_pack(&bs, msg1) == sz);
+    assert(memcmp(SDATA(&bs, 0), encoded, sz) == 0);
+
+    bytestream_fini(&bs);
+    table_01_destroy(&msg0);
+    table_01_destroy(&msg1);
+}
+
+
+static void
+test_decode(void)
+{
+    struct table_01 *msg;
+    /* text, then sub, then code, then an unknown field 100 */
+    static const char oneof[] =
+        "\xf2\x01\x02\x68\x69"
+        "\x82\x02\x04\x08\x03\x12\x00"
+        "\xf8\x01\x07"
+        "\xa0\x06\x01";
+    /* packed int32 run as a varint */
+    static const char etype[] = "\x90\x01\x01";
+
+    msg = table_01_new();
+    assert(msg != NULL);
+    assert(decode(oneof, 5, msg) == 5);
+    assert(TABLE_01_PROTO_GETFNUM(msg, body) ==
+           TABLE_01_PROTO_FNUM(body, text));
+    (void)table_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(oneof, 12, msg) == 12);
+    assert(TABLE_01_PROTO_GETFNUM(msg, body) ==
+           TABLE_01_PROTO_FNUM(body, sub));
+    assert(msg->body.data.sub.code == 3);
+    assert(msg->body.data.sub.label == NULL);
+    (void)table_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(oneof, sizeof(oneof) - 1, msg) ==
+           (ssize_t)sizeof(oneof) - 1);
+    assert(TABLE_01_PROTO_GETFNUM(msg, body) ==
+           TABLE_01_PROTO_FNUM(body, code));
+    assert(msg->body.data.code == 7);
+    (void)table_01_fini(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    assert(decode(etype, sizeof(etype) - 1, msg) == MNPB_ETYPE);
+
+    table_01_destroy(&msg);
+}
+
+
+/*
+ * a oneof member with a repeated field met twice, within an arena
+ */
+static void
+test_arena(void)
+{
+    struct table_01 *msg;
+    mnpb_arena_t arena;
+    mnbytestream_t bs;
+    static const char sub[] =
+        "\x82\x02\x06\x08\x03\x1a\x02\x01\x02"
+        "\x82\x02\x06\x08\x04\x1a\x02\x03\x04";
+
+    mnpb_arena_init(&arena, 256);
+    (void)bytestream_init(&bs, 32);
+    (void)bytestream_cat(&bs, sizeof(sub) - 1, sub);
+    msg = table_01_new_arena(&arena);
+    assert(msg != NULL);
+    (void)table_01_rawsz(msg, SEOD(&bs));
+    assert(table_01_unpack_arena(&bs, NULL, &arena, msg) == SEOD(&bs));
+    assert(TABLE_01_PROTO_GETFNUM(msg, body) ==
+           TABLE_01_PROTO_FNUM(body, sub));
+    assert(msg->body.data.sub.code == 4);
+    assert(msg->body.data.sub.marks.sz == 2);
+    assert(msg->body.data.sub.marks.data[1] == 4);
+    bytestream_fini(&bs);
+    mnpb_arena_fini(&arena);
+}
+
+
+/*
+ * packed run lengths that cannot be buffered
+ */
+static void
+test_huge(void)
+{
+    /* ri32, rfx32, rd */
+    static const int fnums[] = { 18, 20, 21 };
+    static const uint64_t lens[] = {
+        UINT64_MAX,
+        UINT64_MAX - 7,
+        0x8000000000000008ull,
+    };
+    struct table_01 *msg;
+    unsigned i, j;
+
+    msg = table_01_new();
+    assert(msg != NULL);
+    for (i = 0; i < countof(fnums); ++i) {
+        for (j = 0; j < countof(lens); ++j) {
+            mnbytestream_t bs;
+
+            (void)bytestream_init(&bs, 32);
+            assert(mnpb_envarint(&bs, ((uint64_t)fnums[i] << 3) | 2) > 0);
+            assert(mnpb_envarint(&bs, lens[j]) > 0);
+            (void)bytestream_cat(&bs, 4, "\x01\x02\x03\x04");
+            (void)table_01_rawsz(msg, SEOD(&bs));
+            assert(table_01_unpack(&bs, NULL, msg) == MNPB_ESIZE);
+            (void)table_01_clear(msg);
+            bytestream_fini(&bs);
+        }
+    }
+    table_01_destroy(&msg);
+}
+
+
+int
+main(void)
+{
+    test_encode();
+    test_decode();
+    test_arena();
+    test_huge();
+    return 0;
+}
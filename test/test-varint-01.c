@@ -0,0 +1,255 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+
+static void
+test0(void)
+{
+    struct {
+        int rnd;
+        uint64_t in;
+        ssize_t sz;
+    } data[] = {
+        {0, 0ul, 1},
+        {0, 1ul, 1},
+        {0, 0x7ful, 1},
+        {0, 0x80ul, 2},
+        {0, 0x3ffful, 2},
+        {0, 0x4000ul, 3},
+        {0, 0x0fffffffful, 5},
+        {0, 0xfffffffful, 5},
+        {0, 0x00ffffffffffffful, 8},
+        {0, 0x0100000000000000ul, 9},
+        {0, 0x7ffffffffffffffful, 9},
+        {0, 0x8000000000000000ul, 10},
+        {0, 0xfffffffffffffffful, 10},
+    };
+    UNITTEST_PROLOG_RAND;
+
+    FOREACHDATA {
+        mnbytestream_t bs;
+        uint64_t v;
+        ssize_t sz;
+        off_t pad;
+
+        /*
+         * no padding exercises the byte-by-byte path, padding
+         * exercises the bulk path
+         */
+        for (pad = 0; pad <= MNPB_VARINT_MAXSZ; pad += MNPB_VARINT_MAXSZ) {
+            (void)bytestream_init(&bs, 32);
+            sz = mnpb_envarint(&bs, CDATA.in);
+            assert(sz == CDATA.sz);
+            assert(mnpb_szvarint(CDATA.in) == CDATA.sz);
+            for (off_t j = 0; j < pad; ++j) {
+                SCATC(&bs, 0);
+            }
+
+            v = 0;
+            sz = mnpb_devarint(&bs, NULL, &v);
+            assert(sz == CDATA.sz);
+            assert(v == CDATA.in);
+            assert(SPOS(&bs) == CDATA.sz);
+            bytestream_fini(&bs);
+        }
+    }
+}
+
+
+static void
+test1(void)
+{
+    mnbytestream_t bs;
+    uint64_t v;
+    int i;
+
+    /*
+     * a run of varints of all lengths, decoded back to back
+     */
+    (void)bytestream_init(&bs, 32);
+    for (i = 0; i < 64; ++i) {
+        assert(mnpb_envarint(&bs, 1ul << i) == mnpb_szvarint(1ul << i));
+        assert(mnpb_envarint(&bs, (1ul << i) - 1) ==
+               mnpb_szvarint((1ul << i) - 1));
+    }
+
+    for (i = 0; i < 64; ++i) {
+        assert(mnpb_devarint(&bs, NULL, &v) > 0);
+        assert(v == 1ul << i);
+        assert(mnpb_devarint(&bs, NULL, &v) > 0);
+        assert(v == (1ul << i) - 1);
+    }
+    assert(SAVAIL(&bs) == 0);
+    assert(mnpb_devarint(&bs, NULL, &v) == MNPB_EIO);
+    bytestream_fini(&bs);
+}
+
+
+static void
+test2(void)
+{
+    mnbytestream_t bs;
+    uint64_t tag, v;
+    int wtype;
+    char *blob;
+    size_t sz;
+
+    /*
+     * unknown length-delimited field larger than MNPB_MAX_BYTES
+     */
+    sz = 0x100000 + 1;
+    blob = malloc(sz);
+    assert(blob != NULL);
+    memset(blob, 'x', sz);
+
+    (void)bytestream_init(&bs, 32);
+    (void)mnpb_envarint(&bs, (5 << 3) | 2); /* ldelim */
+    (void)mnpb_envarint(&bs, sz);
+    (void)bytestream_cat(&bs, sz, blob);
+    (void)mnpb_envarint(&bs, 0x1234);
+
+    assert(mnpb_unpack_key(&bs, NULL, &tag, &wtype) > 0);
+    assert(tag == 5);
+    assert(wtype == 2);
+    assert(mnpb_devoid(&bs, NULL, tag, wtype) ==
+           (ssize_t)(mnpb_szvarint(sz) + sz));
+    assert(mnpb_devarint(&bs, NULL, &v) > 0);
+    assert(v == 0x1234);
+    assert(SAVAIL(&bs) == 0);
+
+    bytestream_fini(&bs);
+    free(blob);
+}
+
+
+static void
+test3(void)
+{
+    uint64_t keys[] = {
+        (1 << 3) | 0,
+        (15 << 3) | 2,
+        (16 << 3) | 2,
+        (2047 << 3) | 5,
+        (2048 << 3) | 1,
+        (0x1fffffffull << 3) | 2,
+    };
+    mnbytestream_t bs0, bs1;
+    mnpb_rbuf_t rb;
+    uint64_t v;
+    unsigned i;
+    int j;
+
+    /*
+     * precomputed tags, the way mnpbc emits them
+     */
+    (void)bytestream_init(&bs0, 32);
+    (void)bytestream_init(&bs1, 32);
+    mnpb_rbuf_init(&rb, 1);
+    for (i = 0; i < countof(keys); ++i) {
+        uint64_t w;
+        ssize_t sz;
+
+        sz = mnpb_envarint(&bs0, keys[i]);
+        w = 0;
+        for (j = 0; j < sz; ++j) {
+            w |= (uint64_t)(unsigned char)*SDATA(&bs0, SEOD(&bs0) - sz + j) <<
+                (j * 8);
+        }
+        assert(mnpb_entag(&bs1, w, sz) == sz);
+        assert(mnpb_rentag(&rb, w, sz) == sz);
+    }
+    assert(SEOD(&bs1) == SEOD(&bs0));
+    assert(memcmp(SDATA(&bs1, 0), SDATA(&bs0, 0), SEOD(&bs0)) == 0);
+    bytestream_fini(&bs1);
+
+    /*
+     * reverse ones come out last first
+     */
+    (void)bytestream_init(&bs1, 32);
+    for (i = countof(keys); i > 0; --i) {
+        (void)mnpb_envarint(&bs1, keys[i - 1]);
+    }
+    assert(MNPB_RBUF_LEN(&rb) == (size_t)SEOD(&bs1));
+    assert(memcmp(MNPB_RBUF_DATA(&rb), SDATA(&bs1, 0), SEOD(&bs1)) == 0);
+    bytestream_fini(&bs1);
+
+    /*
+     * reverse varints of all lengths
+     */
+    mnpb_rbuf_reset(&rb);
+    for (j = 63; j >= 0; --j) {
+        (void)mnpb_renvarint(&rb, (1ul << j) - 1);
+        (void)mnpb_renvarint(&rb, 1ul << j);
+    }
+    (void)bytestream_init(&bs1, 32);
+    (void)bytestream_cat(&bs1, MNPB_RBUF_LEN(&rb), MNPB_RBUF_DATA(&rb));
+    for (j = 0; j < 64; ++j) {
+        assert(mnpb_devarint(&bs1, NULL, &v) > 0);
+        assert(v == 1ul << j);
+        assert(mnpb_devarint(&bs1, NULL, &v) > 0);
+        assert(v == (1ul << j) - 1);
+    }
+    assert(SAVAIL(&bs1) == 0);
+
+    mnpb_rbuf_fini(&rb);
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs1);
+}
+
+
+/*
+ * packed run lengths that cannot be buffered
+ */
+static void
+test4(void)
+{
+    mnbytestream_t bs;
+    int32_t out[4];
+
+    (void)bytestream_init(&bs, 32);
+    (void)bytestream_cat(&bs, 4, "\x01\x02\x03\x04");
+    assert(mnpb_count_packed_varint(&bs, NULL, SIZE_MAX) == MNPB_ESIZE);
+    assert(mnpb_count_packed_varint(&bs, NULL, (size_t)SSIZE_MAX + 1) ==
+           MNPB_ESIZE);
+    assert(mnpb_unpack_packed_int32(&bs, NULL, SIZE_MAX, out, 4) ==
+           MNPB_ESIZE);
+    /* the element count would fit a bogus cap */
+    assert(mnpb_unpack_packed_fixed32(&bs,
+                                      NULL,
+                                      0x8000000000000004ull,
+                                      (uint32_t *)out,
+                                      SIZE_MAX) == MNPB_ESIZE);
+    assert(SPOS(&bs) == 0);
+    assert(mnpb_count_packed_varint(&bs, NULL, 4) == 4);
+    assert(mnpb_unpack_packed_int32(&bs, NULL, 4, out, 4) == 4);
+    assert(out[3] == 4);
+    assert(SAVAIL(&bs) == 0);
+    bytestream_fini(&bs);
+}
+
+
+int
+main(void)
+{
+    test0();
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
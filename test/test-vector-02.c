@@ -0,0 +1,202 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/vector-02.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define NITEMS 1000
+
+
+/*
+ * a packed run of the field claiming len bytes, and nothing after
+ */
+static void
+test_huge(int fnum, uint64_t len)
+{
+    struct vector_02 *vec;
+    mnbytestream_t bs;
+
+    (void)bytestream_init(&bs, 32);
+    assert(mnpb_envarint(&bs, ((uint64_t)fnum << 3) | 2) > 0);
+    assert(mnpb_envarint(&bs, len) > 0);
+    (void)bytestream_cat(&bs, 4, "\x01\x02\x03\x04");
+    vec = vector_02_new();
+    assert(vec != NULL);
+    (void)vector_02_rawsz(vec, SEOD(&bs));
+    assert(vector_02_unpack(&bs, NULL, vec) == MNPB_ESIZE);
+    vector_02_destroy(&vec);
+    bytestream_fini(&bs);
+}
+
+
+int
+main(void)
+{
+    struct vector_02 *vec0, *vec1;
+    int32_t *i32;
+    int64_t *i64;
+    uint32_t *u32;
+    uint64_t *u64;
+    int32_t *s32;
+    int64_t *s64;
+    bool *flags;
+    enum vector_02_kind_t *kinds;
+    uint32_t *f32;
+    uint64_t *f64;
+    int32_t *sf32;
+    int64_t *sf64;
+    float *fl;
+    double *dbl;
+
+    mnbytestream_t bs0, bs1;
+    mnbytes_t *s;
+    ssize_t sz;
+    int i;
+
+    vec0 = vector_02_new();
+    assert(vec0 != NULL);
+    vec1 = vector_02_new();
+    assert(vec1 != NULL);
+
+    i32 = vector_02_i32_alloc(vec0, NITEMS);
+    i64 = vector_02_i64_alloc(vec0, NITEMS);
+    u32 = vector_02_u32_alloc(vec0, NITEMS);
+    u64 = vector_02_u64_alloc(vec0, NITEMS);
+    s32 = vector_02_s32_alloc(vec0, NITEMS);
+    s64 = vector_02_s64_alloc(vec0, NITEMS);
+    flags = vector_02_flags_alloc(vec0, NITEMS);
+    kinds = vector_02_kinds_alloc(vec0, NITEMS);
+    f32 = vector_02_f32_alloc(vec0, NITEMS);
+    f64 = vector_02_f64_alloc(vec0, NITEMS);
+    sf32 = vector_02_sf32_alloc(vec0, NITEMS);
+    sf64 = vector_02_sf64_alloc(vec0, NITEMS);
+    fl = vector_02_fl_alloc(vec0, NITEMS);
+    dbl = vector_02_dbl_alloc(vec0, NITEMS);
+
+    /*
+     * mostly small values, so that the single-byte runs are hit, with
+     * an occasional long one
+     */
+    for (i = 0; i < NITEMS; ++i) {
+        i32[i] = (i % 17) ? i % 100 : -i;
+        i64[i] = (i % 13) ? i % 100 : -((int64_t)i << 40);
+        u32[i] = (i % 11) ? (uint32_t)(i % 100) : 0xffffffffu - i;
+        u64[i] = (i % 7) ? (uint64_t)(i % 100) : 0xfffffffffffffffful - i;
+        s32[i] = (i % 2) ? -i : i;
+        s64[i] = (i % 3) ? -((int64_t)i << 33) : i;
+        flags[i] = (i % 5) == 0;
+        kinds[i] = (i % 3) == 0 ? NONE : (i % 3) == 1 ? SOME : MANY;
+        f32[i] = 0xdeadbeefu ^ (uint32_t)i;
+        f64[i] = 0xdeadbeefcafebabeul ^ (uint64_t)i;
+        sf32[i] = -i;
+        sf64[i] = -((int64_t)i << 33);
+        fl[i] = (float)i / 3.0f;
+        dbl[i] = (double)i / 7.0;
+    }
+
+    (void)bytestream_init(&bs0, 32);
+
+    sz = vector_02_pack(&bs0, vec0);
+    assert(sz == (ssize_t)vector_02_sz(vec0));
+
+    s = bytes_new_from_mem_len(SPDATA(&bs0), SEOD(&bs0));
+    bytestream_from_bytes(&bs1, s);
+    SEOD(&bs1) = BSZ(s);
+
+    (void)vector_02_rawsz(vec1, SEOD(&bs1));
+    sz = vector_02_unpack(&bs1, NULL, vec1);
+    assert(sz == SEOD(&bs1));
+
+#define VECTOR_02_CMP(f)                                       \
+    assert(vec1->f.sz == vec0->f.sz);                          \
+    for (i = 0; i < NITEMS; ++i) {                             \
+        assert(vec1->f.data[i] == vec0->f.data[i]);            \
+    }                                                          \
+
+
+    VECTOR_02_CMP(i32);
+    VECTOR_02_CMP(i64);
+    VECTOR_02_CMP(u32);
+    VECTOR_02_CMP(u64);
+    VECTOR_02_CMP(s32);
+    VECTOR_02_CMP(s64);
+    VECTOR_02_CMP(flags);
+    VECTOR_02_CMP(kinds);
+    VECTOR_02_CMP(f32);
+    VECTOR_02_CMP(f64);
+    VECTOR_02_CMP(sf32);
+    VECTOR_02_CMP(sf64);
+    VECTOR_02_CMP(fl);
+    VECTOR_02_CMP(dbl);
+
+    /*
+     * packed runs are counted upfront and allocated once
+     */
+    assert(vec1->i32.cap == NITEMS);
+    assert(vec1->dbl.cap == NITEMS);
+
+    /*
+     * one by one, the capacity doubles
+     */
+    vector_02_fini(vec1);
+    assert(vec1->i32.sz == 0 && vec1->i32.cap == 0);
+    for (i = 0; i < NITEMS; ++i) {
+        int32_t *item;
+
+        item = vector_02_i32_alloc(vec1, 1);
+        assert(item != NULL);
+        *item = i;
+        assert(vec1->i32.cap >= vec1->i32.sz);
+        assert(vec1->i32.cap < 2 * vec1->i32.sz);
+    }
+    for (i = 0; i < NITEMS; ++i) {
+        assert(vec1->i32.data[i] == i);
+    }
+
+    assert(vector_02_i64_reserve(vec1, NITEMS) == 0);
+    assert(vec1->i64.cap == NITEMS);
+    assert(vec1->i64.sz == 0);
+    i64 = vector_02_i64_alloc(vec1, NITEMS);
+    assert(i64 != NULL);
+    assert(vec1->i64.cap == NITEMS);
+
+    vector_02_destroy(&vec0);
+    assert(vec0 == NULL);
+    vector_02_destroy(&vec1);
+    assert(vec1 == NULL);
+
+    bytestream_fini(&bs0);
+    BYTES_DECREF(&s);
+
+    /*
+     * varint runs
+     */
+    for (i = 1; i <= 8; ++i) {
+        test_huge(i, UINT64_MAX);
+        test_huge(i, (uint64_t)SSIZE_MAX + 1);
+    }
+
+    /*
+     * fixed-width runs, whose element count would truncate to 1 or 2
+     */
+    for (i = 9; i <= 14; ++i) {
+        test_huge(i, 0x8000000000000004ull);
+        test_huge(i, 0x8000000000000008ull);
+        test_huge(i, UINT64_MAX - 7);
+    }
+
+    return 0;
+}
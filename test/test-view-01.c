@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <string.h>
+
+#include <mncommon/bytes.h>
+#include <mncommon/bytestream_aux.h>
+#include <mncommon/dumpm.h>
+#include <mncommon/util.h>
+
+#include <mnprotobuf.h>
+
+#include "data/view-01.h"
+
+#include "unittest.h"
+
+#ifndef NDEBUG
+const char *_malloc_options = "AJ";
+#endif
+
+#define VIEW_01_SET(v, s) do { (v).data = (s); (v).sz = strlen(s); } while (0)
+
+#define VIEW_01_CMP(a, b)                                              \
+    assert((a).sz == (b).sz);                                          \
+    assert(memcmp((a).data, (b).data, (a).sz) == 0)                    \
+
+
+#define VIEW_01_INSIDE(v, s)                                           \
+    assert((const char *)(v).data >= BCDATA(s) &&                      \
+           (const char *)(v).data + (v).sz <= BCDATA(s) + BSZ(s))      \
+
+
+int
+main(void)
+{
+    struct view_01 *vw0, *vw1;
+    mnpb_view_t *tag;
+    mnbytestream_t bs0, bs1, bs2;
+    mnbytes_t *s;
+    ssize_t sz;
+
+    vw0 = view_01_new();
+    assert(vw0 != NULL);
+    vw1 = view_01_new();
+    assert(vw1 != NULL);
+
+    vw0->id = 123;
+    VIEW_01_SET(vw0->name, "FOO");
+    VIEW_01_SET(vw0->blob, "\x01\x02\x03");
+    tag = view_01_tags_alloc(vw0, 3);
+    VIEW_01_SET(tag[0], "the");
+    VIEW_01_SET(tag[1], "quick");
+    VIEW_01_SET(tag[2], "brown fox");
+    VIEW_01_SET(VIEW_01_PROTO_MEMBER(vw0, note, text), "jumps over");
+    VIEW_01_PROTO_SETFNUM(vw0, note, text);
+    VIEW_01_SET(vw0->inner.first, "John");
+    VIEW_01_SET(vw0->inner.last, "Doe");
+
+    (void)bytestream_init(&bs0, 32);
+
+    sz = view_01_pack(&bs0, vw0);
+    assert(sz == (ssize_t)view_01_sz(vw0));
+
+    s = bytes_new_from_mem_len(SPDATA(&bs0), SEOD(&bs0));
+    bytestream_from_bytes(&bs1, s);
+    SEOD(&bs1) = BSZ(s);
+
+    (void)view_01_rawsz(vw1, SEOD(&bs1));
+    sz = view_01_unpack(&bs1, NULL, vw1);
+    assert(sz == SEOD(&bs1));
+
+    /*
+     * decoded fields point into the input buffer
+     */
+    assert(vw1->id == 123);
+    VIEW_01_CMP(vw1->name, vw0->name);
+    VIEW_01_INSIDE(vw1->name, s);
+    VIEW_01_CMP(vw1->blob, vw0->blob);
+    VIEW_01_INSIDE(vw1->blob, s);
+    assert(vw1->tags.sz == 3);
+    VIEW_01_CMP(vw1->tags.data[0], vw0->tags.data[0]);
+    VIEW_01_CMP(vw1->tags.data[1], vw0->tags.data[1]);
+    VIEW_01_CMP(vw1->tags.data[2], vw0->tags.data[2]);
+    VIEW_01_INSIDE(vw1->tags.data[2], s);
+    assert(VIEW_01_PROTO_GETFNUM(vw1, note) ==
+           VIEW_01_PROTO_FNUM(note, text));
+    VIEW_01_CMP(VIEW_01_PROTO_MEMBER(vw1, note, text),
+                VIEW_01_PROTO_MEMBER(vw0, note, text));
+    VIEW_01_CMP(vw1->inner.first, vw0->inner.first);
+    VIEW_01_CMP(vw1->inner.last, vw0->inner.last);
+    VIEW_01_INSIDE(vw1->inner.last, s);
+
+    /*
+     * and re-encode to the same bytes
+     */
+    (void)bytestream_init(&bs2, 32);
+    sz = view_01_pack(&bs2, vw1);
+    assert(sz == SEOD(&bs0));
+    assert(memcmp(SDATA(&bs2, 0), SDATA(&bs0, 0), sz) == 0);
+
+    bytestream_rewind(&bs2);
+    sz = view_01_pack_reverse(&bs2, vw1);
+    assert(sz == SEOD(&bs0));
+    assert(memcmp(SDATA(&bs2, 0), SDATA(&bs0, 0), sz) == 0);
+
+    bytestream_rewind(&bs0);
+    sz = view_01_dump(&bs0, vw1);
+    TRACE("dump: %s", SPDATA(&bs0));
+
+    view_01_destroy(&vw0);
+    assert(vw0 == NULL);
+    view_01_destroy(&vw1);
+    assert(vw1 == NULL);
+
+    bytestream_fini(&bs0);
+    bytestream_fini(&bs2);
+    BYTES_DECREF(&s);
+
+    return 0;
+}